@@ -0,0 +1,113 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Runs buffer manager workloads against a simulated device, so results depend
+// on the buffer manager and the device profile rather than on the local disk.
+//
+// Files live in MemoryStorage behind a ThrottledStorage with the given read
+// latency and bandwidth.  Each workload reports the pool hit ratio and
+// throughput:
+//   uniform   - reads spread evenly over the file
+//   skewed    - 80% of reads go to the first 20% of pages
+//   scan      - repeated full scans of the file
+//
+// Usage: bufmgr_bench [pages] [frames] [reads] [latency_us] [MB/s]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <string>
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "storage.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::string kFilename = "bufmgr_bench.db";
+
+PageId numPages = 8192;
+std::uint32_t numFrames = 1024;
+std::uint32_t numReads = 20000;
+DeviceProfile profile = {std::chrono::microseconds(100),
+                         std::chrono::microseconds(100),
+                         std::chrono::microseconds(1000),
+                         500 * 1000 * 1000};
+
+void createFile() {
+  File file = File::create(kFilename);
+  std::vector<Page> pages = file.allocatePages(numPages);
+  for (Page &page : pages) {
+    page.insertRecord("page " + std::to_string(page.page_number()));
+    file.writePage(page);
+  }
+}
+
+void run(const char *name, const std::function<PageId()> &nextPage) {
+  File file = File::open(kFilename);
+  BufMgr bufMgr(numFrames);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < numReads; i++) {
+    const PageId pageNo = nextPage();
+    Page *page;
+    bufMgr.readPage(file, pageNo, page);
+    bufMgr.unPinPage(file, pageNo, false);
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  const BufStats &stats = bufMgr.getBufStats();
+  const double hitRatio =
+      1.0 - static_cast<double>(stats.diskreads) / stats.accesses;
+  std::printf("%-9s %10.4f %10d %12.0f\n", name, hitRatio, stats.diskreads,
+              numReads / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) numFrames = std::atoi(argv[2]);
+  if (argc > 3) numReads = std::atoi(argv[3]);
+  if (argc > 4) {
+    profile.read_latency = std::chrono::microseconds(std::atoi(argv[4]));
+  }
+  if (argc > 5) profile.bytes_per_second = std::atoll(argv[5]) * 1000 * 1000;
+
+  File::setStorage(std::make_shared<MemoryStorage>());
+  createFile();
+  File::setStorage(
+      std::make_shared<ThrottledStorage>(File::storage(), profile));
+
+  std::printf(
+      "%u pages, %u frames, %u reads, %lld us read latency, %llu MB/s\n\n",
+      numPages, numFrames, numReads,
+      static_cast<long long>(profile.read_latency.count()),
+      static_cast<unsigned long long>(profile.bytes_per_second / 1000000));
+  std::printf("%-9s %10s %10s %12s\n", "workload", "hit ratio", "misses",
+              "reads/s");
+
+  std::mt19937 random(42);
+  std::uniform_int_distribution<PageId> any(1, numPages);
+  std::uniform_int_distribution<PageId> hot(1, numPages / 5);
+  std::bernoulli_distribution isHot(0.8);
+  run("uniform", [&]() { return any(random); });
+  run("skewed", [&]() { return isHot(random) ? hot(random) : any(random); });
+  PageId next = 0;
+  run("scan", [&]() { return next++ % numPages + 1; });
+
+  File::remove(kFilename);
+  return 0;
+}
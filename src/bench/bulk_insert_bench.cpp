@@ -0,0 +1,88 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Compares ways of loading records into empty pages, moving on to the next
+// page once one is full, for records of a few sizes.
+//
+//   single - Page::insertRecord for each record, after hasSpaceForRecord
+//   batch  - Page::insertRecords with all the records left
+//
+// Usage: bulk_insert_bench [records] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "page.h"
+
+using namespace badgerdb;
+
+namespace {
+
+int numRecords = 200000;
+int numRounds = 10;
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+double load(const std::vector<std::string_view> &records,
+            std::vector<Page> &pages, const bool batch) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; ++round) {
+    std::size_t page = 0;
+    pages[page] = Page();
+    for (std::size_t done = 0; done < records.size();) {
+      if (batch) {
+        done += pages[page]
+                    .insertRecords(records.data() + done,
+                                   records.size() - done)
+                    .size();
+      } else {
+        while (done < records.size() &&
+               pages[page].hasSpaceForRecord(records[done])) {
+          pages[page].insertRecord(records[done++]);
+        }
+      }
+      if (done < records.size()) {
+        pages[++page] = Page();
+      }
+    }
+  }
+  return seconds(start) * 1e9 / (numRounds * records.size());
+}
+
+void run(const std::size_t record_bytes) {
+  std::vector<std::string> storage(numRecords, std::string(record_bytes, 'r'));
+  const std::vector<std::string_view> records(storage.begin(), storage.end());
+  std::vector<Page> pages(numRecords * (record_bytes + 8) / Page::DATA_SIZE +
+                          2);
+  const double single = load(records, pages, false);
+  const double batch = load(records, pages, true);
+  std::printf("%6zu %12.1f %12.1f\n", record_bytes, single, batch);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numRecords = std::atoi(argv[1]);
+  if (argc > 2) numRounds = std::atoi(argv[2]);
+
+  std::printf("%d records, %d rounds, ns per record\n\n", numRecords,
+              numRounds);
+  std::printf("%6s %12s %12s\n", "bytes", "single", "batch");
+  run(8);
+  run(30);
+  run(100);
+  return 0;
+}
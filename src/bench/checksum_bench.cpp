@@ -0,0 +1,108 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Measures the cost of page checksums.
+//
+//   crc32c   - CRC-32C of one page, with SSE4.2 where available and with the
+//              portable table-driven code
+//   readPage - File::readPage on an in-memory file, checksums off and on, so
+//              the cost is not hidden behind the device
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "checksum.h"
+#include "file.h"
+#include "page.h"
+#include "storage.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::string kFilename = "checksum_bench.db";
+
+PageId numPages = 4096;
+
+const int kReadRounds = 10;
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void benchCrc(const char *name,
+              std::uint32_t (*crc)(std::uint32_t, const void *, std::size_t)) {
+  std::vector<char> page(Page::SIZE);
+  for (std::size_t i = 0; i < page.size(); ++i) {
+    page[i] = static_cast<char>(i * 131);
+  }
+  const int rounds = 200000;
+  std::uint32_t sum = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    page[0] = static_cast<char>(i);
+    sum += crc(0, page.data(), page.size());
+  }
+  const double elapsed = seconds(start);
+  std::printf("%-10s %10.1f %10.2f   (%08x)\n", name, elapsed / rounds * 1e9,
+              rounds * (double)Page::SIZE / elapsed / 1e9, sum);
+}
+
+double benchRead(const bool checksums) {
+  double elapsed;
+  {
+    File file = File::create(kFilename);
+    file.setChecksums(checksums);
+    std::vector<Page> pages = file.allocatePages(numPages);
+    const std::string record(Page::DATA_SIZE / 2, 'x');
+    for (Page &page : pages) {
+      page.insertRecord(record);
+      file.writePage(page);
+    }
+
+    std::size_t bytes = 0;
+    const auto start = std::chrono::steady_clock::now();
+    for (int r = 0; r < kReadRounds; ++r) {
+      for (PageId p = 1; p <= numPages; ++p) {
+        bytes += file.readPage(p).getFreeSpace();
+      }
+    }
+    elapsed = seconds(start);
+    if (bytes == 0) std::printf("unexpected\n");
+  }
+  File::remove(kFilename);
+  return elapsed / (kReadRounds * (double)numPages) * 1e9;
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+
+  std::printf("crc32c of one %u byte page (hardware %s)\n\n",
+              static_cast<unsigned>(Page::SIZE),
+              crc32cHardware() ? "available" : "not available");
+  std::printf("%-10s %10s %10s\n", "code", "ns/page", "GB/s");
+  benchCrc("crc32c", crc32c);
+  benchCrc("portable", crc32cPortable);
+
+  File::setStorage(std::make_shared<MemoryStorage>());
+  const double off = benchRead(false);
+  const double on = benchRead(true);
+  std::printf("\nreadPage of %u in-memory pages\n\n", numPages);
+  std::printf("%-10s %10s\n", "checksums", "ns/page");
+  std::printf("%-10s %10.1f\n", "off", off);
+  std::printf("%-10s %10.1f\n", "on", on);
+  return 0;
+}
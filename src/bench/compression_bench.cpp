@@ -0,0 +1,168 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Measures what page compression costs in CPU and saves in I/O.
+//
+// Pages are half filled with repetitive text records, like a table of
+// orders.  The codec is timed on one such page, then a file of them is
+// written and read back page by page, plain and through CompressedStorage,
+// on a simulated device (MemoryStorage behind ThrottledStorage) with the
+// given latency and bandwidth.  Throughput is in bytes of pages, before
+// compression.
+//
+// Usage: compression_bench [pages] [latency_us] [MB/s]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "compressed_storage.h"
+#include "compression.h"
+#include "file.h"
+#include "page.h"
+#include "storage.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::string kFilename = "compression_bench.db";
+
+PageId numPages = 16384;
+DeviceProfile profile = {std::chrono::microseconds(20),
+                         std::chrono::microseconds(20),
+                         std::chrono::microseconds(1000),
+                         200 * 1000 * 1000};
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+// Fills a page half full of order records.
+void fillPage(Page &page) {
+  char record[128];
+  for (int i = 0; page.getFreeSpace() > Page::DATA_SIZE / 2; ++i) {
+    const unsigned order = page.page_number() * 100 + i;
+    std::snprintf(record, sizeof(record),
+                  "order=%08u customer=%06u status=%s region=%s "
+                  "amount=%7.2f",
+                  order, order % 9973, order % 3 ? "SHIPPED" : "PENDING",
+                  order % 2 ? "NORTH-EAST" : "SOUTH-WEST",
+                  (order % 100000) / 100.0);
+    page.insertRecord(record);
+  }
+}
+
+void benchCodec() {
+  // Take the page image from a file, so the bytes are those stored.
+  std::vector<char> image(Page::SIZE);
+  std::shared_ptr<StorageProvider> memory = std::make_shared<MemoryStorage>();
+  File::setStorage(memory);
+  {
+    File file = File::create(kFilename);
+    Page page = file.allocatePage();
+    fillPage(page);
+    file.writePage(page);
+  }
+  memory->open(kFilename, false)
+      ->read(image.data(), image.size(), 2 * Page::SIZE /* page 1 */);
+  File::remove(kFilename);
+
+  std::vector<char> compressed(Page::SIZE * 2);
+  std::vector<char> restored(Page::SIZE);
+  const int rounds = 20000;
+  std::size_t length = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    length = lz4Compress(image.data(), image.size(), compressed.data(),
+                         compressed.size());
+  }
+  const double compress = seconds(start) / rounds;
+  start = std::chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i) {
+    lz4Decompress(compressed.data(), length, restored.data(), restored.size());
+  }
+  const double decompress = seconds(start) / rounds;
+  std::printf("codec on one page: %zu -> %zu bytes (%.2fx)\n", image.size(),
+              length, image.size() / (double)length);
+  std::printf("%-12s %10s %10s\n", "", "us/page", "MB/s");
+  std::printf("%-12s %10.2f %10.0f\n", "compress", compress * 1e6,
+              Page::SIZE / compress / 1e6);
+  std::printf("%-12s %10.2f %10.0f\n\n", "decompress", decompress * 1e6,
+              Page::SIZE / decompress / 1e6);
+}
+
+void run(const char *name, const bool compress) {
+  std::shared_ptr<StorageProvider> memory = std::make_shared<MemoryStorage>();
+  std::shared_ptr<StorageProvider> device =
+      std::make_shared<ThrottledStorage>(memory, profile);
+  if (compress) {
+    File::setStorage(std::make_shared<CompressedStorage>(device));
+  } else {
+    File::setStorage(device);
+  }
+
+  double write_seconds;
+  double read_seconds;
+  {
+    File file = File::create(kFilename);
+    std::vector<Page> pages = file.allocatePages(numPages);
+    for (Page &page : pages) {
+      fillPage(page);
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (const Page &page : pages) {
+      file.writePage(page);
+    }
+    file.sync();
+    write_seconds = seconds(start);
+
+    start = std::chrono::steady_clock::now();
+    std::size_t free_space = 0;
+    for (PageId p = 1; p <= numPages; ++p) {
+      free_space += file.readPage(p).getFreeSpace();
+    }
+    read_seconds = seconds(start);
+    if (free_space == 0) std::printf("unexpected\n");
+  }
+  const off_t stored = memory->open(kFilename, false)->size();
+  File::remove(kFilename);
+
+  const double bytes = numPages * (double)Page::SIZE;
+  std::printf("%-11s %10.1f %10.1f %10.1f %10.1f %8.2f\n", name,
+              bytes / write_seconds / 1e6, bytes / read_seconds / 1e6,
+              bytes / (1 << 20), stored / (double)(1 << 20), bytes / stored);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) {
+    profile.read_latency = profile.write_latency =
+        std::chrono::microseconds(std::atoi(argv[2]));
+  }
+  if (argc > 3) profile.bytes_per_second = std::atoll(argv[3]) * 1000 * 1000;
+
+  benchCodec();
+
+  std::printf("%u pages on a device with %ld us latency, %.0f MB/s\n\n",
+              numPages, static_cast<long>(profile.read_latency.count()),
+              profile.bytes_per_second / 1e6);
+  std::printf("%-11s %10s %10s %10s %10s %8s\n", "file", "write MB/s",
+              "read MB/s", "data MiB", "disk MiB", "ratio");
+  run("plain", false);
+  run("compressed", true);
+  return 0;
+}
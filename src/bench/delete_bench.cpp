@@ -0,0 +1,101 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Measures deletes on full pages, for records of a few sizes.
+//
+//   drain - delete every record of a full page, in random order
+//   churn - delete a random record and insert one of the same size, so
+//           that inserts have to reclaim the space deletes left behind
+//
+// Usage: delete_bench [pages] [seed]
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "page.h"
+
+using namespace badgerdb;
+
+namespace {
+
+int numPages = 256;
+unsigned seed = 1;
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void fill(std::vector<Page> &pages, std::vector<std::vector<RecordId>> &rids,
+          const std::string &record) {
+  for (std::size_t p = 0; p < pages.size(); ++p) {
+    pages[p] = Page();
+    rids[p].clear();
+    while (pages[p].hasSpaceForRecord(record)) {
+      rids[p].push_back(pages[p].insertRecord(record));
+    }
+  }
+}
+
+void run(const std::size_t record_bytes) {
+  std::mt19937 rng(seed);
+  const std::string record(record_bytes, 'r');
+  std::vector<Page> pages(numPages);
+  std::vector<std::vector<RecordId>> rids(numPages);
+
+  fill(pages, rids, record);
+  for (std::vector<RecordId> &page_rids : rids) {
+    std::shuffle(page_rids.begin(), page_rids.end(), rng);
+  }
+  std::size_t deletes = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (std::size_t p = 0; p < pages.size(); ++p) {
+    for (const RecordId &rid : rids[p]) {
+      pages[p].deleteRecord(rid);
+      deletes++;
+    }
+  }
+  const double drain = seconds(start) * 1e9 / deletes;
+
+  fill(pages, rids, record);
+  std::size_t ops = 0;
+  start = std::chrono::steady_clock::now();
+  for (std::size_t p = 0; p < pages.size(); ++p) {
+    for (std::size_t k = 0; k < rids[p].size(); ++k) {
+      RecordId &rid = rids[p][rng() % rids[p].size()];
+      pages[p].deleteRecord(rid);
+      rid = pages[p].insertRecord(record);
+      ops++;
+    }
+  }
+  const double churn = seconds(start) * 1e9 / ops;
+
+  std::printf("%6zu %10zu %12.1f %12.1f\n", record_bytes, rids[0].size(),
+              drain, churn);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) seed = std::atoi(argv[2]);
+
+  std::printf("%d pages\n\n", numPages);
+  std::printf("%6s %10s %12s %12s\n", "bytes", "records", "drain ns",
+              "churn ns");
+  run(4);
+  run(60);
+  run(500);
+  return 0;
+}
@@ -0,0 +1,114 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Compares buffered and direct (O_DIRECT) file I/O at equal total RAM.
+//
+// With buffered I/O every page in the buffer pool is also held by the kernel
+// page cache, so a memory budget of B frames only buys a pool of B / 2
+// frames.  With direct I/O the whole budget goes to the pool.  Both
+// configurations run the same skewed random read workload; the benchmark
+// reports the pool hit ratio and throughput of each.
+//
+// The kernel page cache is not limited here, so buffered misses may be served
+// from memory and its throughput is an upper bound.  For a strict comparison
+// run under a memory limit, e.g.
+//   systemd-run --scope -p MemoryMax=<budget> bench/direct_io_bench
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+
+#include "buffer.h"
+#include "exceptions/file_not_found_exception.h"
+#include "file.h"
+#include "page.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::string kFilename = "direct_io_bench.db";
+
+// Pages in the file, frames in the memory budget, and reads per run.
+PageId numPages = 32768;
+std::uint32_t budgetFrames = 8192;
+std::uint32_t numReads = 400000;
+
+// Builds the file, one record per page.
+void createFile() {
+  try {
+    File::remove(kFilename);
+  } catch (const FileNotFoundException &e) {
+  }
+  File file = File::create(kFilename);
+  std::vector<Page> pages = file.allocatePages(numPages);
+  for (Page &page : pages) {
+    page.insertRecord("page " + std::to_string(page.page_number()));
+    file.writePage(page);
+  }
+  file.sync();
+}
+
+// Reads pages with an 80/20 skew: 80% of reads go to the first 20% of pages.
+void run(const char *name, const bool directIO, const std::uint32_t frames) {
+  // Start with a cold kernel cache.
+  const int fd = ::open(kFilename.c_str(), O_RDONLY);
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  ::close(fd);
+
+  File file = File::open(kFilename);
+  const bool direct = file.setDirectIO(directIO);
+
+  BufMgr bufMgr(frames);
+  std::mt19937 random(42);
+  std::uniform_int_distribution<PageId> hot(1, numPages / 5);
+  std::uniform_int_distribution<PageId> any(1, numPages);
+  std::bernoulli_distribution isHot(0.8);
+
+  const auto start = std::chrono::steady_clock::now();
+  for (std::uint32_t i = 0; i < numReads; i++) {
+    const PageId pageNo = isHot(random) ? hot(random) : any(random);
+    Page *page;
+    bufMgr.readPage(file, pageNo, page);
+    bufMgr.unPinPage(file, pageNo, false);
+  }
+  const double seconds = std::chrono::duration<double>(
+                             std::chrono::steady_clock::now() - start)
+                             .count();
+
+  const BufStats &stats = bufMgr.getBufStats();
+  const double hitRatio =
+      1.0 - static_cast<double>(stats.diskreads) / stats.accesses;
+  std::printf("%-9s %-6s %8u %10.4f %12.0f\n", name, direct ? "yes" : "no",
+              frames, hitRatio, numReads / seconds);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) budgetFrames = std::atoi(argv[2]);
+  if (argc > 3) numReads = std::atoi(argv[3]);
+
+  createFile();
+  std::printf("%u pages, budget %u frames (%u MiB), %u reads\n\n", numPages,
+              budgetFrames, budgetFrames * (unsigned)Page::SIZE >> 20,
+              numReads);
+  std::printf("%-9s %-6s %8s %10s %12s\n", "mode", "direct", "frames",
+              "hit ratio", "reads/s");
+  run("buffered", false, budgetFrames / 2);
+  run("direct", true, budgetFrames);
+
+  File::remove(kFilename);
+  return 0;
+}
@@ -0,0 +1,106 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Compares ways of scanning a whole file.
+//
+// Each scan walks the file and reads the first record of every page:
+//   read   - pages copied out with pread (File::readPage)
+//   copy   - pages copied out of the mapping (File::readPage, memory mapped)
+//   view   - pages viewed in place (FileIterator::view, memory mapped)
+//   chunk  - pages read ahead in 1 MiB chunks (SequentialFileIterator)
+// Every scan runs twice and the second (page cache warm) run is reported.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+#include "exceptions/file_not_found_exception.h"
+#include "file.h"
+#include "file_iterator.h"
+#include "page.h"
+#include "page_view.h"
+#include "sequential_file_iterator.h"
+
+using namespace badgerdb;
+
+namespace {
+
+const std::string kFilename = "mmap_scan_bench.db";
+
+PageId numPages = 32768;
+
+void createFile() {
+  try {
+    File::remove(kFilename);
+  } catch (const FileNotFoundException &e) {
+  }
+  File file = File::create(kFilename);
+  std::vector<Page> pages = file.allocatePages(numPages);
+  const std::string record(Page::DATA_SIZE / 2, 'x');
+  for (Page &page : pages) {
+    page.insertRecord(record);
+    file.writePage(page);
+  }
+  file.sync();
+}
+
+enum class Mode { READ, COPY, VIEW, CHUNK };
+
+double scan(File &file, const Mode mode, std::size_t &bytes) {
+  bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  if (mode == Mode::CHUNK) {
+    for (SequentialFileIterator iter(file); !iter.done(); ++iter) {
+      bytes += iter->getRecord({iter->page_number(), 1}).size();
+    }
+  } else {
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      if (mode == Mode::VIEW) {
+        const PageView page = iter.view();
+        bytes += page.getRecord({page.page_number(), 1}).size();
+      } else {
+        const Page page = *iter;
+        bytes += page.getRecord({page.page_number(), 1}).size();
+      }
+    }
+  }
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void run(const char *name, const Mode mode) {
+  File file = File::open(kFilename);
+  file.setMemoryMapped(mode == Mode::COPY || mode == Mode::VIEW);
+  file.advise(Advice::SEQUENTIAL);
+
+  std::size_t bytes;
+  scan(file, mode, bytes);
+  const double seconds = scan(file, mode, bytes);
+  std::printf("%-6s %10.3f %12.0f %10.1f\n", name, seconds,
+              numPages / seconds, numPages * (double)Page::SIZE / seconds / 1e6);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+
+  createFile();
+  std::printf("%u pages (%u MiB)\n\n", numPages,
+              static_cast<unsigned>(numPages * Page::SIZE >> 20));
+  std::printf("%-6s %10s %12s %10s\n", "mode", "seconds", "pages/s", "MB/s");
+  run("read", Mode::READ);
+  run("copy", Mode::COPY);
+  run("view", Mode::VIEW);
+  run("chunk", Mode::CHUNK);
+
+  File::remove(kFilename);
+  return 0;
+}
@@ -0,0 +1,92 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Compares ways of reading every record of pages held in memory, as a scan
+// through the buffer pool does once pages are pinned.
+//
+//   copy    - Page::getRecord, which copies each record into a string
+//   view    - Page::getRecordView, which points into the page
+//   iterate - PageIterator, which yields views
+//
+// Records are 60 bytes, too long for strings to hold without allocating.
+//
+// Usage: record_scan_bench [pages] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "page_iterator.h"
+
+using namespace badgerdb;
+
+namespace {
+
+int numPages = 1024;
+int numRounds = 20;
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+enum class Mode { COPY, VIEW, ITERATE };
+
+void run(const char *name, std::vector<Page> &pages,
+         const std::vector<std::vector<RecordId>> &rids, const Mode mode) {
+  std::size_t records = 0;
+  std::size_t bytes = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; ++round) {
+    for (std::size_t p = 0; p < pages.size(); ++p) {
+      if (mode == Mode::ITERATE) {
+        for (PageIterator iter = pages[p].begin(); iter != pages[p].end();
+             ++iter) {
+          bytes += (*iter).size();
+          records++;
+        }
+      } else {
+        for (const RecordId &rid : rids[p]) {
+          bytes += mode == Mode::COPY ? pages[p].getRecord(rid).size()
+                                      : pages[p].getRecordView(rid).size();
+          records++;
+        }
+      }
+    }
+  }
+  const double elapsed = seconds(start);
+  std::printf("%-8s %12.0f %10.1f   (%zu bytes)\n", name, records / elapsed,
+              elapsed * 1e9 / records, bytes);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) numRounds = std::atoi(argv[2]);
+
+  std::vector<Page> pages(numPages);
+  std::vector<std::vector<RecordId>> rids(numPages);
+  const std::string record(60, 'r');
+  for (int p = 0; p < numPages; ++p) {
+    while (pages[p].hasSpaceForRecord(record)) {
+      rids[p].push_back(pages[p].insertRecord(record));
+    }
+  }
+
+  std::printf("%d pages, %d rounds\n\n", numPages, numRounds);
+  std::printf("%-8s %12s %10s\n", "mode", "records/s", "ns/record");
+  run("copy", pages, rids, Mode::COPY);
+  run("view", pages, rids, Mode::VIEW);
+  run("iterate", pages, rids, Mode::ITERATE);
+  return 0;
+}
@@ -0,0 +1,100 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Measures slot bookkeeping on pages packed with small records, where a
+// page has hundreds of slots.
+//
+//   reuse   - delete a record near the end of the slot array and insert
+//             one, which takes the freed slot back
+//   iterate - PageIterator over pages where one slot in 64 is still used
+//
+// Records are 4 bytes.
+//
+// Usage: slot_bench [pages] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "page.h"
+#include "page_iterator.h"
+
+using namespace badgerdb;
+
+namespace {
+
+int numPages = 256;
+int numRounds = 200;
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void fill(std::vector<Page> &pages, std::vector<std::vector<RecordId>> &rids,
+          const std::string &record) {
+  for (std::size_t p = 0; p < pages.size(); ++p) {
+    while (pages[p].hasSpaceForRecord(record)) {
+      rids[p].push_back(pages[p].insertRecord(record));
+    }
+  }
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) numRounds = std::atoi(argv[2]);
+
+  const std::string record(4, 'r');
+  std::vector<Page> pages(numPages);
+  std::vector<std::vector<RecordId>> rids(numPages);
+  fill(pages, rids, record);
+
+  std::printf("%d pages of %zu slots, %d rounds\n\n", numPages,
+              rids[0].size(), numRounds);
+  std::printf("%-8s %12s\n", "mode", "ns/op");
+
+  std::size_t ops = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; ++round) {
+    for (std::size_t p = 0; p < pages.size(); ++p) {
+      const RecordId &rid = rids[p][rids[p].size() - 2];
+      pages[p].deleteRecord(rid);
+      pages[p].insertRecord(record);
+      ops++;
+    }
+  }
+  std::printf("%-8s %12.1f\n", "reuse", seconds(start) * 1e9 / ops);
+
+  for (std::size_t p = 0; p < pages.size(); ++p) {
+    for (std::size_t r = 0; r < rids[p].size(); ++r) {
+      if (r % 64 != 0 && r + 1 != rids[p].size()) {
+        pages[p].deleteRecord(rids[p][r]);
+      }
+    }
+  }
+  ops = 0;
+  std::size_t records = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; ++round) {
+    for (std::size_t p = 0; p < pages.size(); ++p) {
+      for (PageIterator iter = pages[p].begin(); iter != pages[p].end();
+           ++iter) {
+        records++;
+      }
+      ops++;
+    }
+  }
+  std::printf("%-8s %12.1f   (%zu records)\n", "iterate",
+              seconds(start) * 1e9 / ops, records);
+  return 0;
+}
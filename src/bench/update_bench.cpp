@@ -0,0 +1,97 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+// Measures Page::updateRecord on full pages, for records of a few sizes.
+//
+//   same   - replace a random record with one of the same length, as when
+//            a counter or status field changes
+//   shrink - replace a random record with one a byte shorter, then put
+//            the byte back
+//
+// Usage: update_bench [pages] [rounds]
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "page.h"
+
+using namespace badgerdb;
+
+namespace {
+
+int numPages = 256;
+int numRounds = 4;
+
+double seconds(const std::chrono::steady_clock::time_point start) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() -
+                                       start)
+      .count();
+}
+
+void run(const std::size_t record_bytes) {
+  std::mt19937 rng(1);
+  const std::string record(record_bytes, 'r');
+  const std::string changed(record_bytes, 'c');
+  const std::string shorter(record_bytes - 1, 's');
+  std::vector<Page> pages(numPages);
+  std::vector<std::vector<RecordId>> rids(numPages);
+  for (std::size_t p = 0; p < pages.size(); ++p) {
+    while (pages[p].hasSpaceForRecord(record)) {
+      rids[p].push_back(pages[p].insertRecord(record));
+    }
+  }
+
+  std::size_t ops = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; ++round) {
+    for (std::size_t p = 0; p < pages.size(); ++p) {
+      for (std::size_t k = 0; k < rids[p].size(); ++k) {
+        const RecordId &rid = rids[p][rng() % rids[p].size()];
+        pages[p].updateRecord(rid, round % 2 ? record : changed);
+        ops++;
+      }
+    }
+  }
+  const double same = seconds(start) * 1e9 / ops;
+
+  ops = 0;
+  start = std::chrono::steady_clock::now();
+  for (int round = 0; round < numRounds; ++round) {
+    for (std::size_t p = 0; p < pages.size(); ++p) {
+      for (std::size_t k = 0; k < rids[p].size(); ++k) {
+        const RecordId &rid = rids[p][rng() % rids[p].size()];
+        pages[p].updateRecord(rid, shorter);
+        pages[p].updateRecord(rid, record);
+        ops += 2;
+      }
+    }
+  }
+  const double shrink = seconds(start) * 1e9 / ops;
+
+  std::printf("%6zu %10zu %12.1f %12.1f\n", record_bytes, rids[0].size(),
+              same, shrink);
+}
+
+}  // namespace
+
+int main(int argc, char **argv) {
+  if (argc > 1) numPages = std::atoi(argv[1]);
+  if (argc > 2) numRounds = std::atoi(argv[2]);
+
+  std::printf("%d pages, %d rounds\n\n", numPages, numRounds);
+  std::printf("%6s %10s %12s %12s\n", "bytes", "records", "same ns",
+              "shrink ns");
+  run(8);
+  run(60);
+  run(500);
+  return 0;
+}
@@ -13,11 +13,18 @@
 
 #include "buffer.h"
 
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <fstream>
 #include <iostream>
 #include <memory>
+#include <tuple>
 
 #include "exceptions/bad_buffer_exception.h"
+#include "exceptions/badgerdb_exception.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/file_not_found_exception.h"
 #include "exceptions/hash_not_found_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
@@ -26,6 +33,62 @@ namespace badgerdb {
 
 constexpr int HASHTABLE_SZ(int bufs) { return ((int)(bufs * 1.2) & -2) + 1; }
 
+// Largest number of consecutive pages a warming thread reads at once (and
+// loads while holding the buffer manager's mutex).
+constexpr PageId WARM_BATCH_PAGES = 32;
+
+// Times a warming thread reads a batch again after pages were written back
+// meanwhile, before it gives up on the batch.
+constexpr int WARM_BATCH_RETRIES = 3;
+
+// Largest number of frames a ScanStrategy::RING scan recycles.  A scan never
+// takes more than an eighth of the pool for its ring.
+constexpr std::uint32_t SCAN_RING_FRAMES = 16;
+
+namespace {
+
+/**
+ * Holds the buffer manager's mutex for the duration of a foreground call.
+ * The call is announced before the mutex is requested so that warming
+ * threads stop taking it, and the last foreground call to finish wakes
+ * them again.
+ */
+class ForegroundLock {
+ public:
+  ForegroundLock(std::mutex& mutex, std::atomic<int>& waiters,
+                 std::condition_variable& idle)
+      : waiters_(waiters), idle_(idle), lock_(mutex, std::defer_lock) {
+    ++waiters_;
+    lock_.lock();
+  }
+
+  ~ForegroundLock() {
+    // Leave while still holding the mutex, so that a warming thread checking
+    // for waiters under it can't miss the wakeup.
+    const bool last = --waiters_ == 0;
+    lock_.unlock();
+    if (last) idle_.notify_all();
+  }
+
+ private:
+  std::atomic<int>& waiters_;
+  std::condition_variable& idle_;
+  std::unique_lock<std::mutex> lock_;
+};
+
+/**
+ * Free pages after the last used page of a file.  Shrinking drops them, so
+ * reclustering never needs to move a page into them.
+ */
+PageId trailingFreePages(const FileHeader& header) {
+  if (header.last_used_page == Page::INVALID_NUMBER) {
+    return header.num_free_pages;
+  }
+  return header.num_pages - 1 - header.last_used_page;
+}
+
+}  // namespace
+
 //----------------------------------------
 // Constructor of the class BufMgr
 //----------------------------------------
@@ -34,6 +97,10 @@ BufMgr::BufMgr(std::uint32_t bufs)
     : numBufs(bufs),
       hashTable(HASHTABLE_SZ(bufs)),
       bufDescTable(bufs),
+      accessClock(0),
+      foregroundWaiters(0),
+      stopWarm(false),
+      writeEpoch(0),
       bufPool(bufs) {
   for (FrameId i = 0; i < bufs; i++) {
     bufDescTable[i].frameNo = i;
@@ -43,6 +110,8 @@ BufMgr::BufMgr(std::uint32_t bufs)
   clockHand = bufs - 1;
 }
 
+BufMgr::~BufMgr() { stopWarming(); }
+
 
 void BufMgr::advanceClock() {
   // Advances clockHand by 1
@@ -76,14 +145,12 @@ void BufMgr::allocBuf(FrameId& frame) {
       if (bufDescTable[clockHand].pinCnt > 0) { 
         pinned_num++;
       }
-      // Flush before allocating frame if dirty and unpinned.
-      else if (bufDescTable[clockHand].dirty == true) {
-        flushFile(bufDescTable[clockHand].file);
-        frame = bufDescTable[clockHand].frameNo;
-        return;
-      }// Unpinned and unmodified frame can be allocated directly. 
-      else if (bufDescTable[clockHand].dirty == false) {
-        frame = bufDescTable[clockHand].frameNo;
+      // Unpinned frame can be allocated once its page is evicted. Only
+      // the victim page is written back (and not synced), so eviction does
+      // not pay for a whole-file flush.
+      else {
+        evictFrame(clockHand);
+        frame = clockHand;
         return;
       }
     }
@@ -91,13 +158,27 @@ void BufMgr::allocBuf(FrameId& frame) {
   throw BufferExceededException();
 }
 
+void BufMgr::evictFrame(FrameId frame) {
+  BufDesc& victim = bufDescTable[frame];
+  if (victim.dirty) {
+    victim.file.writePage(bufPool[frame]);
+    bufStats.diskwrites++;
+    writeEpoch++;
+  }
+  hashTable.remove(victim.file, victim.pageNo);
+  victim.clear();
+}
+
 void BufMgr::readPage(File& file, const PageId pageNo, Page*& page) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
   FrameId currentFrame = 0; 
+  bufStats.accesses++;
   try{
     hashTable.lookup(file, pageNo, currentFrame);
     // Case 2: Page is in buffer pool
     bufDescTable[currentFrame].refbit = true;
     bufDescTable[currentFrame].pinCnt += 1;
+    bufDescTable[currentFrame].lastAccess = ++accessClock;
 
     // Return pointer to frame containing page via page parameter. 
     page = &bufPool[currentFrame];
@@ -108,10 +189,12 @@ void BufMgr::readPage(File& file, const PageId pageNo, Page*& page) {
     allocBuf(currentFrame); 
     
     // read page from disk to buffer pool frame 
-    bufPool[currentFrame] = file.readPage(pageNo); 
+    file.readPage(pageNo, bufPool[currentFrame]);
+    bufStats.diskreads++;
 
     // Set pinCnt to 1
     bufDescTable[currentFrame].Set(file, bufPool[currentFrame].page_number());  
+    bufDescTable[currentFrame].lastAccess = ++accessClock;
 
     // Insert page into hashtable 
     hashTable.insert(file, bufPool[currentFrame].page_number(), currentFrame); 
@@ -121,7 +204,67 @@ void BufMgr::readPage(File& file, const PageId pageNo, Page*& page) {
   }
 } 
 
+void BufMgr::readPageForScan(File& file, const PageId pageNo, Page*& page,
+                             ScanRing* ring) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+  FrameId currentFrame = 0;
+  bufStats.accesses++;
+  try {
+    hashTable.lookup(file, pageNo, currentFrame);
+    // Resident pages are used in place, as in readPage().
+    bufDescTable[currentFrame].refbit = true;
+    bufDescTable[currentFrame].pinCnt += 1;
+    bufDescTable[currentFrame].lastAccess = ++accessClock;
+    page = &bufPool[currentFrame];
+    return;
+  } catch (const HashNotFoundException& e) {
+  }
+
+  if (ring == NULL) {
+    allocBuf(currentFrame);
+  } else {
+    const std::size_t ringFrames = std::max<std::uint32_t>(
+        1, std::min(SCAN_RING_FRAMES, numBufs / 8));
+    bool reused = false;
+    if (ring->frames.size() == ringFrames) {
+      // Recycle the oldest frame of the ring, unless someone else has since
+      // pinned or read its page, in which case it leaves the ring.
+      const FrameId oldest = ring->frames[ring->next];
+      BufDesc& desc = bufDescTable[oldest];
+      if (!desc.valid) {
+        currentFrame = oldest;
+        reused = true;
+      } else if (desc.pinCnt == 0 && !desc.refbit) {
+        evictFrame(oldest);
+        currentFrame = oldest;
+        reused = true;
+      }
+    }
+    if (!reused) {
+      allocBuf(currentFrame);
+    }
+    if (ring->frames.size() < ringFrames) {
+      ring->frames.push_back(currentFrame);
+    } else {
+      ring->frames[ring->next] = currentFrame;
+      ring->next = (ring->next + 1) % ringFrames;
+    }
+  }
+
+  file.readPage(pageNo, bufPool[currentFrame]);
+  bufStats.diskreads++;
+  bufDescTable[currentFrame].Set(file, pageNo);
+  bufDescTable[currentFrame].lastAccess = ++accessClock;
+  if (ring != NULL) {
+    // Let the clock take the scan's pages before anything else.
+    bufDescTable[currentFrame].refbit = false;
+  }
+  hashTable.insert(file, pageNo, currentFrame);
+  page = &bufPool[currentFrame];
+}
+
 void BufMgr::unPinPage(File& file, const PageId pageNo, const bool dirty) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
   FrameId currentFrame = 0; 
   try{
     // Check if page is in buffer pool
@@ -139,6 +282,7 @@ void BufMgr::unPinPage(File& file, const PageId pageNo, const bool dirty) {
 }
 
 void BufMgr::allocPage(File& file, PageId& pageNo, Page*& page) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
   FrameId currentFrame = 0; 
   try{
     hashTable.lookup(file, pageNo, currentFrame);
@@ -158,9 +302,12 @@ void BufMgr::allocPage(File& file, PageId& pageNo, Page*& page) {
   
   // Allocate an empty page in the specified file using file.allocatePage() 
   bufPool[currentFrame] = file.allocatePage();
+  bufStats.accesses++;
+  bufStats.diskreads++;
 
   // Set is invoked on the frame 
   bufDescTable[currentFrame].Set(file, bufPool[currentFrame].page_number());
+  bufDescTable[currentFrame].lastAccess = ++accessClock;
   
   // entry is inserted into hashTable 
   hashTable.insert(file, bufPool[currentFrame].page_number(), bufDescTable[currentFrame].frameNo);
@@ -171,8 +318,42 @@ void BufMgr::allocPage(File& file, PageId& pageNo, Page*& page) {
   pageNo = bufPool[currentFrame].page_number();
 }
 
+void BufMgr::allocPages(File& file, const PageId count,
+                        std::vector<PageId>& pageNos,
+                        std::vector<Page*>& pages) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+  pageNos.clear();
+  pages.clear();
+
+  // Make sure every page will get a frame before growing the file, since
+  // the allocation can't be undone.
+  std::uint32_t available = 0;
+  for (FrameId i = 0; i < numBufs; i++) {
+    if (!bufDescTable[i].valid || bufDescTable[i].pinCnt == 0) available++;
+  }
+  if (available < count) {
+    throw BufferExceededException();
+  }
+
+  std::vector<Page> newPages = file.allocatePages(count);
+  for (Page& newPage : newPages) {
+    FrameId currentFrame = 0;
+    allocBuf(currentFrame);
+    bufPool[currentFrame] = newPage;
+    bufStats.accesses++;
+    bufStats.diskreads++;
+    bufDescTable[currentFrame].Set(file, newPage.page_number());
+    bufDescTable[currentFrame].lastAccess = ++accessClock;
+    hashTable.insert(file, newPage.page_number(), currentFrame);
+
+    pageNos.push_back(newPage.page_number());
+    pages.push_back(&bufPool[currentFrame]);
+  }
+}
+
 void BufMgr::flushFile(File& file) {
-  
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+
   // Scan bufDecTable for all pages belonging to file.
   for(FrameId currentFrame = 0; currentFrame < numBufs; currentFrame++){
 
@@ -190,6 +371,8 @@ void BufMgr::flushFile(File& file) {
       // write dirty page and remove
       else if (bufDescTable[currentFrame].dirty){
         bufDescTable[currentFrame].file.writePage(bufPool[currentFrame]);
+        bufStats.diskwrites++;
+        writeEpoch++;
         bufDescTable[currentFrame].dirty = false;
         hashTable.remove(file, bufDescTable[currentFrame].pageNo);
         bufDescTable[currentFrame].clear();
@@ -201,9 +384,13 @@ void BufMgr::flushFile(File& file) {
       }
     }
   }
+
+  // Make the write-back durable with a single sync for the whole file.
+  file.sync();
 }
 
 void BufMgr::disposePage(File& file, const PageId PageNo) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
   FrameId currentFrame;
   try{
     // check if page exists in bufferpool
@@ -212,15 +399,259 @@ void BufMgr::disposePage(File& file, const PageId PageNo) {
     // remove page from hashTable, bufDescTable, and file
     hashTable.remove(file, PageNo);
     bufDescTable[currentFrame].clear();
+    writeEpoch++;
     file.deletePage(PageNo);
 
   } catch(const HashNotFoundException &e) {  
     // page is not in buffer pool so delete from file
+    writeEpoch++;
     file.deletePage(PageNo); 
   }  
 }
 
+PageId BufMgr::recluster(File& file, const ReclusterOptions& options) {
+  const auto start = std::chrono::steady_clock::now();
+  PageId moved = 0;
+  while (true) {
+    PageId from;
+    PageId to;
+    PageId remaining;
+    {
+      ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+      const FileHeader header = file.readHeader();
+      if (header.num_free_pages <= trailingFreePages(header)) break;
+
+      from = header.last_used_page;
+      FrameId frame;
+      try {
+        hashTable.lookup(file, from, frame);
+        if (bufDescTable[frame].pinCnt > 0) break;
+        // The move copies the page on disk, so bring that copy up to date.
+        evictFrame(frame);
+      } catch (const HashNotFoundException& e) {
+      }
+      to = file.movePage(from);
+      // Pages read by warming threads may now have the wrong number.
+      writeEpoch++;
+      if (to == from) break;
+
+      const FileHeader after = file.readHeader();
+      const PageId trailing = trailingFreePages(after);
+      remaining = after.num_free_pages > trailing
+                      ? after.num_free_pages - trailing
+                      : 0;
+    }
+    moved++;
+    if (options.onMove) options.onMove(from, to);
+    if (options.onProgress) options.onProgress(moved, remaining);
+    if (options.pagesPerSecond > 0) {
+      std::this_thread::sleep_until(
+          start + std::chrono::microseconds(
+                      std::uint64_t(moved) * 1000000 / options.pagesPerSecond));
+    }
+  }
+
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+  file.shrink();
+  return moved;
+}
+
+void BufMgr::dumpResidentSet(const std::string& path) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+  std::ofstream out(path, std::ofstream::out | std::ofstream::trunc);
+
+  for (FrameId i = 0; i < numBufs; i++) {
+    const BufDesc& desc = bufDescTable[i];
+    if (desc.valid) {
+      out << desc.lastAccess << " " << desc.pageNo << " "
+          << desc.file.filename() << "\n";
+    }
+  }
+}
+
+void BufMgr::warmFrom(const std::string& path, std::uint32_t numThreads) {
+  stopWarming();
+
+  std::ifstream in(path);
+  if (!in) {
+    throw FileNotFoundException(path);
+  }
+
+  // (recency, file name, page number) of every page in the dump
+  std::vector<std::tuple<std::uint64_t, std::string, PageId>> entries;
+  std::uint64_t recency;
+  PageId pageNo;
+  std::string filename;
+  while (in >> recency >> pageNo && std::getline(in >> std::ws, filename)) {
+    entries.emplace_back(recency, filename, pageNo);
+  }
+
+  // Order pages from least to most recently used, and keep only the most
+  // recently used ones if they would not all fit.
+  std::stable_sort(entries.begin(), entries.end(),
+                   [](const std::tuple<std::uint64_t, std::string, PageId>& a,
+                      const std::tuple<std::uint64_t, std::string, PageId>& b) {
+                     return std::get<0>(a) < std::get<0>(b);
+                   });
+  if (entries.size() > numBufs) {
+    entries.erase(entries.begin(), entries.end() - numBufs);
+  }
+  // Give the pages access times in the same order, after every access so
+  // far, so that a later dump keeps their recency.
+  std::uint64_t clock;
+  {
+    ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
+    clock = accessClock;
+    accessClock += entries.size();
+  }
+  for (auto& entry : entries) {
+    std::get<0>(entry) = ++clock;
+  }
+  std::sort(entries.begin(), entries.end(),
+            [](const std::tuple<std::uint64_t, std::string, PageId>& a,
+               const std::tuple<std::uint64_t, std::string, PageId>& b) {
+              return std::tie(std::get<1>(a), std::get<2>(a)) <
+                     std::tie(std::get<1>(b), std::get<2>(b));
+            });
+
+  // Group pages into runs of consecutive page numbers, and hand all the runs
+  // of a file to the same thread so that it reads the file front to back.
+  if (numThreads == 0) numThreads = 1;
+  std::vector<std::vector<WarmRun>> runsByThread(numThreads);
+  std::uint32_t worker = 0;
+  for (std::size_t i = 0; i < entries.size(); i++) {
+    const std::uint64_t lastAccess = std::get<0>(entries[i]);
+    const std::string& name = std::get<1>(entries[i]);
+    const PageId page = std::get<2>(entries[i]);
+    if (i > 0 && std::get<1>(entries[i - 1]) == name) {
+      WarmRun& last = runsByThread[worker].back();
+      if (last.firstPage + last.numPages == page) {
+        last.numPages++;
+        last.lastAccess.push_back(lastAccess);
+        continue;
+      }
+    } else if (i > 0) {
+      worker = (worker + 1) % numThreads;
+    }
+    runsByThread[worker].push_back({name, page, 1, {lastAccess}});
+  }
+
+  stopWarm = false;
+  for (std::vector<WarmRun>& runs : runsByThread) {
+    if (!runs.empty()) {
+      warmThreads.emplace_back(&BufMgr::warmWorker, this, std::move(runs));
+    }
+  }
+}
+
+void BufMgr::stopWarming() {
+  {
+    // Set under the mutex so that a thread about to wait can't miss it.
+    std::lock_guard<std::mutex> lock(mutex);
+    stopWarm = true;
+  }
+  foregroundIdle.notify_all();
+  for (std::thread& thread : warmThreads) {
+    thread.join();
+  }
+  warmThreads.clear();
+}
+
+void BufMgr::waitForWarming() {
+  for (std::thread& thread : warmThreads) {
+    thread.join();
+  }
+  warmThreads.clear();
+}
+
+FrameId BufMgr::findFreeFrame(FrameId start) {
+  for (FrameId i = start; i < numBufs; i++) {
+    if (!bufDescTable[i].valid) return i;
+  }
+  return numBufs;
+}
+
+void BufMgr::warmWorker(std::vector<WarmRun> runs) {
+  FrameId cursor = 0;  // frames before this one were in use when last seen
+
+  for (const WarmRun& run : runs) {
+    File file;
+    try {
+      file = File::open(run.filename);
+    } catch (const BadgerDbException& e) {
+      continue;  // file is gone
+    }
+
+    PageId next = run.firstPage;
+    const PageId end = run.firstPage + run.numPages;
+    int retries = 0;
+    while (next < end) {
+      {
+        // Let foreground calls go first.
+        std::unique_lock<std::mutex> lock(mutex);
+        foregroundIdle.wait(
+            lock, [this] { return foregroundWaiters == 0 || stopWarm; });
+        if (stopWarm) return;
+      }
+
+      // Read without holding the mutex so foreground calls are not held up
+      // by warming I/O.
+      const std::uint64_t epoch = writeEpoch;
+      const PageId count = std::min(WARM_BATCH_PAGES, end - next);
+      std::vector<Page> pages;
+      try {
+        pages = file.readPages(next, count);
+      } catch (const BadgerDbException& e) {
+        break;  // file is unreadable; skip the rest of this run
+      }
+      if (pages.empty()) break;  // rest of the run is past end of file
+
+      std::lock_guard<std::mutex> lock(mutex);
+      // A page may have been written back or disposed of while we were
+      // reading it; read the batch again, unless that keeps happening.
+      if (writeEpoch != epoch) {
+        if (++retries > WARM_BATCH_RETRIES) {
+          retries = 0;
+          next += count;
+        }
+        continue;
+      }
+      retries = 0;
+
+      for (PageId i = 0; i < pages.size(); i++) {
+        const PageId page = next + i;
+        if (pages[i].page_number() != page) continue;  // page is free
+
+        FrameId frame;
+        try {
+          hashTable.lookup(file, page, frame);
+          continue;  // already resident
+        } catch (const HashNotFoundException& e) {
+        }
+
+        cursor = findFreeFrame(cursor);
+        if (cursor == numBufs) {
+          // Pool is full; stop every warming thread.
+          stopWarm = true;
+          foregroundIdle.notify_all();
+          return;
+        }
+        bufPool[cursor] = std::move(pages[i]);
+        bufDescTable[cursor].Set(file, page);
+        bufDescTable[cursor].pinCnt = 0;
+        bufDescTable[cursor].refbit = false;
+        bufDescTable[cursor].lastAccess =
+            run.lastAccess[page - run.firstPage];
+        hashTable.insert(file, page, cursor);
+        bufStats.diskreads++;
+      }
+      next += count;
+    }
+  }
+}
+
 void BufMgr::printSelf(void) {
+  ForegroundLock lock(mutex, foregroundWaiters, foregroundIdle);
   int validFrames = 0;
 
   for (FrameId i = 0; i < numBufs; i++) {
@@ -8,7 +8,15 @@
 
 #pragma once
 
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
 #include <vector>
 
 #include "bufHashTbl.h"
@@ -21,6 +29,23 @@ namespace badgerdb {
  */
 class BufMgr;
 
+/**
+ * @brief How a scan through the buffer pool treats the pages it loads
+ */
+enum class ScanStrategy {
+  /**
+   * Pages are loaded like any other read and compete for frames as usual.
+   */
+  NORMAL,
+
+  /**
+   * Pages not already resident are loaded into a small ring of frames that
+   * the scan recycles, so a large scan does not push the rest of the pool
+   * out.
+   */
+  RING,
+};
+
 /**
  * @brief Class for maintaining information about buffer pool frames
  */
@@ -68,6 +93,12 @@ class BufDesc {
    */
   bool refbit;
 
+  /**
+   * Value of the buffer manager's access clock the last time this frame was
+   * read or allocated.  Larger values are more recent.
+   */
+  std::uint64_t lastAccess;
+
   /**
    * Initialize buffer frame for a new user
    */
@@ -78,6 +109,7 @@ class BufDesc {
     dirty = false;
     refbit = false;
     valid = false;
+    lastAccess = 0;
   }
 
   /**
@@ -141,12 +173,67 @@ struct BufStats {
   BufStats() { clear(); }
 };
 
+/**
+ * @brief Settings for BufMgr::recluster()
+ */
+struct ReclusterOptions {
+  /**
+   * Largest number of pages moved per second; 0 for no limit
+   */
+  std::uint32_t pagesPerSecond = 0;
+
+  /**
+   * Called after each move with the page's old and new numbers
+   */
+  std::function<void(PageId, PageId)> onMove;
+
+  /**
+   * Called after each move with the number of pages moved so far and the
+   * number of free pages still before the file's last used page, which
+   * reaches 0 once the file is fully reclustered
+   */
+  std::function<void(PageId, PageId)> onProgress;
+};
+
+/**
+ * @brief Allocator for buffer pool frames, aligned so that direct I/O moves
+ * pages straight between the disk and the frames
+ */
+template <typename T>
+struct FrameAllocator {
+  typedef T value_type;
+
+  FrameAllocator() = default;
+  template <typename U>
+  FrameAllocator(const FrameAllocator<U>&) {}
+
+  T* allocate(const std::size_t n) {
+    return static_cast<T*>(::operator new(
+        n * sizeof(T), std::align_val_t(StorageBackend::DIRECT_IO_ALIGNMENT)));
+  }
+  void deallocate(T* p, const std::size_t) {
+    ::operator delete(p,
+                      std::align_val_t(StorageBackend::DIRECT_IO_ALIGNMENT));
+  }
+
+  template <typename U>
+  bool operator==(const FrameAllocator<U>&) const {
+    return true;
+  }
+  template <typename U>
+  bool operator!=(const FrameAllocator<U>&) const {
+    return false;
+  }
+};
+
 /**
  * @brief The central class which manages the buffer pool including frame
  * allocation and deallocation to pages in the file
  */
 class BufMgr {
  private:
+  friend class BufferFileIterator;
+
   /**
    * Current position of clockhand in our buffer pool
    */
@@ -173,6 +260,76 @@ class BufMgr {
    */
   BufStats bufStats;
 
+  /**
+   * Logical clock stamped into BufDesc::lastAccess on every page access
+   */
+  std::uint64_t accessClock;
+
+  /**
+   * Serializes access to the buffer pool between the caller and the warming
+   * threads started by warmFrom()
+   */
+  std::mutex mutex;
+
+  /**
+   * Number of foreground calls waiting for or holding the mutex.  Warming
+   * threads back off while this is non-zero.
+   */
+  std::atomic<int> foregroundWaiters;
+
+  /**
+   * Notified when the last foreground call leaves, or warming is stopped.
+   * Warming threads wait on it with the mutex.
+   */
+  std::condition_variable foregroundIdle;
+
+  /**
+   * Set to ask warming threads to stop at their next batch
+   */
+  std::atomic<bool> stopWarm;
+
+  /**
+   * Incremented whenever the buffer manager writes back or deletes a page,
+   * so that warming threads can tell that a page they read without holding
+   * the mutex may be stale.
+   */
+  std::atomic<std::uint64_t> writeEpoch;
+
+  /**
+   * Threads started by warmFrom()
+   */
+  std::vector<std::thread> warmThreads;
+
+  /**
+   * Run of consecutive pages of one file to be loaded by a warming thread
+   */
+  struct WarmRun {
+    std::string filename;
+    PageId firstPage;
+    PageId numPages;
+    // Access time to give each page of the run, ordered like the dump
+    std::vector<std::uint64_t> lastAccess;
+  };
+
+  /**
+   * Body of a warming thread.  Reads the given runs in batches without
+   * holding the mutex, then installs each batch into free frames, until every
+   * run has been loaded, the pool has no free frames left, or stopWarming()
+   * is called.  A batch whose pages keep being written back while it is
+   * read is skipped.
+   *
+   * @param runs	Runs to load, sorted in file/page order
+   */
+  void warmWorker(std::vector<WarmRun> runs);
+
+  /**
+   * Returns the first frame at or after start that holds no valid page, or
+   * numBufs if there is none.  Never evicts anything.
+   *
+   * @param start	Frame to start searching from
+   */
+  FrameId findFreeFrame(FrameId start);
+
   /**
    * Advance clock to next frame in the buffer pool
    */
@@ -188,17 +345,54 @@ class BufMgr {
    */
   void allocBuf(FrameId& frame);
 
+  /**
+   * Writes back the page in an unpinned frame if it is dirty and removes it
+   * from the pool.
+   *
+   * @param frame	Frame to empty
+   */
+  void evictFrame(FrameId frame);
+
+  /**
+   * Frames recycled by a scan using ScanStrategy::RING
+   */
+  struct ScanRing {
+    std::vector<FrameId> frames;
+    std::size_t next = 0;
+  };
+
+  /**
+   * Like readPage(), but if the page is not resident and a ring is given,
+   * loads it into the next frame of the ring.  The ring's oldest frame is
+   * reused if the scan's page in it is unpinned and has not been read by
+   * anyone else since; otherwise a frame is allocated as usual and joins the
+   * ring.  Pages loaded into the ring start out not recently referenced.
+   *
+   * @param file   	File object
+   * @param pageNo  Page number in the file to be read
+   * @param page  	Reference to page pointer, set to the pinned frame
+   * @param ring	Ring of the scan, or NULL for ScanStrategy::NORMAL
+   */
+  void readPageForScan(File& file, const PageId pageNo, Page*& page,
+                       ScanRing* ring);
+
  public:
   /**
-   * Actual buffer pool from which frames are allocated
+   * Actual buffer pool from which frames are allocated.  Frames are aligned
+   * for direct I/O, and pages are read into them in place.
    */
-  std::vector<Page> bufPool;
+  std::vector<Page, FrameAllocator<Page>> bufPool;
 
   /**
    * Constructor of BufMgr class
    */
   BufMgr(std::uint32_t bufs);
 
+  /**
+   * Destructor of BufMgr class.  Stops any warming threads.
+   */
+  ~BufMgr();
+
   /**
    * Reads the given page from the file into a frame and returns the pointer to
    * page. If the requested page is already present in the buffer pool pointer
@@ -237,7 +431,23 @@ class BufMgr {
   void allocPage(File& file, PageId& pageNo, Page*& page);
 
   /**
-   * Writes out all dirty pages of the file to disk.
+   * Allocates a contiguous run of new, empty pages at the end of the file
+   * with a single File::allocatePages() call and assigns each a frame in the
+   * buffer pool.  The pages are returned pinned.
+   *
+   * @param file   	File object
+   * @param count   Number of pages to allocate.
+   * @param pageNos Numbers assigned to the new pages, in order.
+   * @param pages   Pointers to the frames holding the new pages, in order.
+   * @throws  BufferExceededException If fewer than count frames could be
+   * freed; no pages are allocated in that case.
+   */
+  void allocPages(File& file, const PageId count, std::vector<PageId>& pageNos,
+                  std::vector<Page*>& pages);
+
+  /**
+   * Writes out all dirty pages of the file to disk, then makes them durable
+   * with a single File::sync().
    * All the frames assigned to the file need to be unpinned from buffer pool
    * before this function can be successfully called. Otherwise Error returned.
    *
@@ -259,6 +469,62 @@ class BufMgr {
    */
   void disposePage(File& file, const PageId PageNo);
 
+  /**
+   * Reclusters a file while it stays in use: repeatedly moves the file's
+   * last used page into its lowest free page, until the used pages are
+   * contiguous at the front of the file, then shrinks the file.  A scan
+   * then reads one contiguous run instead of skipping over free pages.
+   *
+   * Pages are moved one at a time, each under the buffer manager's mutex,
+   * so other calls carry on in between.  A resident page is written back
+   * if dirty and dropped from the pool before it is moved.  Moved pages
+   * get new numbers, reported through options.onMove so that references
+   * to them can be updated.  If the page to be moved next is pinned,
+   * reclustering stops early and can be run again later.
+   *
+   * @param file   	File object
+   * @param options	Throttle and callbacks
+   * @return  Number of pages moved
+   */
+  PageId recluster(File& file,
+                   const ReclusterOptions& options = ReclusterOptions());
+
+  /**
+   * Writes the set of pages currently resident in the buffer pool to a file
+   * so that a later BufMgr can be warmed with warmFrom().  One line is
+   * written per valid frame: access recency, page number and file name.
+   *
+   * @param path		Name of the dump file to write
+   */
+  void dumpResidentSet(const std::string& path);
+
+  /**
+   * Starts reloading a resident set written by dumpResidentSet() in the
+   * background and returns immediately.  If the dump holds more pages than
+   * the pool has frames, the most recently accessed ones are kept.  Pages
+   * are loaded in file/page order, reading runs of consecutive pages with
+   * one large read each, into free frames only: warming never evicts a page
+   * and stops once the pool is full.  Warming threads give way to foreground
+   * calls whenever one is waiting.  Pages whose file is missing or that are
+   * no longer allocated are skipped.
+   *
+   * @param path		Name of the dump file to read
+   * @param numThreads	Number of warming threads; files are divided among
+   * them
+   */
+  void warmFrom(const std::string& path, std::uint32_t numThreads = 1);
+
+  /**
+   * Stops any warming started by warmFrom() and waits for its threads to
+   * exit.  Pages already loaded stay in the pool.
+   */
+  void stopWarming();
+
+  /**
+   * Waits for warming started by warmFrom() to finish on its own.
+   */
+  void waitForWarming();
+
   /**
    * Print member variable values.
    */
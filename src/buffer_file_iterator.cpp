@@ -0,0 +1,53 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "buffer_file_iterator.h"
+
+namespace badgerdb {
+
+BufferFileIterator::BufferFileIterator(BufMgr &bufMgr, File &file,
+                                       ScanStrategy strategy)
+    : buf_mgr_(&bufMgr),
+      file_(&file),
+      use_ring_(strategy == ScanStrategy::RING),
+      page_number_(Page::INVALID_NUMBER),
+      page_(NULL),
+      dirty_(false) {
+  pin(file_->readHeader().first_used_page);
+}
+
+BufferFileIterator::~BufferFileIterator() { unpin(); }
+
+BufferFileIterator &BufferFileIterator::operator++() {
+  // The used pages are tracked by the file, which the buffer manager keeps
+  // up to date as it allocates and disposes of pages.
+  const PageId next = file_->nextUsedPage(page_number_);
+  unpin();
+  pin(next);
+  return *this;
+}
+
+void BufferFileIterator::pin(const PageId page_number) {
+  if (page_number == Page::INVALID_NUMBER) {
+    return;
+  }
+  buf_mgr_->readPageForScan(*file_, page_number, page_,
+                            use_ring_ ? &ring_ : NULL);
+  page_number_ = page_number;
+}
+
+void BufferFileIterator::unpin() {
+  if (page_ == NULL) {
+    return;
+  }
+  page_ = NULL;
+  buf_mgr_->unPinPage(*file_, page_number_, dirty_);
+  dirty_ = false;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,144 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include "buffer.h"
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Iterator for scanning all used pages of a file through the buffer
+ *        pool.
+ *
+ * Unlike FileIterator, which always reads from the file, this iterator pins
+ * each page in the buffer manager and yields the frame holding it.  Resident
+ * pages are used as they are, including changes not yet written back, and
+ * pages that are not resident are read into the pool.  The current page is
+ * pinned until the iterator moves past it or is destroyed.
+ *
+ * With ScanStrategy::RING, pages the scan has to load go into a small set of
+ * frames that it recycles, so scanning a file larger than the pool does not
+ * evict the pool's working set.
+ *
+ * Usage:
+ * @code
+ *   for (badgerdb::BufferFileIterator iter(bufMgr, file); !iter.done();
+ *        ++iter) {
+ *     std::cout << "Read page: " << iter->page_number() << std::endl;
+ *   }
+ * @endcode
+ */
+class BufferFileIterator {
+ public:
+  /**
+   * Constructs an iterator at the first used page of the file, which is
+   * pinned.
+   *
+   * @param bufMgr    Buffer manager to read through.  Must outlive the
+   *                  iterator.
+   * @param file      File to iterate over.  Must outlive the iterator.
+   * @param strategy  How pages not already resident are loaded.
+   */
+  BufferFileIterator(BufMgr &bufMgr, File &file,
+                     ScanStrategy strategy = ScanStrategy::NORMAL);
+
+  /**
+   * Unpins the current page, if any.
+   */
+  ~BufferFileIterator();
+
+  BufferFileIterator(const BufferFileIterator &) = delete;
+  BufferFileIterator &operator=(const BufferFileIterator &) = delete;
+
+  /**
+   * Returns true once the iterator has moved past the last used page.
+   *
+   * @return  Whether the scan is finished.
+   */
+  bool done() const { return page_ == NULL; }
+
+  /**
+   * Unpins the current page and pins the next used page in the file.
+   */
+  BufferFileIterator &operator++();
+
+  /**
+   * Returns the frame holding the current page.  Must not be called once
+   * done() is true.  Call markDirty() after changing the page.
+   *
+   * @return  Current page.
+   */
+  Page &operator*() const { return *page_; }
+
+  /**
+   * Returns a pointer to the frame holding the current page.  Must not be
+   * called once done() is true.
+   *
+   * @return  Current page.
+   */
+  Page *operator->() const { return page_; }
+
+  /**
+   * Marks the current page dirty, so that it is unpinned as dirty.
+   */
+  void markDirty() { dirty_ = true; }
+
+ private:
+  /**
+   * Pins the given page, or ends the scan for Page::INVALID_NUMBER.
+   *
+   * @param page_number  Page to move to.
+   */
+  void pin(const PageId page_number);
+
+  /**
+   * Unpins the current page, if any.
+   */
+  void unpin();
+
+  /**
+   * Buffer manager holding the pages.
+   */
+  BufMgr *buf_mgr_;
+
+  /**
+   * File being scanned.
+   */
+  File *file_;
+
+  /**
+   * Frames recycled by the scan; unused with ScanStrategy::NORMAL.
+   */
+  BufMgr::ScanRing ring_;
+
+  /**
+   * Whether pages are loaded into ring_.
+   */
+  bool use_ring_;
+
+  /**
+   * Number of the current page.
+   */
+  PageId page_number_;
+
+  /**
+   * Frame holding the current page, or NULL once the scan is finished.
+   */
+  Page *page_;
+
+  /**
+   * Whether the current page has been marked dirty.
+   */
+  bool dirty_;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,117 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "checksum.h"
+
+#include <cstring>
+
+#if defined(__x86_64__)
+#include <nmmintrin.h>
+#endif
+
+namespace badgerdb {
+
+namespace {
+
+// Reversed Castagnoli polynomial.
+const std::uint32_t CRC32C_POLYNOMIAL = 0x82F63B78;
+
+/**
+ * Lookup tables for slicing-by-8: table[k][b] is the CRC of byte b followed
+ * by k zero bytes.
+ */
+struct Crc32cTables {
+  std::uint32_t table[8][256];
+
+  Crc32cTables() {
+    for (std::uint32_t b = 0; b < 256; ++b) {
+      std::uint32_t crc = b;
+      for (int bit = 0; bit < 8; ++bit) {
+        crc = (crc >> 1) ^ (crc & 1 ? CRC32C_POLYNOMIAL : 0);
+      }
+      table[0][b] = crc;
+    }
+    for (std::uint32_t b = 0; b < 256; ++b) {
+      for (int k = 1; k < 8; ++k) {
+        table[k][b] =
+            (table[k - 1][b] >> 8) ^ table[0][table[k - 1][b] & 0xff];
+      }
+    }
+  }
+};
+
+const Crc32cTables &tables() {
+  static const Crc32cTables instance;
+  return instance;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) std::uint32_t crc32cSse42(
+    std::uint32_t crc, const void *data, std::size_t length) {
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  std::uint64_t crc64 = ~crc;
+  while (length >= 8) {
+    std::uint64_t word;
+    std::memcpy(&word, bytes, sizeof(word));
+    crc64 = _mm_crc32_u64(crc64, word);
+    bytes += 8;
+    length -= 8;
+  }
+  std::uint32_t crc32 = static_cast<std::uint32_t>(crc64);
+  while (length > 0) {
+    crc32 = _mm_crc32_u8(crc32, *bytes++);
+    --length;
+  }
+  return ~crc32;
+}
+
+const bool kHaveSse42 = __builtin_cpu_supports("sse4.2");
+#else
+const bool kHaveSse42 = false;
+#endif
+
+}  // namespace
+
+std::uint32_t crc32cPortable(std::uint32_t crc, const void *data,
+                             std::size_t length) {
+  const std::uint32_t(&table)[8][256] = tables().table;
+  const unsigned char *bytes = static_cast<const unsigned char *>(data);
+  crc = ~crc;
+  while (length >= 8) {
+    // Little-endian: the first four bytes fold into the running CRC.
+    std::uint32_t low;
+    std::uint32_t high;
+    std::memcpy(&low, bytes, sizeof(low));
+    std::memcpy(&high, bytes + 4, sizeof(high));
+    low ^= crc;
+    crc = table[7][low & 0xff] ^ table[6][(low >> 8) & 0xff] ^
+          table[5][(low >> 16) & 0xff] ^ table[4][low >> 24] ^
+          table[3][high & 0xff] ^ table[2][(high >> 8) & 0xff] ^
+          table[1][(high >> 16) & 0xff] ^ table[0][high >> 24];
+    bytes += 8;
+    length -= 8;
+  }
+  while (length > 0) {
+    crc = (crc >> 8) ^ table[0][(crc ^ *bytes++) & 0xff];
+    --length;
+  }
+  return ~crc;
+}
+
+std::uint32_t crc32c(std::uint32_t crc, const void *data, std::size_t length) {
+#if defined(__x86_64__)
+  if (kHaveSse42) {
+    return crc32cSse42(crc, data, length);
+  }
+#endif
+  return crc32cPortable(crc, data, length);
+}
+
+bool crc32cHardware() { return kHaveSse42; }
+
+}  // namespace badgerdb
@@ -0,0 +1,39 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace badgerdb {
+
+/**
+ * Extends a CRC-32C (Castagnoli) checksum with more bytes.  Uses the SSE4.2
+ * crc32 instruction when the processor has it, and a table otherwise; both
+ * give the same result.
+ *
+ * @param crc     Checksum of the bytes so far; 0 to start.
+ * @param data    Bytes to add.
+ * @param length  Number of bytes to add.
+ * @return  Checksum including the new bytes.
+ */
+std::uint32_t crc32c(std::uint32_t crc, const void *data, std::size_t length);
+
+/**
+ * Same as crc32c(), always using the table.  For tests and benchmarks.
+ */
+std::uint32_t crc32cPortable(std::uint32_t crc, const void *data,
+                             std::size_t length);
+
+/**
+ * Returns whether crc32c() uses the crc32 instruction.
+ */
+bool crc32cHardware();
+
+}  // namespace badgerdb
@@ -0,0 +1,699 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "compressed_storage.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "compression.h"
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/file_io_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+// Identifies a compressed file ("BDBZ").
+const std::uint32_t COMPRESSED_MAGIC = 0x5A424442;
+
+const std::uint32_t COMPRESSED_VERSION = 1;
+
+// Size of a block, compressed on its own: File's page size, so that every
+// page is one block.
+const std::size_t BLOCK_BYTES = 8192;
+
+// Unit in which slots are handed out.
+const std::size_t UNIT_BYTES = 256;
+
+// Units before the first slot, holding the superblock.
+const std::uint32_t SUPERBLOCK_UNITS = 16;
+
+// How a block is stored in its slot.
+const std::uint16_t STORED_RAW = 0;
+const std::uint16_t STORED_LZ4 = 1;
+
+/**
+ * Superblock at offset 0 of a compressed file.
+ */
+struct Superblock {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t block_bytes;
+  // Run of units holding the page map.
+  std::uint32_t map_unit;
+  std::uint32_t map_units;
+  std::uint32_t num_blocks;
+  std::uint64_t size;
+};
+
+/**
+ * Start of every slot.  Naming the block lets reads check that the map led
+ * them to the right place.
+ */
+struct SlotHeader {
+  std::uint32_t block;
+  std::uint16_t length;
+  std::uint16_t method;
+};
+
+/**
+ * Page map entry: where a block's slot is.  Unit 0 means the block isn't
+ * stored and reads as zeros.
+ */
+struct MapEntry {
+  std::uint32_t unit;
+  std::uint32_t units;
+};
+
+std::uint32_t unitsFor(const std::size_t bytes) {
+  return (bytes + UNIT_BYTES - 1) / UNIT_BYTES;
+}
+
+off_t unitOffset(const std::uint32_t unit) {
+  return static_cast<off_t>(unit) * UNIT_BYTES;
+}
+
+// Returns whether a store starts with the superblock of a compressed file.
+bool isCompressedStore(StorageBackend &backend) {
+  std::uint32_t magic;
+  return backend.read(&magic, sizeof(magic), 0 /* offset */) ==
+             sizeof(magic) &&
+         magic == COMPRESSED_MAGIC;
+}
+
+/**
+ * Backend for a compressed file.
+ */
+class CompressedBackend : public StorageBackend {
+ public:
+  CompressedBackend(const std::string &name,
+                    std::unique_ptr<StorageBackend> inner,
+                    std::shared_ptr<CompressedStorage::Counters> counters)
+      : name_(name),
+        inner_(std::move(inner)),
+        counters_(counters),
+        size_(0),
+        map_unit_(0),
+        map_units_(0),
+        end_unit_(SUPERBLOCK_UNITS),
+        dirty_(false) {}
+
+  /**
+   * Publishes the page map if it has changed.
+   */
+  ~CompressedBackend() override {
+    try {
+      std::lock_guard<std::mutex> lock(mutex_);
+      syncLocked();
+    } catch (const BadgerDbException &e) {
+      // Destructors must not throw; changes since the last sync are lost.
+    }
+  }
+
+  /**
+   * Writes the superblock of a new, empty file.
+   */
+  void create() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    dirty_ = true;
+    syncLocked();
+  }
+
+  /**
+   * Reads the superblock and page map of an existing file.
+   */
+  void load();
+
+  std::size_t read(void *buffer, const std::size_t length,
+                   const off_t offset) override;
+
+  std::size_t readv(const struct iovec *vectors, const int count,
+                    const off_t offset) override {
+    std::size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+      total += vectors[i].iov_len;
+    }
+    std::vector<char> staging(total);
+    const std::size_t bytes_read = read(staging.data(), total, offset);
+    std::size_t copied = 0;
+    for (int i = 0; i < count && copied < bytes_read; ++i) {
+      const std::size_t length =
+          std::min(vectors[i].iov_len, bytes_read - copied);
+      std::memcpy(vectors[i].iov_base, staging.data() + copied, length);
+      copied += length;
+    }
+    return bytes_read;
+  }
+
+  void write(const void *buffer, const std::size_t length,
+             const off_t offset) override;
+
+  void writev(const struct iovec *vectors, const int count,
+              const off_t offset) override {
+    // A page arrives as its header and its data; join them so the block
+    // is compressed whole.
+    std::vector<char> staging;
+    for (int i = 0; i < count; ++i) {
+      const char *bytes = static_cast<const char *>(vectors[i].iov_base);
+      staging.insert(staging.end(), bytes, bytes + vectors[i].iov_len);
+    }
+    write(staging.data(), staging.size(), offset);
+  }
+
+  void sync() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    syncLocked();
+  }
+
+  off_t size() override {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return size_;
+  }
+
+  bool punchHole(const off_t offset, const off_t length) override;
+
+  bool truncate(const off_t length) override;
+
+ private:
+  /**
+   * Compresses a whole block and stores it, in its slot if it still fits
+   * and in a new one otherwise.
+   */
+  void storeBlock(const std::uint32_t block, const char *image);
+
+  /**
+   * Replaces part of a block, or zeros it if <bytes> is NULL.  Callers hold
+   * patch_mutex_.
+   */
+  void patchBlock(const std::uint32_t block, const std::size_t within,
+                  const char *bytes, const std::size_t length);
+
+  /**
+   * Decompresses the slot of a block into a block-sized image.
+   *
+   * @param available   Bytes of the slot that could be read.
+   * @throws  FileIOException  If the slot doesn't hold the block.
+   */
+  void decode(const std::uint32_t block, const char *slot,
+              const std::size_t available, char *image) const;
+
+  /**
+   * Returns the page map entry of a block.
+   */
+  MapEntry entryLocked(const std::uint32_t block) const {
+    return block < map_.size() ? map_[block] : MapEntry{0, 0};
+  }
+
+  /**
+   * Hands out a run of free units, the smallest that fits, extending the
+   * file if there is none.
+   */
+  std::uint32_t allocateLocked(const std::uint32_t units);
+
+  /**
+   * Returns units to the free runs, merging them with their neighbours.
+   */
+  void releaseLocked(std::uint32_t unit, std::uint32_t units);
+
+  /**
+   * Gives up the slot of a block.  Its units are released once a page map
+   * that no longer points to them has been published.
+   */
+  void retireLocked(MapEntry &entry) {
+    if (entry.unit != 0) {
+      retired_.push_back(entry);
+      entry = {0, 0};
+      dirty_ = true;
+    }
+  }
+
+  /**
+   * Writes the page map to new units and publishes it, if it has changed,
+   * then makes the file durable.
+   */
+  void syncLocked();
+
+  const std::string name_;
+  std::unique_ptr<StorageBackend> inner_;
+  std::shared_ptr<CompressedStorage::Counters> counters_;
+
+  /**
+   * Serializes writes of partial blocks, which read, change and store
+   * the block.
+   */
+  std::mutex patch_mutex_;
+
+  /**
+   * Guards everything below.
+   */
+  mutable std::mutex mutex_;
+
+  /**
+   * Size of the file, as seen by File.
+   */
+  std::uint64_t size_;
+
+  /**
+   * Where each block is stored.
+   */
+  std::vector<MapEntry> map_;
+
+  /**
+   * Units holding the page map last published.
+   */
+  std::uint32_t map_unit_;
+  std::uint32_t map_units_;
+
+  /**
+   * Unit past the last one handed out.
+   */
+  std::uint32_t end_unit_;
+
+  /**
+   * Free runs of units, by first unit and by length.
+   */
+  std::map<std::uint32_t, std::uint32_t> free_;
+  std::set<std::pair<std::uint32_t, std::uint32_t>> free_by_length_;
+
+  /**
+   * Slots given up since the page map was last published.
+   */
+  std::vector<MapEntry> retired_;
+
+  /**
+   * Set when the page map or size differ from those last published.
+   */
+  bool dirty_;
+};
+
+void CompressedBackend::load() {
+  Superblock superblock;
+  if (inner_->read(&superblock, sizeof(superblock), 0 /* offset */) !=
+          sizeof(superblock) ||
+      superblock.magic != COMPRESSED_MAGIC ||
+      superblock.version != COMPRESSED_VERSION ||
+      superblock.block_bytes != BLOCK_BYTES) {
+    throw FileIOException(name_, EINVAL);
+  }
+  size_ = superblock.size;
+  map_unit_ = superblock.map_unit;
+  map_units_ = superblock.map_units;
+  map_.resize(superblock.num_blocks);
+  const std::size_t map_bytes = map_.size() * sizeof(MapEntry);
+  if (map_bytes > 0 && inner_->read(map_.data(), map_bytes,
+                                    unitOffset(map_unit_)) != map_bytes) {
+    throw FileIOException(name_, EINVAL);
+  }
+
+  // Everything not in use is free.
+  std::vector<MapEntry> used = {{0, SUPERBLOCK_UNITS}};
+  if (map_units_ > 0) {
+    used.push_back({map_unit_, map_units_});
+  }
+  for (const MapEntry &entry : map_) {
+    if (entry.unit != 0) {
+      used.push_back(entry);
+    }
+  }
+  std::sort(used.begin(), used.end(),
+            [](const MapEntry &a, const MapEntry &b) { return a.unit < b.unit; });
+  end_unit_ = 0;
+  for (const MapEntry &run : used) {
+    if (run.unit > end_unit_) {
+      releaseLocked(end_unit_, run.unit - end_unit_);
+    }
+    end_unit_ = std::max(end_unit_, run.unit + run.units);
+  }
+}
+
+std::size_t CompressedBackend::read(void *buffer, const std::size_t length,
+                                    const off_t offset) {
+  std::vector<MapEntry> entries;
+  std::size_t available;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (static_cast<std::uint64_t>(offset) >= size_ || length == 0) {
+      return 0;
+    }
+    available = std::min<std::uint64_t>(length, size_ - offset);
+    const std::uint32_t first_block = offset / BLOCK_BYTES;
+    const std::uint32_t last_block = (offset + available - 1) / BLOCK_BYTES;
+    for (std::uint32_t block = first_block; block <= last_block; ++block) {
+      entries.push_back(entryLocked(block));
+    }
+  }
+
+  char *out = static_cast<char *>(buffer);
+  std::uint64_t position = offset;
+  const std::uint64_t end = offset + available;
+  std::vector<char> staging;
+  std::vector<char> image(BLOCK_BYTES);
+  std::uint64_t blocks_read = 0;
+  for (std::size_t i = 0; i < entries.size();) {
+    // Blocks written in order usually sit in neighbouring slots; read each
+    // such run with one request.
+    std::size_t run_end = i + 1;
+    std::size_t bytes_read = 0;
+    if (entries[i].unit != 0) {
+      while (run_end < entries.size() &&
+             entries[run_end].unit ==
+                 entries[run_end - 1].unit + entries[run_end - 1].units) {
+        ++run_end;
+      }
+      const MapEntry &last = entries[run_end - 1];
+      staging.resize(unitOffset(last.unit + last.units - entries[i].unit));
+      bytes_read = inner_->read(staging.data(), staging.size(),
+                                unitOffset(entries[i].unit));
+    }
+    for (std::size_t k = i; k < run_end; ++k) {
+      const std::uint64_t block_start = position - position % BLOCK_BYTES;
+      const std::size_t within = position - block_start;
+      const std::size_t piece =
+          std::min<std::uint64_t>(end - position, BLOCK_BYTES - within);
+      if (entries[k].unit == 0) {
+        std::memset(out, 0, piece);
+      } else {
+        const bool whole = piece == BLOCK_BYTES;
+        const std::size_t slot_offset =
+            unitOffset(entries[k].unit - entries[i].unit);
+        decode(block_start / BLOCK_BYTES, staging.data() + slot_offset,
+               bytes_read > slot_offset ? bytes_read - slot_offset : 0,
+               whole ? out : image.data());
+        if (!whole) {
+          std::memcpy(out, image.data() + within, piece);
+        }
+        blocks_read++;
+      }
+      out += piece;
+      position += piece;
+    }
+    i = run_end;
+  }
+  counters_->pages_read += blocks_read;
+  return available;
+}
+
+void CompressedBackend::write(const void *buffer, const std::size_t length,
+                              const off_t offset) {
+  const char *in = static_cast<const char *>(buffer);
+  std::uint64_t position = offset;
+  const std::uint64_t end = offset + length;
+  while (position < end) {
+    const std::uint32_t block = position / BLOCK_BYTES;
+    const std::size_t within = position % BLOCK_BYTES;
+    const std::size_t piece =
+        std::min<std::uint64_t>(end - position, BLOCK_BYTES - within);
+    if (piece == BLOCK_BYTES) {
+      storeBlock(block, in);
+    } else {
+      std::lock_guard<std::mutex> patch_lock(patch_mutex_);
+      patchBlock(block, within, in, piece);
+    }
+    in += piece;
+    position += piece;
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (end > size_) {
+    size_ = end;
+    dirty_ = true;
+  }
+}
+
+bool CompressedBackend::punchHole(const off_t offset, const off_t length) {
+  std::uint64_t position = offset;
+  const std::uint64_t end = offset + length;
+  while (position < end) {
+    const std::uint32_t block = position / BLOCK_BYTES;
+    const std::size_t within = position % BLOCK_BYTES;
+    const std::size_t piece =
+        std::min<std::uint64_t>(end - position, BLOCK_BYTES - within);
+    if (piece == BLOCK_BYTES) {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (block < map_.size()) {
+        retireLocked(map_[block]);
+      }
+    } else {
+      std::lock_guard<std::mutex> patch_lock(patch_mutex_);
+      patchBlock(block, within, NULL, piece);
+    }
+    position += piece;
+  }
+  return true;
+}
+
+bool CompressedBackend::truncate(const off_t length) {
+  std::lock_guard<std::mutex> patch_lock(patch_mutex_);
+  if (length >= size()) {
+    return true;
+  }
+  // Bytes past the end must read back as zeros if the file grows again.
+  const std::size_t within = length % BLOCK_BYTES;
+  if (within != 0) {
+    patchBlock(length / BLOCK_BYTES, within, NULL, BLOCK_BYTES - within);
+  }
+  std::lock_guard<std::mutex> lock(mutex_);
+  const std::size_t keep = (length + BLOCK_BYTES - 1) / BLOCK_BYTES;
+  for (std::size_t block = keep; block < map_.size(); ++block) {
+    retireLocked(map_[block]);
+  }
+  map_.resize(std::min(map_.size(), keep));
+  size_ = length;
+  dirty_ = true;
+  return true;
+}
+
+void CompressedBackend::storeBlock(const std::uint32_t block,
+                                   const char *image) {
+  char slot[sizeof(SlotHeader) + BLOCK_BYTES];
+  SlotHeader header = {block, 0, STORED_LZ4};
+  // Blocks that wouldn't save a unit are stored as they are, so reading
+  // them costs no decompression.
+  std::size_t length = lz4Compress(image, BLOCK_BYTES, slot + sizeof(header),
+                                   BLOCK_BYTES - UNIT_BYTES);
+  if (length == 0) {
+    header.method = STORED_RAW;
+    length = BLOCK_BYTES;
+    std::memcpy(slot + sizeof(header), image, BLOCK_BYTES);
+  }
+  header.length = length;
+  std::memcpy(slot, &header, sizeof(header));
+  const std::size_t stored = sizeof(header) + length;
+  const std::uint32_t units = unitsFor(stored);
+
+  std::uint32_t unit;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (block >= map_.size()) {
+      map_.resize(block + 1, MapEntry{0, 0});
+    }
+    MapEntry &entry = map_[block];
+    if (entry.unit == 0 || units > entry.units) {
+      // The published map still points to the old slot, so it is kept
+      // until the new map is published.
+      retireLocked(entry);
+      entry = {allocateLocked(units), units};
+      dirty_ = true;
+    }
+    unit = entry.unit;
+  }
+  inner_->write(slot, stored, unitOffset(unit));
+
+  counters_->pages_written++;
+  counters_->bytes_written += BLOCK_BYTES;
+  counters_->bytes_stored += stored;
+}
+
+void CompressedBackend::patchBlock(const std::uint32_t block,
+                                   const std::size_t within, const char *bytes,
+                                   const std::size_t length) {
+  MapEntry entry;
+  {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entry = entryLocked(block);
+  }
+  std::vector<char> image(BLOCK_BYTES, 0);
+  if (entry.unit != 0) {
+    std::vector<char> slot(unitOffset(entry.units));
+    const std::size_t bytes_read =
+        inner_->read(slot.data(), slot.size(), unitOffset(entry.unit));
+    decode(block, slot.data(), bytes_read, image.data());
+  } else if (bytes == NULL) {
+    return;  // zeros already
+  }
+  if (bytes != NULL) {
+    std::memcpy(image.data() + within, bytes, length);
+  } else {
+    std::memset(image.data() + within, 0, length);
+  }
+  storeBlock(block, image.data());
+}
+
+void CompressedBackend::decode(const std::uint32_t block, const char *slot,
+                               const std::size_t available,
+                               char *image) const {
+  SlotHeader header;
+  if (available < sizeof(header)) {
+    throw FileIOException(name_, EIO);
+  }
+  std::memcpy(&header, slot, sizeof(header));
+  const char *data = slot + sizeof(header);
+  if (header.block != block || header.length > available - sizeof(header)) {
+    throw FileIOException(name_, EIO);
+  }
+  if (header.method == STORED_RAW && header.length == BLOCK_BYTES) {
+    std::memcpy(image, data, BLOCK_BYTES);
+  } else if (header.method != STORED_LZ4 ||
+             !lz4Decompress(data, header.length, image, BLOCK_BYTES)) {
+    throw FileIOException(name_, EIO);
+  }
+}
+
+std::uint32_t CompressedBackend::allocateLocked(const std::uint32_t units) {
+  const auto fit = free_by_length_.lower_bound({units, 0});
+  if (fit == free_by_length_.end()) {
+    const std::uint32_t unit = end_unit_;
+    end_unit_ += units;
+    return unit;
+  }
+  const std::uint32_t run_units = fit->first;
+  const std::uint32_t unit = fit->second;
+  free_by_length_.erase(fit);
+  free_.erase(unit);
+  if (run_units > units) {
+    free_[unit + units] = run_units - units;
+    free_by_length_.insert({run_units - units, unit + units});
+  }
+  return unit;
+}
+
+void CompressedBackend::releaseLocked(std::uint32_t unit,
+                                      std::uint32_t units) {
+  auto next = free_.lower_bound(unit);
+  if (next != free_.end() && unit + units == next->first) {
+    units += next->second;
+    free_by_length_.erase({next->second, next->first});
+    next = free_.erase(next);
+  }
+  if (next != free_.begin()) {
+    const auto previous = std::prev(next);
+    if (previous->first + previous->second == unit) {
+      unit = previous->first;
+      units += previous->second;
+      free_by_length_.erase({previous->second, previous->first});
+      free_.erase(previous);
+    }
+  }
+  free_[unit] = units;
+  free_by_length_.insert({units, unit});
+}
+
+void CompressedBackend::syncLocked() {
+  if (!dirty_) {
+    inner_->sync();
+    return;
+  }
+
+  // Write the new map beside the old one, and only switch the superblock
+  // over once it is durable.
+  const std::size_t map_bytes = map_.size() * sizeof(MapEntry);
+  const std::uint32_t new_units = unitsFor(map_bytes);
+  const std::uint32_t new_unit = new_units == 0 ? 0 : allocateLocked(new_units);
+  if (new_units > 0) {
+    inner_->write(map_.data(), map_bytes, unitOffset(new_unit));
+  }
+  inner_->sync();
+
+  const Superblock superblock = {
+      COMPRESSED_MAGIC,
+      COMPRESSED_VERSION,
+      static_cast<std::uint32_t>(BLOCK_BYTES),
+      new_unit,
+      new_units,
+      static_cast<std::uint32_t>(map_.size()),
+      size_};
+  inner_->write(&superblock, sizeof(superblock), 0 /* offset */);
+  inner_->sync();
+
+  // Nothing published points to the old map or the retired slots now.
+  if (map_units_ > 0) {
+    releaseLocked(map_unit_, map_units_);
+  }
+  for (const MapEntry &slot : retired_) {
+    releaseLocked(slot.unit, slot.units);
+  }
+  retired_.clear();
+  map_unit_ = new_unit;
+  map_units_ = new_units;
+  dirty_ = false;
+
+  // Give free space at the end back to the inner store.
+  if (!free_.empty()) {
+    const auto last = std::prev(free_.end());
+    if (last->first + last->second == end_unit_) {
+      end_unit_ = last->first;
+      free_by_length_.erase({last->second, last->first});
+      free_.erase(last);
+      inner_->truncate(unitOffset(end_unit_));
+    }
+  }
+}
+
+}  // namespace
+
+CompressedStorage::CompressedStorage(std::shared_ptr<StorageProvider> inner,
+                                     Policy compress)
+    : inner_(inner),
+      compress_(std::move(compress)),
+      counters_(std::make_shared<Counters>()) {}
+
+bool CompressedStorage::exists(const std::string &name) {
+  return inner_->exists(name);
+}
+
+std::unique_ptr<StorageBackend> CompressedStorage::open(
+    const std::string &name, const bool create_new) {
+  std::unique_ptr<StorageBackend> backend = inner_->open(name, create_new);
+  if (create_new ? compress_ && !compress_(name)
+                 : !isCompressedStore(*backend)) {
+    return backend;
+  }
+  std::unique_ptr<CompressedBackend> compressed(
+      new CompressedBackend(name, std::move(backend), counters_));
+  if (create_new) {
+    compressed->create();
+  } else {
+    compressed->load();
+  }
+  return std::move(compressed);
+}
+
+void CompressedStorage::remove(const std::string &name) {
+  inner_->remove(name);
+}
+
+void CompressedStorage::rename(const std::string &from, const std::string &to) {
+  inner_->rename(from, to);
+}
+
+CompressionStats CompressedStorage::stats() const {
+  return {counters_->pages_written, counters_->bytes_written,
+          counters_->bytes_stored, counters_->pages_read};
+}
+
+bool CompressedStorage::isCompressed(const std::string &name) {
+  return isCompressedStore(*inner_->open(name, false /* create_new */));
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,138 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "storage.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Counts of the work done by a CompressedStorage.
+ */
+struct CompressionStats {
+  /**
+   * Pages compressed and written.
+   */
+  std::uint64_t pages_written;
+
+  /**
+   * Bytes of those pages before compression.
+   */
+  std::uint64_t bytes_written;
+
+  /**
+   * Bytes stored for them after compression, including per-page overhead.
+   */
+  std::uint64_t bytes_stored;
+
+  /**
+   * Pages read and decompressed.
+   */
+  std::uint64_t pages_read;
+
+  /**
+   * Returns how many times smaller the pages written were once stored.
+   */
+  double ratio() const {
+    return bytes_stored == 0 ? 1.0
+                             : static_cast<double>(bytes_written) / bytes_stored;
+  }
+};
+
+/**
+ * @brief Wraps another provider, compressing the files it creates.
+ *
+ * A compressed file is kept as a series of 8 KiB blocks, one per page of
+ * the File stored in it.  Each block is compressed on its own with
+ * lz4Compress() when written and stored in a slot of just enough 256-byte
+ * units, found through a page map.  Reads decompress whole blocks.  A block
+ * that grows past its slot moves to a new one; the map is written to fresh
+ * units and published through a superblock when the file is synced or
+ * closed, and slots given up are only reused after that, so a crash leaves
+ * the previous map and the slots it points to in place.  Blocks never
+ * written, and ranges whose holes are punched, take no space.
+ *
+ * Compression is chosen per file when it is created.  Existing files that
+ * are not compressed are opened as they are, so a database can move to
+ * compression file by file:
+ *
+ * @code
+ *   File::setStorage(std::make_shared<CompressedStorage>(
+ *       std::make_shared<PosixStorage>()));
+ *   File file = File::create("orders");  // compressed
+ * @endcode
+ *
+ * Compression trades CPU time for I/O: it pays on files that are bound by
+ * their device and whose pages are partly empty or repetitive.  Memory
+ * mapping, direct I/O and reserving space are not offered for compressed
+ * files.
+ */
+class CompressedStorage : public StorageProvider {
+ public:
+  /**
+   * Decides whether a file about to be created is compressed.
+   */
+  using Policy = std::function<bool(const std::string &name)>;
+
+  /**
+   * Constructs a compressing view of another provider.
+   *
+   * @param inner     Provider that holds the data.
+   * @param compress  Which new files to compress; all of them if empty.
+   */
+  explicit CompressedStorage(std::shared_ptr<StorageProvider> inner,
+                             Policy compress = Policy());
+
+  bool exists(const std::string &name) override;
+  std::unique_ptr<StorageBackend> open(const std::string &name,
+                                       const bool create_new) override;
+  void remove(const std::string &name) override;
+  void rename(const std::string &from, const std::string &to) override;
+
+  /**
+   * Returns the work done so far by files opened through this provider.
+   */
+  CompressionStats stats() const;
+
+  /**
+   * Returns whether the store with the given name is compressed.
+   */
+  bool isCompressed(const std::string &name);
+
+  /**
+   * Counters behind stats(), shared with the backends.
+   */
+  struct Counters {
+    std::atomic<std::uint64_t> pages_written{0};
+    std::atomic<std::uint64_t> bytes_written{0};
+    std::atomic<std::uint64_t> bytes_stored{0};
+    std::atomic<std::uint64_t> pages_read{0};
+  };
+
+ private:
+  /**
+   * Provider that holds the data.
+   */
+  std::shared_ptr<StorageProvider> inner_;
+
+  /**
+   * Which new files to compress.
+   */
+  Policy compress_;
+
+  std::shared_ptr<Counters> counters_;
+};
+
+}  // namespace badgerdb
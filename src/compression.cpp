@@ -0,0 +1,232 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "compression.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace badgerdb {
+
+namespace {
+
+// Shortest repeat worth a back reference.
+const std::size_t MIN_MATCH = 4;
+
+// The format ends every block with at least this many literals...
+const std::size_t LAST_LITERALS = 5;
+
+// ...and starts no match closer than this to the end.
+const std::size_t MATCH_FIND_LIMIT = 12;
+
+// Farthest back a reference can point.
+const std::size_t MAX_DISTANCE = 65535;
+
+// Bits of the hash of four bytes used to find earlier occurrences.
+const int HASH_BITS = 12;
+
+// Failed searches after which the search starts skipping ahead faster, so
+// that incompressible input passes through quickly.
+const int SKIP_TRIGGER = 6;
+
+std::uint32_t read32(const unsigned char *position) {
+  std::uint32_t value;
+  std::memcpy(&value, position, sizeof(value));
+  return value;
+}
+
+std::uint32_t hash(const std::uint32_t sequence) {
+  return (sequence * 2654435761U) >> (32 - HASH_BITS);
+}
+
+// Writes the extra bytes of a length that doesn't fit in its four token
+// bits.
+unsigned char *writeLength(unsigned char *out, std::size_t length) {
+  while (length >= 255) {
+    *out++ = 255;
+    length -= 255;
+  }
+  *out++ = static_cast<unsigned char>(length);
+  return out;
+}
+
+// Writes a sequence of literals followed by an optional match.  Returns
+// NULL if it doesn't fit before <out_end>.
+unsigned char *writeSequence(unsigned char *out, unsigned char *out_end,
+                             const unsigned char *literals,
+                             const std::size_t literal_length,
+                             const std::size_t distance,
+                             const std::size_t match_length) {
+  // Token, lengths, literals and offset, at worst.
+  std::size_t needed = 1 + literal_length / 255 + 1 + literal_length;
+  if (match_length != 0) {
+    needed += 2 + match_length / 255 + 1;
+  }
+  if (static_cast<std::size_t>(out_end - out) < needed) {
+    return NULL;
+  }
+  unsigned char *token = out++;
+  *token = static_cast<unsigned char>(
+      (literal_length < 15 ? literal_length : 15) << 4);
+  if (literal_length >= 15) {
+    out = writeLength(out, literal_length - 15);
+  }
+  std::memcpy(out, literals, literal_length);
+  out += literal_length;
+  if (match_length == 0) {
+    return out;  // last literals
+  }
+  *out++ = static_cast<unsigned char>(distance);
+  *out++ = static_cast<unsigned char>(distance >> 8);
+  const std::size_t extra = match_length - MIN_MATCH;
+  *token |= static_cast<unsigned char>(extra < 15 ? extra : 15);
+  if (extra >= 15) {
+    out = writeLength(out, extra - 15);
+  }
+  return out;
+}
+
+}  // namespace
+
+std::size_t lz4Compress(const void *source, const std::size_t length,
+                        void *destination, const std::size_t capacity) {
+  const unsigned char *const start = static_cast<const unsigned char *>(source);
+  const unsigned char *const end = start + length;
+  unsigned char *const out_start = static_cast<unsigned char *>(destination);
+  unsigned char *const out_end = out_start + capacity;
+  unsigned char *out = out_start;
+  const unsigned char *anchor = start;
+
+  if (length > MATCH_FIND_LIMIT) {
+    // Positions of earlier four-byte sequences, by hash.  Unset entries
+    // point at the start, which fails the checks below when stale.
+    std::uint32_t table[1 << HASH_BITS] = {0};
+    const unsigned char *const match_limit = end - LAST_LITERALS;
+    const unsigned char *const find_limit = end - MATCH_FIND_LIMIT;
+    const unsigned char *position = start;
+    int misses = 0;
+    while (position <= find_limit) {
+      const std::uint32_t sequence = read32(position);
+      const std::uint32_t slot = hash(sequence);
+      const unsigned char *candidate = start + table[slot];
+      table[slot] = static_cast<std::uint32_t>(position - start);
+      if (candidate >= position ||
+          static_cast<std::size_t>(position - candidate) > MAX_DISTANCE ||
+          read32(candidate) != sequence) {
+        position += 1 + (misses++ >> SKIP_TRIGGER);
+        continue;
+      }
+      misses = 0;
+
+      // Extend the match backwards over literals, then forwards.
+      while (position > anchor && candidate > start &&
+             position[-1] == candidate[-1]) {
+        --position;
+        --candidate;
+      }
+      const unsigned char *match_end = position + MIN_MATCH;
+      const unsigned char *candidate_end = candidate + MIN_MATCH;
+      while (match_end < match_limit && *match_end == *candidate_end) {
+        ++match_end;
+        ++candidate_end;
+      }
+
+      out = writeSequence(out, out_end, anchor, position - anchor,
+                          position - candidate, match_end - position);
+      if (out == NULL) {
+        return 0;
+      }
+      // Index a position inside the match, which helps runs that repeat
+      // with a short period.
+      if (match_end - 2 > start) {
+        table[hash(read32(match_end - 2))] =
+            static_cast<std::uint32_t>(match_end - 2 - start);
+      }
+      position = match_end;
+      anchor = position;
+    }
+  }
+
+  out = writeSequence(out, out_end, anchor, end - anchor, 0, 0);
+  return out == NULL ? 0 : out - out_start;
+}
+
+bool lz4Decompress(const void *source, const std::size_t length,
+                   void *destination, const std::size_t expected_length) {
+  const unsigned char *in = static_cast<const unsigned char *>(source);
+  const unsigned char *const in_end = in + length;
+  unsigned char *const out_start = static_cast<unsigned char *>(destination);
+  unsigned char *out = out_start;
+  unsigned char *const out_end = out_start + expected_length;
+
+  // Reads the extra bytes of a length; false if the input runs out.
+  const auto readLength = [&in, in_end](std::size_t &value) {
+    unsigned char byte;
+    do {
+      if (in == in_end) {
+        return false;
+      }
+      byte = *in++;
+      value += byte;
+    } while (byte == 255);
+    return true;
+  };
+
+  while (in < in_end) {
+    const unsigned char token = *in++;
+    std::size_t literal_length = token >> 4;
+    if (literal_length == 15 && !readLength(literal_length)) {
+      return false;
+    }
+    if (literal_length > static_cast<std::size_t>(in_end - in) ||
+        literal_length > static_cast<std::size_t>(out_end - out)) {
+      return false;
+    }
+    std::memcpy(out, in, literal_length);
+    in += literal_length;
+    out += literal_length;
+    if (in == in_end) {
+      break;  // last literals
+    }
+
+    if (in_end - in < 2) {
+      return false;
+    }
+    const std::size_t distance = in[0] | (in[1] << 8);
+    in += 2;
+    std::size_t match_length = token & 15;
+    if (match_length == 15 && !readLength(match_length)) {
+      return false;
+    }
+    match_length += MIN_MATCH;
+    if (distance == 0 ||
+        distance > static_cast<std::size_t>(out - out_start) ||
+        match_length > static_cast<std::size_t>(out_end - out)) {
+      return false;
+    }
+    const unsigned char *from = out - distance;
+    if (distance >= match_length) {
+      std::memcpy(out, from, match_length);
+      out += match_length;
+    } else {
+      // The match overlaps the bytes it produces, repeating its first
+      // <distance> bytes; copy what is already there, doubling each time.
+      while (match_length > 0) {
+        const std::size_t piece =
+            std::min<std::size_t>(match_length, out - from);
+        std::memcpy(out, from, piece);
+        out += piece;
+        match_length -= piece;
+      }
+    }
+  }
+  return out == out_end;
+}
+
+}  // namespace badgerdb
@@ -0,0 +1,45 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstddef>
+
+namespace badgerdb {
+
+/**
+ * Compresses bytes into the LZ4 block format: a greedy, hash-based search
+ * for repeats of four bytes or more within the last 64 KiB, encoded as runs
+ * of literals and back references.  Fast enough to run on every page
+ * written, and good at the zeros and repeated text of half-empty pages.
+ *
+ * @param source            Bytes to compress.
+ * @param length            Number of bytes to compress.
+ * @param destination       Where to put the compressed bytes.
+ * @param capacity          Size of <destination>.
+ * @return  Size of the compressed bytes, or 0 if they don't fit in
+ *          <capacity>.
+ */
+std::size_t lz4Compress(const void *source, const std::size_t length,
+                        void *destination, const std::size_t capacity);
+
+/**
+ * Decompresses bytes produced by lz4Compress().  Malformed input is detected
+ * rather than read or written out of bounds.
+ *
+ * @param source            Compressed bytes.
+ * @param length            Number of compressed bytes.
+ * @param destination       Where to put the decompressed bytes.
+ * @param expected_length   Number of bytes the input decompresses to.
+ * @return  Whether the input was well formed and decompressed to exactly
+ *          <expected_length> bytes.
+ */
+bool lz4Decompress(const void *source, const std::size_t length,
+                   void *destination, const std::size_t expected_length);
+
+}  // namespace badgerdb
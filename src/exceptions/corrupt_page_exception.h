@@ -0,0 +1,57 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a page read from a file does not
+ *        match the checksum stored with it.
+ *
+ * @see File::setChecksums()
+ */
+class CorruptPageException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a corrupt page exception for the given page number and
+   * filename.
+   *
+   * @param page_number   Number of the corrupt page.
+   * @param file          Name of file holding the page.
+   */
+  CorruptPageException(const PageId page_number, const std::string &file);
+
+  /**
+   * Returns the number of the corrupt page.
+   */
+  virtual PageId page_number() const { return page_number_; }
+
+  /**
+   * Returns name of the file that caused this exception.
+   */
+  virtual const std::string &filename() const { return filename_; }
+
+ protected:
+  /**
+   * Number of the corrupt page.
+   */
+  const PageId page_number_;
+
+  /**
+   * Name of file which caused this exception.
+   */
+  const std::string filename_;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,53 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when the operating system reports an
+ *        error while reading or writing a file.
+ */
+class FileIOException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file I/O exception for the given file.
+   *
+   * @param name        Name of file on which the I/O failed.
+   * @param error_code  errno value reported by the failed call.
+   */
+  explicit FileIOException(const std::string &name, const int error_code);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string &filename() const { return filename_; }
+
+  /**
+   * Returns the errno value reported by the failed call.
+   */
+  virtual int error_code() const { return error_code_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+
+  /**
+   * errno value reported by the failed call.
+   */
+  const int error_code_;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,42 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <string>
+
+#include "badgerdb_exception.h"
+
+namespace badgerdb {
+
+/**
+ * @brief An exception that is thrown when a file that can only be read is
+ *        modified, such as a file in an old format that has not been upgraded.
+ */
+class FileReadOnlyException : public BadgerDbException {
+ public:
+  /**
+   * Constructs a file read-only exception for the given file.
+   *
+   * @param name  Name of file that's read-only.
+   */
+  explicit FileReadOnlyException(const std::string &name);
+
+  /**
+   * Returns the name of the file that caused this exception.
+   */
+  virtual const std::string &filename() const { return filename_; }
+
+ protected:
+  /**
+   * Name of file that caused this exception.
+   */
+  const std::string filename_;
+};
+
+}  // namespace badgerdb
@@ -8,24 +8,111 @@
 
 #include "file.h"
 
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cassert>
-#include <cstdio>
-#include <fstream>
+#include <cerrno>
+#include <cstddef>
+#include <cstring>
 #include <iostream>
 #include <memory>
 #include <string>
 
+#include "exceptions/badgerdb_exception.h"
 #include "exceptions/file_exists_exception.h"
+#include "exceptions/corrupt_page_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
 #include "exceptions/file_open_exception.h"
+#include "exceptions/file_read_only_exception.h"
 #include "exceptions/invalid_page_exception.h"
+#include "checksum.h"
 #include "file_iterator.h"
 #include "page.h"
+#include "page_view.h"
 
 namespace badgerdb {
 
-File::StreamMap File::open_streams_;
+namespace {
+
+// Marks a version 2 (or later) file.  It sits where a version 1 file keeps
+// its page count, which would otherwise describe a file of several terabytes.
+const std::uint32_t FILE_MAGIC = 0x47444242;
+
+/**
+ * Layout of the header block of a version 2 file.
+ */
+struct DiskHeader {
+  std::uint32_t magic;
+  std::uint32_t version;
+  PageId num_pages;
+  PageId first_used_page;
+  PageId num_free_pages;
+  PageId first_free_page;
+  PageId last_used_page;
+  std::uint32_t flags;
+};
+
+// Flag set in DiskHeader::flags when pages carry checksums.  Files written
+// before flags existed have zeros there.
+const std::uint32_t FLAG_CHECKSUMS = 1;
+
+// Returns the checksum of a page: a CRC-32C of its header, less the next
+// page number, and its data.
+std::uint32_t pageChecksum(const PageHeader &header, const char *data) {
+  const std::size_t skip_start = offsetof(PageHeader, next_page_number);
+  const std::size_t skip_end = skip_start + sizeof(PageId);
+  const char *header_bytes = reinterpret_cast<const char *>(&header);
+  std::uint32_t crc = crc32c(0, header_bytes, skip_start);
+  crc = crc32c(crc, header_bytes + skip_end, sizeof(PageHeader) - skip_end);
+  return crc32c(crc, data, Page::DATA_SIZE);
+}
+
+// Stores the checksum of a page image in place of its next page number.
+void stampImage(char *image) {
+  PageHeader header;
+  std::memcpy(&header, image, sizeof(header));
+  header.next_page_number = pageChecksum(header, image + sizeof(header));
+  std::memcpy(image, &header, sizeof(header));
+}
+
+// Returns whether a page image read from disk matches its checksum.
+bool checksumMatches(const PageHeader &header, const char *data) {
+  return header.next_page_number == pageChecksum(header, data);
+}
+
+// Number of 64-bit words in a bitmap block.
+const std::size_t WORDS_PER_BITMAP = Page::SIZE / sizeof(std::uint64_t);
+
+// Largest number of pages copied at once by File::upgrade().
+const PageId UPGRADE_BATCH_PAGES = 64;
+
+// Returns the number of bitmap groups needed for pages 1 to num_pages - 1.
+PageId numGroups(const PageId num_pages) {
+  return num_pages <= 1 ? 0 : (num_pages - 2) / File::PAGES_PER_BITMAP + 1;
+}
+
+}  // namespace
+
+File::OpenFileMap File::open_files_;
 File::CountMap File::open_counts_;
+std::mutex File::open_files_mutex_;
+std::shared_ptr<StorageProvider> File::storage_ =
+    std::make_shared<PosixStorage>();
+
+File::OpenFile::~OpenFile() {
+  // Views must not be used after the file is closed, so mappings they still
+  // refer to go too.
+  if (mapping != NULL) {
+    backend->unmap(mapping->address, mapping->length);
+  }
+  for (const auto &old_mapping : old_mappings) {
+    backend->unmap(old_mapping->address, old_mapping->length);
+  }
+}
 
 File File::create(const std::string &filename) {
   return File(filename, true /* create_new */);
@@ -42,174 +129,705 @@ void File::remove(const std::string &filename) {
   if (isOpen(filename)) {
     throw FileOpenException(filename);
   }
-  std::remove(filename.c_str());
+  storage()->remove(filename);
 }
 
 bool File::isOpen(const std::string &filename) {
   if (!exists(filename)) {
     return false;
   }
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
   return open_counts_.find(filename) != open_counts_.end();
 }
 
 bool File::exists(const std::string &filename) {
-  std::fstream file(filename);
-  if (file) {
-    file.close();
-    return true;
-  }
+  return storage()->exists(filename);
+}
+
+void File::setStorage(std::shared_ptr<StorageProvider> storage) {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  storage_ = storage;
+}
 
-  return false;
+std::shared_ptr<StorageProvider> File::storage() {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  return storage_;
 }
 
 File::File(const File &other)
-    : filename_(other.filename_),
-      stream_(open_streams_[filename_]),
-      valid_(other.valid_) {
-  ++open_counts_[filename_];
+    : filename_(other.filename_), valid_(other.valid_) {
+  if (other.open_file_) {
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    ++open_counts_[filename_];
+    open_file_ = other.open_file_;
+  }
 }
 
 File &File::operator=(const File &rhs) {
-  // This accounts for self-assignment and assignment of a File object for the
-  // same file.
+  // Hold on to the other file's descriptor first; this accounts for
+  // self-assignment and assignment of a File object for the same file.
+  const std::shared_ptr<OpenFile> other_file = rhs.open_file_;
+  const std::string other_filename = rhs.filename_;
+  const bool other_valid = rhs.valid_;
   close();  // close my file and associate me with the new one
-  filename_ = rhs.filename_;
-  valid_ = rhs.valid_;
-  openIfNeeded(false /* create_new */);
+  filename_ = other_filename;
+  valid_ = other_valid;
+  if (other_file) {
+    std::lock_guard<std::mutex> lock(open_files_mutex_);
+    if (++open_counts_[filename_] == 1) {
+      open_files_[filename_] = other_file;
+    }
+    open_file_ = other_file;
+  }
   return *this;
 }
 
-File::~File() { close(); }
+File::~File() {
+  try {
+    close();
+  } catch (const BadgerDbException &e) {
+    // Destructors must not throw.
+  }
+}
 
 Page File::allocatePage() {
-  FileHeader header = readHeader();
+  checkWritable();
   Page new_page;
-  Page existing_page;
-  if (header.num_free_pages > 0) {
-    new_page = readPage(header.first_free_page, true /* allow_free */);
-    new_page.set_page_number(header.first_free_page);
-    header.first_free_page = new_page.next_page_number();
-    --header.num_free_pages;
-
-    if (header.first_used_page == Page::INVALID_NUMBER ||
-        header.first_used_page > new_page.page_number()) {
-      // Either have no pages used or the head of the used list is a page
-      // later than the one we just allocated, so add the new page to the
-      // head.
-      if (header.first_used_page > new_page.page_number()) {
-        new_page.set_next_page_number(header.first_used_page);
-      }
-      header.first_used_page = new_page.page_number();
+  {
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    FileHeader &header = open_file_->header;
+    if (header.num_free_pages == 0) {
+      new_page = appendPagesLocked(1).front();
     } else {
-      // New page is reused from somewhere after the beginning, so we need
-      // to find where in the used list to insert it.
-      PageId next_page_number = Page::INVALID_NUMBER;
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        next_page_number = (*iter).next_page_number();
-        if (next_page_number > new_page.page_number() ||
-            next_page_number == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
-        }
+      // Reuse the lowest free page, which keeps the file compact.
+      const PageId page_number = firstFreeLocked(
+          std::max(header.first_free_page, static_cast<PageId>(1)));
+      --header.num_free_pages;
+      header.first_free_page =
+          header.num_free_pages > 0 ? page_number + 1 : Page::INVALID_NUMBER;
+      setUsedLocked(page_number, true);
+      if (header.first_used_page == Page::INVALID_NUMBER ||
+          page_number < header.first_used_page) {
+        header.first_used_page = page_number;
       }
-      existing_page.set_next_page_number(new_page.page_number());
-      new_page.set_next_page_number(next_page_number);
+      if (page_number > header.last_used_page) {
+        header.last_used_page = page_number;
+      }
+      open_file_->header_dirty = true;
+
+      new_page.set_page_number(page_number);
+      new_page.set_next_page_number(nextUsedLocked(page_number));
+      writePage(page_number, new_page);
     }
+  }
+  wrote(1);
 
-    assert((header.num_free_pages == 0) ==
-           (header.first_free_page == Page::INVALID_NUMBER));
-  } else {
-    new_page.set_page_number(header.num_pages);
-    if (header.first_used_page == Page::INVALID_NUMBER) {
-      header.first_used_page = new_page.page_number();
-    } else {
-      // If we have pages allocated, we need to add the new page to the
-      // tail of the linked list.
-      for (FileIterator iter = begin(); iter != end(); ++iter) {
-        if ((*iter).next_page_number() == Page::INVALID_NUMBER) {
-          existing_page = *iter;
-          break;
+  return new_page;
+}
+
+std::vector<Page> File::allocatePages(const PageId num_pages) {
+  checkWritable();
+  if (num_pages == 0) {
+    return std::vector<Page>();
+  }
+  std::vector<Page> new_pages;
+  {
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    new_pages = appendPagesLocked(num_pages);
+  }
+  wrote(1);
+
+  return new_pages;
+}
+
+bool File::setDirectIO(const bool enable) {
+  if (open_file_->version == 1) {
+    // Pages of version 1 files are not block aligned.
+    return false;
+  }
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (enable && open_file_->memory_mapped) {
+    return false;
+  }
+  return open_file_->backend->setDirectIO(enable);
+}
+
+bool File::directIO() const { return open_file_->backend->directIO(); }
+
+bool File::setMemoryMapped(const bool enable) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (enable && (open_file_->backend->directIO() ||
+                 !open_file_->backend->mappable())) {
+    return false;
+  }
+  open_file_->memory_mapped = enable;
+  return enable;
+}
+
+bool File::memoryMapped() const { return open_file_->memory_mapped; }
+
+PageView File::readPageView(const PageId page_number) const {
+  if (!open_file_->memory_mapped) {
+    throw FileIOException(filename_, EINVAL);
+  }
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (page_number == Page::INVALID_NUMBER ||
+      page_number >= open_file_->header.num_pages) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const char *image = mappedPageLocked(page_number);
+  if (image == NULL || reinterpret_cast<const PageHeader *>(image)
+                               ->current_page_number == Page::INVALID_NUMBER) {
+    throw InvalidPageException(page_number, filename_);
+  }
+  const PageHeader *header = reinterpret_cast<const PageHeader *>(image);
+  if (open_file_->checksums && isUsedLocked(page_number) &&
+      !checksumMatches(*header, image + sizeof(PageHeader))) {
+    throw CorruptPageException(page_number, filename_);
+  }
+  const PageId next_page_number = open_file_->version == 1
+                                      ? header->next_page_number
+                                      : nextUsedLocked(page_number);
+  return PageView(image, next_page_number, open_file_->mapping);
+}
+
+void File::advise(const Advice advice, const PageId first_page,
+                  const PageId num_pages) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  const PageId end_page =
+      num_pages == 0
+          ? open_file_->header.num_pages
+          : std::min(first_page + num_pages, open_file_->header.num_pages);
+  if (first_page == Page::INVALID_NUMBER || first_page >= end_page) {
+    return;
+  }
+  const off_t start = pagePosition(first_page);
+  const off_t end = pagePosition(end_page - 1) + Page::SIZE;
+  open_file_->backend->advise(start, end - start, advice);
+
+  OpenFile &state = *open_file_;
+  if (state.mapping != NULL) {
+    int map_advice = MADV_NORMAL;
+    switch (advice) {
+      case Advice::NORMAL:
+        break;
+      case Advice::SEQUENTIAL:
+        map_advice = MADV_SEQUENTIAL;
+        break;
+      case Advice::RANDOM:
+        map_advice = MADV_RANDOM;
+        break;
+      case Advice::WILLNEED:
+        map_advice = MADV_WILLNEED;
+        break;
+      case Advice::DONTNEED:
+        map_advice = MADV_DONTNEED;
+        break;
+    }
+    // madvise needs a page-aligned start.  Advice is only a hint, so
+    // failures are ignored.
+    const off_t map_start = start - start % ::sysconf(_SC_PAGESIZE);
+    const off_t map_end = std::min<off_t>(end, state.mapped_size);
+    if (map_start < map_end) {
+      ::madvise(const_cast<char *>(state.mapping->address) + map_start,
+                map_end - map_start, map_advice);
+    }
+  }
+}
+
+void File::setChecksums(const bool enable) {
+  checkWritable();
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  OpenFile &state = *open_file_;
+  if (enable == state.checksums) {
+    return;
+  }
+  if (enable) {
+    // Stamp the used pages in batches.  Batches start one past a multiple of
+    // UPGRADE_BATCH_PAGES, so they never straddle a bitmap block.
+    std::vector<char> buffer(UPGRADE_BATCH_PAGES * Page::SIZE);
+    for (PageId first = 1; first < state.header.num_pages;
+         first += UPGRADE_BATCH_PAGES) {
+      const PageId count =
+          std::min(UPGRADE_BATCH_PAGES, state.header.num_pages - first);
+      readAt(buffer.data(), count * Page::SIZE, pagePosition(first));
+      for (PageId i = 0; i < count; ++i) {
+        if (isUsedLocked(first + i)) {
+          stampImage(buffer.data() + i * Page::SIZE);
         }
       }
-      assert(existing_page.isUsed());
-      existing_page.set_next_page_number(new_page.page_number());
+      writeAt(buffer.data(), count * Page::SIZE, pagePosition(first));
     }
-    ++header.num_pages;
-  }
-  writePage(new_page.page_number(), new_page);
-  if (existing_page.page_number() != Page::INVALID_NUMBER) {
-    // If we updated an existing page by inserting the new page into the
-    // used list, we need to write it out.
-    writePage(existing_page.page_number(), existing_page);
   }
-  writeHeader(header);
+  state.checksums = enable;
+  state.header_dirty = true;
+  syncLocked();
+}
 
-  return new_page;
+void File::setHolePunching(const PageId run_pages) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  open_file_->hole_punch_pages = run_pages;
+}
+
+void File::setPreallocation(const std::size_t extent_bytes) {
+  const std::size_t bytes =
+      extent_bytes < MAX_EXTENT_BYTES ? extent_bytes : MAX_EXTENT_BYTES;
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  open_file_->extent_bytes = (bytes + Page::SIZE - 1) / Page::SIZE * Page::SIZE;
 }
 
 Page File::readPage(const PageId page_number) const {
+  Page page;
+  readPage(page_number, page);
+  return page;
+}
+
+void File::readPage(const PageId page_number, Page &page) const {
   FileHeader header = readHeader();
-  if (page_number >= header.num_pages) {
+  if (page_number == Page::INVALID_NUMBER ||
+      page_number >= header.num_pages) {
     throw InvalidPageException(page_number, filename_);
   }
-  return readPage(page_number, false /* allow_free */);
+  readPageInto(page_number, page, false /* allow_free */);
 }
 
 Page File::readPage(const PageId page_number, const bool allow_free) const {
   Page page;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&page.header_), sizeof(page.header_));
-  stream_->read(&page.data_[0], Page::DATA_SIZE);
+  readPageInto(page_number, page, allow_free);
+  return page;
+}
+
+void File::readPageInto(const PageId page_number, Page &page,
+                        const bool allow_free) const {
+  const off_t position = pagePosition(page_number);
+  if (open_file_->memory_mapped) {
+    const char *image;
+    std::shared_ptr<const Mapping> mapping;
+    {
+      std::lock_guard<std::mutex> lock(open_file_->mutex);
+      image = mappedPageLocked(page_number);
+      mapping = open_file_->mapping;
+    }
+    // Holding the mapping keeps it mapped, so the image can be copied
+    // without the lock.
+    if (image != NULL) {
+      std::memcpy(page.image(), image, Page::SIZE);
+    }
+    if (image == NULL ||
+        page.header_.current_page_number == Page::INVALID_NUMBER) {
+      // Page is free or past the end of the file.
+      page.initialize();
+    }
+  } else {
+    const std::size_t bytes_read =
+        open_file_->backend->read(page.image(), Page::SIZE, position);
+    if (bytes_read < sizeof(page.header_)) {
+      // Page is past the end of the file.
+      page.initialize();
+    } else if (bytes_read < Page::SIZE) {
+      // Torn last page; don't leave what <page> held before in its tail.
+      std::memset(page.image() + bytes_read, 0, Page::SIZE - bytes_read);
+    }
+  }
+  if (open_file_->version != 1) {
+    PageId next_page_number;
+    bool used;
+    {
+      std::lock_guard<std::mutex> lock(open_file_->mutex);
+      used = page_number < open_file_->header.num_pages &&
+             isUsedLocked(page_number);
+      next_page_number = nextUsedLocked(page_number);
+    }
+    if (used && open_file_->checksums &&
+        !checksumMatches(page.header_, page.data_)) {
+      throw CorruptPageException(page_number, filename_);
+    }
+    // The next pointer on disk may be stale, or hold the checksum; the
+    // bitmap is authoritative.
+    if (page.isUsed()) {
+      page.set_next_page_number(next_page_number);
+    }
+  }
   if (!allow_free && !page.isUsed()) {
     throw InvalidPageException(page_number, filename_);
   }
+}
 
-  return page;
+std::vector<Page> File::readPages(const PageId first_page,
+                                  const PageId num_pages) const {
+  std::vector<Page> pages;
+  const FileHeader header = readHeader();
+  if (first_page == Page::INVALID_NUMBER || first_page >= header.num_pages) {
+    return pages;
+  }
+  const PageId count = std::min(num_pages, header.num_pages - first_page);
+  pages.resize(count);
+
+  for (PageId i = 0; i < count;) {
+    // Pages are contiguous on disk up to the end of their bitmap group, and
+    // in the vector, so each run is read straight into place.
+    PageId run = count - i;
+    if (open_file_->version != 1) {
+      run = std::min(run, PAGES_PER_BITMAP -
+                              (first_page + i - 1) % PAGES_PER_BITMAP);
+    }
+    readAt(pages[i].image(), run * Page::SIZE, pagePosition(first_page + i));
+    i += run;
+  }
+
+  if (open_file_->version != 1) {
+    std::vector<bool> used(count);
+    {
+      std::lock_guard<std::mutex> lock(open_file_->mutex);
+      for (PageId i = 0; i < count; ++i) {
+        used[i] = isUsedLocked(first_page + i);
+        if (pages[i].isUsed()) {
+          pages[i].set_next_page_number(nextUsedLocked(first_page + i));
+        }
+      }
+    }
+    if (open_file_->checksums) {
+      verifyPages(first_page, pages.data(), used);
+    }
+  }
+  return pages;
 }
 
 void File::writePage(const Page &new_page) {
-  PageHeader header = readPageHeader(new_page.page_number());
-  if (header.current_page_number == Page::INVALID_NUMBER) {
-    // Page has been deleted since it was read.
-    throw InvalidPageException(new_page.page_number(), filename_);
+  checkWritable();
+  const PageId page_number = new_page.page_number();
+  PageHeader header = new_page.header_;
+  {
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    if (page_number == Page::INVALID_NUMBER ||
+        page_number >= open_file_->header.num_pages ||
+        !isUsedLocked(page_number)) {
+      // Page has been deleted since it was read.
+      throw InvalidPageException(page_number, filename_);
+    }
+    // Other pages may have been allocated or deleted since this page was
+    // read, so refresh its next page pointer.
+    header.next_page_number = nextUsedLocked(page_number);
   }
-  // Page on disk may have had its next page pointer updated since it was read;
-  // we don't modify that, but we do keep all the other modifications to the
-  // page header.
-  const PageId next_page_number = header.next_page_number;
-  header = new_page.header_;
-  header.next_page_number = next_page_number;
-  writePage(new_page.page_number(), header, new_page);
+  writePage(page_number, header, new_page);
+  wrote(1);
 }
 
 void File::deletePage(const PageId page_number) {
-  FileHeader header = readHeader();
-  Page existing_page = readPage(page_number);
-  Page previous_page;
-  // If this page is the head of the used list, update the header to point to
-  // the next page in line.
-  if (page_number == header.first_used_page) {
-    header.first_used_page = existing_page.next_page_number();
+  checkWritable();
+  {
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    FileHeader &header = open_file_->header;
+    if (page_number == Page::INVALID_NUMBER ||
+        page_number >= header.num_pages || !isUsedLocked(page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+    // Clear the page on disk, then take it off the used list.
+    writePage(page_number, Page());
+    if (page_number == header.first_used_page) {
+      header.first_used_page = nextUsedLocked(page_number);
+    }
+    if (page_number == header.last_used_page) {
+      header.last_used_page = prevUsedLocked(page_number);
+    }
+    setUsedLocked(page_number, false);
+    ++header.num_free_pages;
+    if (header.first_free_page == Page::INVALID_NUMBER ||
+        page_number < header.first_free_page) {
+      header.first_free_page = page_number;
+    }
+    open_file_->header_dirty = true;
+    if (open_file_->hole_punch_pages > 0) {
+      punchFreeRunLocked(page_number);
+    }
+  }
+  wrote(1);
+}
+
+std::map<PageId, PageId> File::compact() {
+  checkWritable();
+  std::map<PageId, PageId> moved;
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  const FileHeader &header = open_file_->header;
+  while (header.last_used_page != Page::INVALID_NUMBER) {
+    const PageId used_page = header.last_used_page;
+    const PageId new_page = movePageLocked(used_page);
+    if (new_page == used_page) {
+      break;  // no free page before it
+    }
+    moved[used_page] = new_page;
+  }
+  shrinkLocked();
+  return moved;
+}
+
+PageId File::movePage(const PageId page_number) {
+  checkWritable();
+  PageId new_page;
+  {
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    if (page_number == Page::INVALID_NUMBER ||
+        page_number >= open_file_->header.num_pages ||
+        !isUsedLocked(page_number)) {
+      throw InvalidPageException(page_number, filename_);
+    }
+    new_page = movePageLocked(page_number);
+  }
+  wrote(1);
+  return new_page;
+}
+
+void File::shrink() {
+  checkWritable();
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  shrinkLocked();
+}
+
+PageId File::movePageLocked(const PageId page_number) {
+  FileHeader &header = open_file_->header;
+  if (header.num_free_pages == 0) {
+    return page_number;
+  }
+  const PageId free_page = firstFreeLocked(
+      std::max(header.first_free_page, static_cast<PageId>(1)));
+  if (free_page > page_number) {
+    return page_number;
+  }
+
+  std::vector<char> image(Page::SIZE);
+  readAt(image.data(), image.size(), pagePosition(page_number));
+  PageHeader page_header;
+  std::memcpy(&page_header, image.data(), sizeof(page_header));
+  if (open_file_->checksums &&
+      !checksumMatches(page_header, image.data() + sizeof(page_header))) {
+    throw CorruptPageException(page_number, filename_);
+  }
+  page_header.current_page_number = free_page;
+  std::memcpy(image.data(), &page_header, sizeof(page_header));
+  if (open_file_->checksums) {
+    stampImage(image.data());
+  }
+  writeAt(image.data(), image.size(), pagePosition(free_page));
+  // Clear the old copy, as deletePage() would.
+  writePage(page_number, Page());
+
+  // The page count stays the same: one page is taken, one is given back.
+  setUsedLocked(free_page, true);
+  setUsedLocked(page_number, false);
+  // free_page comes before page_number, so it is the new first used page
+  // whenever page_number was the first.  Set it before prevUsedLocked(),
+  // which scans no further back than first_used_page.
+  if (header.first_used_page == page_number ||
+      header.first_used_page > free_page) {
+    header.first_used_page = free_page;
+  }
+  if (header.last_used_page == page_number) {
+    header.last_used_page = prevUsedLocked(page_number);
+  }
+  // The old page is now free, so there is a free page after free_page.
+  header.first_free_page = firstFreeLocked(free_page + 1);
+  open_file_->header_dirty = true;
+  return free_page;
+}
+
+void File::shrinkLocked() {
+  OpenFile &state = *open_file_;
+  FileHeader &header = state.header;
+  const PageId num_pages = header.last_used_page == Page::INVALID_NUMBER
+                               ? 1
+                               : header.last_used_page + 1;
+  if (num_pages == header.num_pages) {
+    return;
+  }
+
+  // Drop the free pages at the end, and their bitmap blocks.
+  header.num_free_pages -= header.num_pages - num_pages;
+  header.num_pages = num_pages;
+  if (header.num_free_pages == 0) {
+    header.first_free_page = Page::INVALID_NUMBER;
+  }
+  state.header_dirty = true;
+  const PageId groups = numGroups(header.num_pages);
+  state.bitmap.resize(groups * WORDS_PER_BITMAP);
+  state.bitmap_dirty.resize(groups);
+
+  // Moved pages must be durable before the space they came from goes.
+  syncLocked();
+  const off_t end = header.num_pages > 1
+                        ? pagePosition(header.num_pages - 1) + Page::SIZE
+                        : static_cast<off_t>(Page::SIZE);
+  if (state.backend->truncate(end)) {
+    state.backend->sync();
+    state.reserved_end = 0;
+    // Pages past the new end may not be touched through the mapping until
+    // the file grows back over them.
+    state.mapped_size =
+        std::min(state.mapped_size, static_cast<std::size_t>(end));
+  }
+}
+
+void File::upgrade(const std::string &filename) {
+  if (!exists(filename)) {
+    throw FileNotFoundException(filename);
+  }
+  if (isOpen(filename)) {
+    throw FileOpenException(filename);
+  }
+  const std::string upgraded_filename = filename + ".upgrade";
+  {
+    File old_file = File::open(filename);
+    if (old_file.formatVersion() == FORMAT_VERSION) {
+      return;
+    }
+    if (exists(upgraded_filename)) {
+      // Left behind by an interrupted upgrade.
+      storage()->remove(upgraded_filename);
+    }
+    File new_file = File::create(upgraded_filename);
+    const FileHeader old_header = old_file.readHeader();
+
+    std::lock_guard<std::mutex> lock(new_file.open_file_->mutex);
+    FileHeader &header = new_file.open_file_->header;
+    header = {old_header.num_pages, Page::INVALID_NUMBER, 0 /* num_free_pages */,
+              Page::INVALID_NUMBER, Page::INVALID_NUMBER};
+    const PageId groups = numGroups(header.num_pages);
+    new_file.open_file_->bitmap.assign(groups * WORDS_PER_BITMAP, 0);
+    new_file.open_file_->bitmap_dirty.assign(groups, true);
+
+    // Copy the pages across in batches.  Batches start one past a multiple
+    // of UPGRADE_BATCH_PAGES, so they never straddle a bitmap block.
+    std::vector<char> buffer(UPGRADE_BATCH_PAGES * Page::SIZE);
+    for (PageId first = 1; first < header.num_pages;
+         first += UPGRADE_BATCH_PAGES) {
+      const PageId count =
+          std::min(UPGRADE_BATCH_PAGES, header.num_pages - first);
+      old_file.readAt(buffer.data(), count * Page::SIZE,
+                      old_file.pagePosition(first));
+      new_file.writeAt(buffer.data(), count * Page::SIZE,
+                       new_file.pagePosition(first));
+      for (PageId i = 0; i < count; ++i) {
+        PageHeader page_header;
+        std::memcpy(&page_header, buffer.data() + i * Page::SIZE,
+                    sizeof(page_header));
+        const PageId page_number = first + i;
+        if (page_header.current_page_number != Page::INVALID_NUMBER) {
+          new_file.setUsedLocked(page_number, true);
+          if (header.first_used_page == Page::INVALID_NUMBER) {
+            header.first_used_page = page_number;
+          }
+          header.last_used_page = page_number;
+        } else {
+          ++header.num_free_pages;
+          if (header.first_free_page == Page::INVALID_NUMBER) {
+            header.first_free_page = page_number;
+          }
+        }
+      }
+    }
+    new_file.open_file_->header_dirty = true;
+    new_file.syncLocked();
+  }
+  storage()->rename(upgraded_filename, filename);
+}
+
+void File::setDurability(const Durability mode,
+                         const std::uint32_t batch_pages,
+                         const std::uint32_t batch_ms) {
+  std::lock_guard<std::mutex> syncer_lock(open_file_->syncer_mutex);
+  stopSyncer();
+  {
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    if (open_file_->unsynced_writes > 0 && mode != Durability::NONE) {
+      // Writes made under the old mode become durable under the new one.
+      syncLocked();
+    }
+    open_file_->durability = mode;
+    open_file_->batch_pages = batch_pages;
+    open_file_->batch_ms = batch_ms;
+  }
+  if (mode == Durability::BATCHED && batch_ms > 0) {
+    startSyncer();
+  }
+}
+
+Durability File::durability() const {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return open_file_->durability;
+}
+
+void File::sync() {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  if (open_file_->durability != Durability::NONE &&
+      (open_file_->unsynced_writes > 0 || open_file_->header_dirty)) {
+    syncLocked();
   } else {
-    // Walk the used list so we can update the page that points to this one.
-    for (FileIterator iter = begin(); iter != end(); ++iter) {
-      previous_page = *iter;
-      if (previous_page.next_page_number() == existing_page.page_number()) {
-        previous_page.set_next_page_number(existing_page.next_page_number());
-        break;
+    flushMetadataLocked();
+  }
+}
+
+PageId File::nextUsedPage(const PageId page_number) const {
+  if (open_file_->version == 1) {
+    return readPageHeader(page_number).next_page_number;
+  }
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return nextUsedLocked(page_number);
+}
+
+PageId File::usedSpan(const PageId first_page,
+                      const PageId max_pages) const {
+  if (open_file_->version == 1 || max_pages <= 1) {
+    return 1;
+  }
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  // Pages are contiguous on disk up to the end of their bitmap group.
+  const PageId group_end =
+      first_page + (PAGES_PER_BITMAP - (first_page - 1) % PAGES_PER_BITMAP);
+  const PageId limit = std::min(
+      {first_page + max_pages, group_end, open_file_->header.last_used_page + 1});
+  if (limit <= first_page) {
+    return 0;  // first_page and every page after it were freed
+  }
+  const PageId last =
+      isUsedLocked(limit - 1) ? limit - 1 : prevUsedLocked(limit - 1);
+  if (last == Page::INVALID_NUMBER || last < first_page) {
+    return 0;  // first_page was freed, along with the rest of the span
+  }
+  return last - first_page + 1;
+}
+
+void File::readChunk(const PageId first_page,
+                     std::vector<Page> &pages) const {
+  assert(pages.size() <= MAX_CHUNK_PAGES);
+  if (pages.empty()) {
+    return;
+  }
+  const std::size_t bytes_read = open_file_->backend->read(
+      pages.front().image(), pages.size() * Page::SIZE,
+      pagePosition(first_page));
+  for (std::size_t i = bytes_read / Page::SIZE; i < pages.size(); ++i) {
+    // Page is past the end of the file.
+    pages[i].initialize();
+  }
+  if (open_file_->version != 1 && open_file_->checksums) {
+    std::vector<bool> used(pages.size());
+    {
+      std::lock_guard<std::mutex> lock(open_file_->mutex);
+      for (std::size_t i = 0; i < pages.size(); ++i) {
+        used[i] = isUsedLocked(first_page + i);
       }
     }
+    verifyPages(first_page, pages.data(), used);
   }
-  // Clear the page and add it to the head of the free list.
-  existing_page.initialize();
-  existing_page.set_next_page_number(header.first_free_page);
-  header.first_free_page = page_number;
-  ++header.num_free_pages;
-  if (previous_page.isUsed()) {
-    writePage(previous_page.page_number(), previous_page);
+}
+
+void File::verifyPages(const PageId first_page, const Page *pages,
+                       const std::vector<bool> &used) const {
+  for (std::size_t i = 0; i < used.size(); ++i) {
+    if (used[i] &&
+        !checksumMatches(pages[i].header_, pages[i].data_)) {
+      throw CorruptPageException(first_page + i, filename_);
+    }
   }
-  writePage(page_number, existing_page);
-  writeHeader(header);
 }
 
 FileIterator File::begin() {
@@ -226,46 +844,165 @@ File::File(const std::string &name, const bool create_new)
   if (create_new) {
     // File starts with 1 page (the header).
     FileHeader header = {1 /* num_pages */, 0 /* first_used_page */,
-                         0 /* num_free_pages */, 0 /* first_free_page */};
+                         0 /* num_free_pages */, 0 /* first_free_page */,
+                         0 /* last_used_page */};
     writeHeader(header);
+    std::lock_guard<std::mutex> lock(open_file_->mutex);
+    flushMetadataLocked();
   }
 }
 
 void File::openIfNeeded(const bool create_new) {
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
   if (open_counts_.find(filename_) !=
       open_counts_.end()) {  // exists an entry already
+    if (create_new) {
+      throw FileExistsException(filename_);
+    }
     ++open_counts_[filename_];
-    stream_ = open_streams_[filename_];
+    open_file_ = open_files_[filename_];
   } else {
-    std::ios_base::openmode mode =
-        std::fstream::in | std::fstream::out | std::fstream::binary;
-    const bool already_exists = exists(filename_);
-    if (create_new) {
-      // Error if we try to overwrite an existing file.
-      if (already_exists) {
-        throw FileExistsException(filename_);
-      }
-      // New files have to be truncated on open.
-      mode = mode | std::fstream::trunc;
-    } else {
-      // Error if we try to open a file that doesn't exist.
-      if (!already_exists) {
-        valid_ = false;
-        throw FileNotFoundException(filename_);
-      }
+    try {
+      open_file_ = std::make_shared<OpenFile>(
+          storage_->open(filename_, create_new));
+    } catch (const FileNotFoundException &e) {
+      valid_ = false;
+      throw;
+    }
+    if (!create_new) {
+      loadMetadata();
     }
-    stream_.reset(new std::fstream(filename_, mode));
-    open_streams_[filename_] = stream_;
+    open_files_[filename_] = open_file_;
     open_counts_[filename_] = 1;
   }
 }
 
 void File::close() {
-  --open_counts_[filename_];
-  stream_.reset();
-  if (open_counts_[filename_] == 0) {
-    open_streams_.erase(filename_);
+  if (!open_file_) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(open_files_mutex_);
+  valid_ = false;
+  if (--open_counts_[filename_] == 0) {
+    // Last user of the file; persist the cached state before anyone can
+    // open it again.
+    open_files_.erase(filename_);
     open_counts_.erase(filename_);
+    {
+      std::lock_guard<std::mutex> syncer_lock(open_file_->syncer_mutex);
+      stopSyncer();
+    }
+    try {
+      std::lock_guard<std::mutex> file_lock(open_file_->mutex);
+      if (open_file_->durability != Durability::NONE) {
+        syncLocked();
+      } else {
+        flushMetadataLocked();
+      }
+    } catch (const BadgerDbException &e) {
+      open_file_.reset();
+      throw;
+    }
+  }
+  open_file_.reset();
+}
+
+void File::readAt(void *buffer, const std::size_t length,
+                  const off_t offset) const {
+  const std::size_t bytes_read =
+      open_file_->backend->read(buffer, length, offset);
+  if (bytes_read < length) {
+    // Past the end of the file.
+    std::memset(static_cast<char *>(buffer) + bytes_read, 0,
+                length - bytes_read);
+  }
+}
+
+void File::writeAt(const void *buffer, const std::size_t length,
+                   const off_t offset) {
+  open_file_->backend->write(buffer, length, offset);
+}
+
+void File::wrote(const std::uint32_t num_writes) {
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  switch (open_file_->durability) {
+    case Durability::NONE:
+      break;
+    case Durability::BATCHED: {
+      open_file_->unsynced_writes += num_writes;
+      const auto since_sync =
+          std::chrono::steady_clock::now() - open_file_->last_sync;
+      if (open_file_->unsynced_writes >= open_file_->batch_pages ||
+          since_sync >= std::chrono::milliseconds(open_file_->batch_ms)) {
+        syncLocked();
+      } else if (open_file_->unsynced_writes == num_writes) {
+        // First writes since the last sync; start the syncer's clock.
+        open_file_->syncer_wakeup.notify_one();
+      }
+      break;
+    }
+    case Durability::STRICT:
+      open_file_->unsynced_writes += num_writes;
+      syncLocked();
+      break;
+  }
+}
+
+void File::syncLocked() {
+  flushMetadataLocked();
+  open_file_->backend->sync();
+  open_file_->unsynced_writes = 0;
+  open_file_->last_sync = std::chrono::steady_clock::now();
+}
+
+void File::startSyncer() {
+  open_file_->stop_syncer = false;
+  open_file_->syncer = std::thread(
+      [state = open_file_, filename = filename_]() {
+        // The thread gets a handle of its own that isn't counted in
+        // open_counts_, so the file can still be closed; the last close
+        // stops the thread before the state goes.
+        File handle;
+        handle.filename_ = filename;
+        handle.open_file_ = state;
+        handle.valid_ = true;
+        handle.runSyncer();
+        handle.open_file_.reset();
+      });
+}
+
+void File::stopSyncer() {
+  OpenFile &state = *open_file_;
+  if (!state.syncer.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.stop_syncer = true;
+  }
+  state.syncer_wakeup.notify_all();
+  state.syncer.join();
+}
+
+void File::runSyncer() {
+  OpenFile &state = *open_file_;
+  const std::chrono::milliseconds batch_time(state.batch_ms);
+  std::unique_lock<std::mutex> lock(state.mutex);
+  while (!state.stop_syncer) {
+    if (state.unsynced_writes == 0) {
+      state.syncer_wakeup.wait(lock);
+    } else if (std::chrono::steady_clock::now() <
+               state.last_sync + batch_time) {
+      state.syncer_wakeup.wait_until(lock, state.last_sync + batch_time);
+    } else {
+      try {
+        syncLocked();
+      } catch (const BadgerDbException &e) {
+        // Nobody to report to; the next sync() or write tries again and
+        // throws.  Back off so as not to spin on a failing device.
+        state.syncer_wakeup.wait_for(lock, batch_time);
+      }
+    }
   }
 }
 
@@ -275,30 +1012,315 @@ void File::writePage(const PageId page_number, const Page &new_page) {
 
 void File::writePage(const PageId page_number, const PageHeader &header,
                      const Page &new_page) {
-  stream_->seekp(pagePosition(page_number), std::ios::beg);
-  stream_->write(reinterpret_cast<const char *>(&header), sizeof(header));
-  stream_->write(&new_page.data_[0], Page::DATA_SIZE);
-  stream_->flush();
+  if (!open_file_->checksums &&
+      std::memcmp(&header, &new_page.header_, sizeof(header)) == 0) {
+    // The page goes out as it is, so an aligned frame is written without
+    // staging under direct I/O.
+    open_file_->backend->write(new_page.image(), Page::SIZE,
+                               pagePosition(page_number));
+    return;
+  }
+  PageHeader disk_header = header;
+  if (open_file_->checksums) {
+    disk_header.next_page_number =
+        pageChecksum(disk_header, new_page.data_);
+  }
+  struct iovec image[2] = {
+      {&disk_header, sizeof(disk_header)},
+      {const_cast<char *>(new_page.data_), Page::DATA_SIZE}};
+  open_file_->backend->writev(image, 2, pagePosition(page_number));
 }
 
 FileHeader File::readHeader() const {
-  FileHeader header;
-  stream_->seekg(0 /* pos */, std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&header), sizeof(header));
-
-  return header;
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  return open_file_->header;
 }
 
 void File::writeHeader(const FileHeader &header) {
-  stream_->seekp(0 /* pos */, std::ios::beg);
-  stream_->write(reinterpret_cast<const char *>(&header), sizeof(header));
-  stream_->flush();
+  std::lock_guard<std::mutex> lock(open_file_->mutex);
+  open_file_->header = header;
+  open_file_->header_dirty = true;
+}
+
+void File::loadMetadata() {
+  OpenFile &state = *open_file_;
+  DiskHeader disk_header;
+  readAt(&disk_header, sizeof(disk_header), 0 /* offset */);
+  if (disk_header.magic != FILE_MAGIC) {
+    // Version 1 file, whose header is just the first four fields.
+    state.version = 1;
+    PageId fields[4];
+    std::memcpy(fields, &disk_header, sizeof(fields));
+    state.header = {fields[0], fields[1], fields[2], fields[3],
+                    Page::INVALID_NUMBER};
+    return;
+  }
+  if (disk_header.version != FORMAT_VERSION) {
+    throw FileIOException(filename_, EINVAL);
+  }
+  state.version = disk_header.version;
+  state.checksums = (disk_header.flags & FLAG_CHECKSUMS) != 0;
+  state.header = {disk_header.num_pages, disk_header.first_used_page,
+                  disk_header.num_free_pages, disk_header.first_free_page,
+                  disk_header.last_used_page};
+
+  const PageId groups = numGroups(state.header.num_pages);
+  state.bitmap.resize(groups * WORDS_PER_BITMAP);
+  state.bitmap_dirty.assign(groups, false);
+  for (PageId group = 0; group < groups; ++group) {
+    readAt(&state.bitmap[group * WORDS_PER_BITMAP], Page::SIZE,
+           bitmapPosition(group));
+  }
+}
+
+void File::flushMetadataLocked() {
+  OpenFile &state = *open_file_;
+  if (state.header_dirty) {
+    const FileHeader &header = state.header;
+    const DiskHeader disk_header = {
+        FILE_MAGIC,             state.version,         header.num_pages,
+        header.first_used_page, header.num_free_pages, header.first_free_page,
+        header.last_used_page,  state.checksums ? FLAG_CHECKSUMS : 0};
+    std::vector<char> block(Page::SIZE, 0);
+    std::memcpy(block.data(), &disk_header, sizeof(disk_header));
+    writeAt(block.data(), block.size(), 0 /* offset */);
+    state.header_dirty = false;
+  }
+  for (PageId group = 0; group < state.bitmap_dirty.size(); ++group) {
+    if (state.bitmap_dirty[group]) {
+      writeAt(&state.bitmap[group * WORDS_PER_BITMAP], Page::SIZE,
+              bitmapPosition(group));
+      state.bitmap_dirty[group] = false;
+    }
+  }
+}
+
+std::vector<Page> File::appendPagesLocked(const PageId num_pages) {
+  OpenFile &state = *open_file_;
+  FileHeader &header = state.header;
+  const PageId first_page = header.num_pages;
+  const PageId last_page = first_page + num_pages - 1;
+
+  header.num_pages += num_pages;
+  const PageId groups = numGroups(header.num_pages);
+  if (groups > state.bitmap_dirty.size()) {
+    // The new pages start one or more groups, each of which needs a bitmap
+    // block of its own.
+    state.bitmap.resize(groups * WORDS_PER_BITMAP, 0);
+    state.bitmap_dirty.resize(groups, true);
+  }
+  for (PageId page_number = first_page; page_number <= last_page;
+       ++page_number) {
+    setUsedLocked(page_number, true);
+  }
+  if (header.first_used_page == Page::INVALID_NUMBER) {
+    header.first_used_page = first_page;
+  }
+  header.last_used_page = last_page;
+  state.header_dirty = true;
+
+  std::vector<Page> new_pages(num_pages);
+  for (PageId i = 0; i < num_pages; ++i) {
+    new_pages[i].set_page_number(first_page + i);
+    new_pages[i].set_next_page_number(i + 1 < num_pages ? first_page + i + 1
+                                                        : Page::INVALID_NUMBER);
+  }
+
+  reserveLocked(pagePosition(last_page) + Page::SIZE);
+  // Pages are contiguous on disk up to the end of their bitmap group, so
+  // each group's share of the run goes out in one write, straight from the
+  // vector unless the images need checksums.
+  std::vector<char> buffer;
+  for (PageId i = 0; i < num_pages;) {
+    const PageId run =
+        std::min(num_pages - i, PAGES_PER_BITMAP -
+                                    (first_page + i - 1) % PAGES_PER_BITMAP);
+    const char *images = new_pages[i].image();
+    if (state.checksums) {
+      buffer.assign(images, images + run * Page::SIZE);
+      for (PageId j = 0; j < run; ++j) {
+        stampImage(buffer.data() + j * Page::SIZE);
+      }
+      images = buffer.data();
+    }
+    writeAt(images, run * Page::SIZE, pagePosition(first_page + i));
+    i += run;
+  }
+
+  return new_pages;
+}
+
+void File::reserveLocked(const off_t end) {
+  OpenFile &state = *open_file_;
+  if (state.extent_bytes == 0 || end <= state.reserved_end) {
+    return;
+  }
+  if (state.reserved_end == 0) {
+    // First extension since the file was opened; space up to its current
+    // size is already allocated.
+    state.reserved_end = state.backend->size();
+    if (end <= state.reserved_end) {
+      return;
+    }
+  }
+  const off_t extent = state.extent_bytes;
+  const off_t new_end = (end + extent - 1) / extent * extent;
+  if (!state.backend->reserve(state.reserved_end,
+                              new_end - state.reserved_end)) {
+    // Storage can't preallocate; let writes extend the file instead.
+    state.extent_bytes = 0;
+    return;
+  }
+  state.reserved_end = new_end;
+}
+
+void File::punchFreeRunLocked(const PageId page_number) {
+  OpenFile &state = *open_file_;
+  // Runs are aligned within the page's bitmap group, since groups are
+  // separated on disk by their bitmap blocks.
+  const PageId run_pages = state.hole_punch_pages;
+  const PageId group_first =
+      page_number - (page_number - 1) % PAGES_PER_BITMAP;
+  const PageId group_end =
+      std::min(group_first + PAGES_PER_BITMAP, state.header.num_pages);
+  const PageId run_first =
+      group_first + (page_number - group_first) / run_pages * run_pages;
+  const PageId run_end = std::min(run_first + run_pages, group_end);
+  for (PageId page = run_first; page < run_end; ++page) {
+    if (isUsedLocked(page)) {
+      return;
+    }
+  }
+  if (!state.backend->punchHole(pagePosition(run_first),
+                                (run_end - run_first) * Page::SIZE)) {
+    // Storage can't give space back; stop trying.
+    state.hole_punch_pages = 0;
+  }
+}
+
+const char *File::mappedPageLocked(const PageId page_number) const {
+  OpenFile &state = *open_file_;
+  if (!state.old_mappings.empty()) {
+    releaseMappingsLocked();
+  }
+  const off_t position = pagePosition(page_number);
+  const off_t page_end = position + static_cast<off_t>(Page::SIZE);
+  if (page_end > static_cast<off_t>(state.mapped_size)) {
+    // Page is past the part of the mapping known to be in the file.  Bytes
+    // past the end of the file may not be touched, so check its size.
+    const off_t file_size = state.backend->size();
+    if (page_end > file_size) {
+      return NULL;
+    }
+    if (state.mapping == NULL ||
+        file_size > static_cast<off_t>(state.mapping->length)) {
+      // Map at least twice as much as before, so a growing file is only
+      // mapped again a logarithmic number of times.  The mapping follows
+      // the file as it grows into it.
+      std::size_t length =
+          state.mapping == NULL ? 0 : 2 * state.mapping->length;
+      length = std::max(length, static_cast<std::size_t>(file_size));
+      const std::size_t system_page = ::sysconf(_SC_PAGESIZE);
+      length = (length + system_page - 1) / system_page * system_page;
+      const char *address = state.backend->map(length);
+      if (state.mapping != NULL) {
+        state.old_mappings.push_back(std::move(state.mapping));
+      }
+      state.mapping = std::make_shared<const Mapping>(Mapping{address, length});
+    }
+    state.mapped_size = file_size;
+  }
+  return state.mapping->address + position;
+}
+
+void File::releaseMappingsLocked() const {
+  OpenFile &state = *open_file_;
+  auto it = state.old_mappings.begin();
+  while (it != state.old_mappings.end()) {
+    if (it->use_count() == 1) {
+      // Only this list holds the mapping, so no view can copy it any more.
+      // Order the views' last reads before the unmap.
+      std::atomic_thread_fence(std::memory_order_acquire);
+      state.backend->unmap((*it)->address, (*it)->length);
+      it = state.old_mappings.erase(it);
+    } else {
+      ++it;
+    }
+  }
+}
+
+void File::checkWritable() const {
+  if (open_file_->version == 1) {
+    throw FileReadOnlyException(filename_);
+  }
+}
+
+bool File::isUsedLocked(const PageId page_number) const {
+  const PageId index = page_number - 1;
+  return (open_file_->bitmap[index / 64] >> (index % 64)) & 1;
+}
+
+void File::setUsedLocked(const PageId page_number, const bool used) {
+  const PageId index = page_number - 1;
+  const std::uint64_t mask = std::uint64_t(1) << (index % 64);
+  if (used) {
+    open_file_->bitmap[index / 64] |= mask;
+  } else {
+    open_file_->bitmap[index / 64] &= ~mask;
+  }
+  open_file_->bitmap_dirty[index / PAGES_PER_BITMAP] = true;
+}
+
+PageId File::nextUsedLocked(const PageId page_number) const {
+  const PageId last_used_page = open_file_->header.last_used_page;
+  if (last_used_page == Page::INVALID_NUMBER ||
+      page_number >= last_used_page) {
+    return Page::INVALID_NUMBER;
+  }
+  // Bit index of the following page is page_number.  The scan stops at
+  // last_used_page at the latest.
+  const std::vector<std::uint64_t> &bitmap = open_file_->bitmap;
+  std::size_t word = page_number / 64;
+  std::uint64_t bits =
+      bitmap[word] & (~std::uint64_t(0) << (page_number % 64));
+  while (bits == 0) {
+    bits = bitmap[++word];
+  }
+  return word * 64 + __builtin_ctzll(bits) + 1;
+}
+
+PageId File::prevUsedLocked(const PageId page_number) const {
+  const PageId first_used_page = open_file_->header.first_used_page;
+  if (first_used_page == Page::INVALID_NUMBER ||
+      page_number <= first_used_page) {
+    return Page::INVALID_NUMBER;
+  }
+  // Bit index of the preceding page is page_number - 2.  The scan stops at
+  // first_used_page at the latest.
+  const std::vector<std::uint64_t> &bitmap = open_file_->bitmap;
+  const PageId index = page_number - 2;
+  std::size_t word = index / 64;
+  std::uint64_t bits = bitmap[word] & (~std::uint64_t(0) >> (63 - index % 64));
+  while (bits == 0) {
+    bits = bitmap[--word];
+  }
+  return word * 64 + (63 - __builtin_clzll(bits)) + 1;
+}
+
+PageId File::firstFreeLocked(const PageId page_number) const {
+  const std::vector<std::uint64_t> &bitmap = open_file_->bitmap;
+  const PageId index = page_number - 1;
+  std::size_t word = index / 64;
+  std::uint64_t bits = ~bitmap[word] & (~std::uint64_t(0) << (index % 64));
+  while (bits == 0) {
+    bits = ~bitmap[++word];
+  }
+  return word * 64 + __builtin_ctzll(bits) + 1;
 }
 
 PageHeader File::readPageHeader(PageId page_number) const {
   PageHeader header;
-  stream_->seekg(pagePosition(page_number), std::ios::beg);
-  stream_->read(reinterpret_cast<char *>(&header), sizeof(header));
+  readAt(&header, sizeof(header), pagePosition(page_number));
 
   return header;
 }
@@ -8,16 +8,27 @@
 
 #pragma once
 
-#include <fstream>
+#include <sys/types.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "page.h"
+#include "storage.h"
 
 namespace badgerdb {
 
 class FileIterator;
+class PageView;
 
 /**
  * @brief Header metadata for files on disk which contain pages.
@@ -40,9 +51,15 @@ struct FileHeader {
 
   /**
    * Page number of the first free (allocated but unused) page in the file.
+   * In version 2 files this is only a hint: no page before it is free.
    */
   PageId first_free_page;
 
+  /**
+   * Page number of the last used page in the file (version 2 files only).
+   */
+  PageId last_used_page;
+
   /**
    * Returns true if this file header is equal to the other.
    *
@@ -52,27 +69,89 @@ struct FileHeader {
   bool operator==(const FileHeader &rhs) const {
     return num_pages == rhs.num_pages && num_free_pages == rhs.num_free_pages &&
            first_used_page == rhs.first_used_page &&
-           first_free_page == rhs.first_free_page;
+           first_free_page == rhs.first_free_page &&
+           last_used_page == rhs.last_used_page;
   }
 };
 
+/**
+ * @brief How a File makes its writes durable.
+ */
+enum class Durability {
+  /**
+   * Writes are handed to the operating system and never synced; sync() and
+   * closing the file only write out the header and allocation bitmaps.
+   */
+  NONE,
+
+  /**
+   * Writes accumulate in the operating system's cache and are made durable
+   * together with one fdatasync, either on an explicit sync() or once a
+   * number of pages has been written or milliseconds has passed since the
+   * last sync.  A background thread syncs writes that have waited that long
+   * even if no further write arrives.
+   */
+  BATCHED,
+
+  /**
+   * Every write is made durable with fdatasync before it returns.
+   */
+  STRICT
+};
+
 /**
  * @brief Class which represents a file in the filesystem containing database
  *        pages.
  *
- * The File class wraps a stream to an underlying file on disk.  Files contain
+ * The File class wraps a StorageBackend for an underlying file, by default a
+ * file on disk reached through a shared cache of descriptors (see
+ * setStorage() and PosixStorage).  Files contain
  * fixed-sized pages, and they never deallocate space (though they do reuse
  * deleted pages if possible).  If multiple File objects refer to the same
- * underlying file, they will share the stream in memory.
+ * underlying file, they will share the backend.
  * If a file that has already been opened (possibly by another query), then the
- * File class detects this (by looking in the open_streams_ map) and just
- * returns a file object with the already created stream for the file without
- * actually opening the UNIX file again.
+ * File class detects this (by looking in the open_files_ map) and just
+ * returns a file object with the already open backend for the file without
+ * actually opening the underlying file again.
+ *
+ * All page I/O is positional (pread/pwrite), so there is no shared file
+ * position and several threads may read and write different pages of the same
+ * file at once.  Opening, copying and closing File objects is synchronized.
+ *
+ * Files are created in format version 2.  Block 0 holds the file header, and
+ * the pages follow in groups of PAGES_PER_BITMAP, each group preceded by a
+ * bitmap block with one bit per page recording whether it is used.  The used
+ * pages, in page number order, form the list that FileIterator walks; the
+ * next_page_number of a page is derived from the bitmaps when it is read.
+ * The header and bitmaps are kept in memory, so allocating and deleting a
+ * page costs a single page write.  Version 1 files, which chain used and free
+ * pages through next_page_number and keep the header in the first 16 bytes,
+ * open read-only until converted with upgrade().
  *
- * @warning This class is not threadsafe.
+ * @warning Allocating and deleting pages is not threadsafe.
  */
 class File {
  public:
+  /**
+   * Format version of files created by this class.
+   */
+  static const std::uint32_t FORMAT_VERSION = 2;
+
+  /**
+   * Number of pages whose allocation state is recorded in one bitmap block.
+   */
+  static const PageId PAGES_PER_BITMAP = Page::SIZE * 8;
+
+  /**
+   * Default size of the extents in which disk space is reserved.
+   */
+  static const std::size_t DEFAULT_EXTENT_BYTES = 1 << 20;
+
+  /**
+   * Largest size of the extents in which disk space is reserved.
+   */
+  static const std::size_t MAX_EXTENT_BYTES = 64 << 20;
+
   /**
    * Creates a new file.
    *
@@ -84,18 +163,30 @@ class File {
   /**
    * Opens the file named fileName and returns the corresponding File object.
    * It first checks if the file is already open. If so, then the new File
-   * object created uses the same input-output stream to read to or write fom
-   * that already open file. Reference count (open_counts_ static variable
-   * inside the File object) is incremented whenever an already open file is
-   * opened again. Otherwise the UNIX file is actually opened. The fileName and
-   * the stream associated with this File object are inserted into the
-   * open_streams_ map.
+   * object created uses the same descriptor to read from or write to that
+   * already open file. Reference count (open_counts_ static variable inside
+   * the File object) is incremented whenever an already open file is opened
+   * again. Otherwise the UNIX file is actually opened. The fileName and the
+   * descriptor associated with this File object are inserted into the
+   * open_files_ map.
    *
    * @param filename  Name of the file.
    * @throws  FileNotFoundException   If the requested file doesn't exist.
    */
   static File open(const std::string &filename);
 
+  /**
+   * Converts a version 1 file into the current format in place.  Page numbers
+   * and contents are preserved.  The conversion is written to a temporary
+   * file that then replaces the original, so an interrupted upgrade leaves
+   * the original untouched.  Does nothing if the file is already current.
+   *
+   * @param filename  Name of the file.
+   * @throws  FileNotFoundException   If the file doesn't exist.
+   * @throws  FileOpenException       If the file is currently open.
+   */
+  static void upgrade(const std::string &filename);
+
   /**
    * Deletes an existing file.
    *
@@ -119,6 +210,21 @@ class File {
    */
   static bool exists(const std::string &filename);
 
+  /**
+   * Sets where files are stored from now on.  Files already open keep the
+   * storage they were opened with.  Defaults to PosixStorage.
+   *
+   * @param storage   Provider of storage for files.
+   */
+  static void setStorage(std::shared_ptr<StorageProvider> storage);
+
+  /**
+   * Returns the provider of storage for files.
+   *
+   * @return  Provider of storage for files.
+   */
+  static std::shared_ptr<StorageProvider> storage();
+
   /**
    * Copy constructor.
    *
@@ -128,10 +234,11 @@ class File {
   File(const File &other);
 
   /**
-   * Assignment operator.
+   * Assignment operator.  The file this object held is closed first.
    *
    * @param rhs File object to assign.
    * @return    Newly assigned file object.
+   * @throws  FileIOException  If closing the file this object held fails.
    */
   File &operator=(const File &rhs);
 
@@ -151,14 +258,30 @@ class File {
 
   /**
    * Destructor that automatically closes the underlying file if no other
-   * File objects are using it.
+   * File objects are using it.  Errors writing out the file's metadata are
+   * ignored; call close() first to see them.
    */
   ~File();
 
   /**
-   * Allocates a new page in the file.
+   * Releases this object's reference to the file, after which the object is
+   * no longer valid.  The underlying file is only closed if no other File
+   * objects exist that access it.  Closing writes out the header and
+   * allocation bitmaps and, unless the durability mode is Durability::NONE,
+   * syncs the file.  Does nothing if the object holds no file.
+   *
+   * @throws  FileIOException  If the metadata can't be written out or the
+   *                           sync fails.  The object lets go of the file
+   *                           regardless.
+   */
+  void close();
+
+  /**
+   * Allocates a new page in the file.  The lowest free page is reused if
+   * there is one; otherwise the file grows by a page.
    *
    * @return The new page.
+   * @throws  FileReadOnlyException  If the file is in an old format.
    */
   Page allocatePage();
 
@@ -169,6 +292,8 @@ class File {
    * @return  The page.
    * @throws  InvalidPageException  If the page doesn't exist in the file or is
    *                                not currently used.
+   * @throws  CorruptPageException  If checksums are on and the page doesn't
+   *                                match its checksum.
    */
   Page readPage(const PageId page_number) const;
 
@@ -178,16 +303,233 @@ class File {
    *
    * @see allocatePage()
    * @param new_page  Page to write.
+   * @throws  InvalidPageException   If the page is not currently used.
+   * @throws  FileReadOnlyException  If the file is in an old format.
    */
   void writePage(const Page &new_page);
 
   /**
-   * Deletes a page from the file.
+   * Deletes a page from the file.  With hole punching on, the disk space of
+   * the page's run of free pages may be given back; see setHolePunching().
    *
    * @param page_number   Number of page to delete.
+   * @throws  InvalidPageException   If the page is not currently used.
+   * @throws  FileReadOnlyException  If the file is in an old format.
    */
   void deletePage(const PageId page_number);
 
+  /**
+   * Allocates a contiguous run of new pages at the end of the file.  Unlike
+   * repeated calls to allocatePage(), free pages are not reused, the pages
+   * are written with as few writes as possible and the file's metadata is
+   * updated once.  The file is extended in preallocated extents; see
+   * setPreallocation().
+   *
+   * @param num_pages   Number of pages to allocate.
+   * @return The new pages, in page number order.
+   * @throws  FileReadOnlyException  If the file is in an old format.
+   */
+  std::vector<Page> allocatePages(const PageId num_pages);
+
+  /**
+   * Sets the size of the extents in which the file's disk space is reserved
+   * (with fallocate) as pages are appended.  The setting is shared by all
+   * File objects open on the same file and lasts until it is closed.  Files
+   * start out with DEFAULT_EXTENT_BYTES.  Filesystems without fallocate
+   * support fall back to growing the file a write at a time.
+   *
+   * @param extent_bytes  Extent size in bytes, rounded up to whole pages and
+   *                      limited to MAX_EXTENT_BYTES; 0 disables
+   *                      preallocation.
+   */
+  void setPreallocation(const std::size_t extent_bytes);
+
+  /**
+   * Turns on giving back the disk space of deleted pages.  Each bitmap
+   * group is divided into aligned runs of <run_pages> pages; once every
+   * page of a run is free, the run's space is released with
+   * fallocate(FALLOC_FL_PUNCH_HOLE), so the file takes less space on disk
+   * without changing its size or page numbers.  Freed pages are reused by
+   * allocatePage() as before.  The setting is shared by all File objects
+   * open on the same file and lasts until it is closed.  Files start out
+   * with hole punching off, and storage that can't punch holes turns it off
+   * again.
+   *
+   * @param run_pages   Pages per run; 0 turns hole punching off.
+   */
+  void setHolePunching(const PageId run_pages);
+
+  /**
+   * Turns page checksums on or off for the file.  The setting is stored in
+   * the file.  With checksums on, every page is written with a CRC-32C of
+   * its contents, kept where the page header holds its next page number
+   * (which the allocation bitmap makes redundant on disk), and every used
+   * page read from the file is checked against it.  A BufMgr checks pages
+   * as it reads them in on a miss, not when they are found in the pool.
+   *
+   * Turning checksums on stamps every used page of the file, so it must
+   * not be written to by other threads meanwhile.  The file is synced.
+   *
+   * @param enable  Whether to use checksums.
+   * @throws  FileReadOnlyException  If the file is in an old format.
+   */
+  void setChecksums(const bool enable);
+
+  /**
+   * Returns whether pages are written with checksums and verified on read.
+   *
+   * @return  Whether checksums are in use.
+   */
+  bool checksums() const { return open_file_->checksums; }
+
+  /**
+   * Moves used pages from the end of the file into free pages nearer the
+   * front, until no free page comes before a used one, then shrinks the
+   * file to its last used page.  Moved pages get new page numbers, so the
+   * file must not have pages in a buffer pool, and references to moved
+   * pages must be updated by the caller.  The file is synced before and
+   * after it is shrunk.  BufMgr::recluster() does the same while the file
+   * stays in use.
+   *
+   * @return  New page number of each moved page, by old page number.
+   * @throws  FileReadOnlyException  If the file is in an old format.
+   */
+  std::map<PageId, PageId> compact();
+
+  /**
+   * Moves a used page into the lowest free page, if that comes before it.
+   * The page gets the free page's number and its old number becomes free.
+   * The page must not be in a buffer pool.
+   *
+   * @param page_number   Number of page to move.
+   * @return  New number of the page; page_number if it was not moved.
+   * @throws  InvalidPageException   If the page is not currently used.
+   * @throws  FileReadOnlyException  If the file is in an old format.
+   */
+  PageId movePage(const PageId page_number);
+
+  /**
+   * Shrinks the file to its last used page, dropping the free pages after
+   * it.  The file is synced before it is shrunk.
+   *
+   * @throws  FileReadOnlyException  If the file is in an old format.
+   */
+  void shrink();
+
+  /**
+   * Turns direct I/O (O_DIRECT) on or off for this file.  With direct I/O,
+   * page reads and writes bypass the kernel page cache, so pages cached by a
+   * BufMgr are not cached a second time by the kernel.  The setting is
+   * shared by all File objects open on the same file and lasts until it is
+   * closed.  Files start out buffered.
+   *
+   * Filesystems that reject O_DIRECT (e.g. tmpfs) keep the file buffered,
+   * as do version 1 files, whose pages are not block aligned.  A file also
+   * falls back to buffered I/O if the filesystem later rejects a direct
+   * transfer.
+   *
+   * @param enable  Whether to use direct I/O.
+   * @return  Whether direct I/O is now in use.
+   * @throws  FileIOException  If the descriptor flags can't be changed.
+   */
+  bool setDirectIO(const bool enable);
+
+  /**
+   * Returns whether direct I/O is in use for this file.
+   *
+   * @return  True if page transfers bypass the kernel page cache.
+   */
+  bool directIO() const;
+
+  /**
+   * Turns memory mapping on or off for this file.  While it is on, the file
+   * is mapped read-only into memory, readPageView() returns views of pages
+   * in the mapping and readPage() copies pages out of it instead of making a
+   * system call per page.  Writes still go through the descriptor, and are
+   * visible through the mapping as soon as they return.  The setting is
+   * shared by all File objects open on the same file.  The mapping grows
+   * geometrically with the file; a mapping it outgrows is kept until no
+   * view refers to it, and all of them go when the file is closed.
+   *
+   * Memory mapping can't be combined with direct I/O.
+   *
+   * @param enable  Whether to map the file.
+   * @return  Whether the file is now memory mapped.
+   */
+  bool setMemoryMapped(const bool enable);
+
+  /**
+   * Returns whether the file is memory mapped.
+   *
+   * @return  True if readPageView() may be used.
+   */
+  bool memoryMapped() const;
+
+  /**
+   * Returns a view of a page in the file's mapping, without copying it.  The
+   * view stays valid until the file is closed, and reflects later writes to
+   * the page.
+   *
+   * @param page_number   Number of page to view.
+   * @return  View of the page.
+   * @throws  InvalidPageException  If the page doesn't exist or is free.
+   * @throws  FileIOException       If the file is not memory mapped (EINVAL)
+   *                                or can't be mapped.
+   */
+  PageView readPageView(const PageId page_number) const;
+
+  /**
+   * Tells the operating system how a range of pages will be accessed, both
+   * for reads through the descriptor and through the mapping.
+   *
+   * @param advice      Expected access pattern.
+   * @param first_page  Number of the first page in the range.
+   * @param num_pages   Number of pages in the range; 0 for the rest of the
+   *                    file.
+   */
+  void advise(const Advice advice, const PageId first_page = 1,
+              const PageId num_pages = 0);
+
+  /**
+   * Returns the on-disk format version of this file.
+   *
+   * @return  Format version.
+   */
+  std::uint32_t formatVersion() const { return open_file_->version; }
+
+  /**
+   * Sets how writes to this file are made durable.  The setting is shared by
+   * all File objects open on the same file and lasts until it is closed.
+   * Files start out with Durability::NONE.
+   *
+   * @param mode          Durability mode.
+   * @param batch_pages   For Durability::BATCHED, sync after this many
+   *                      writes.
+   * @param batch_ms      For Durability::BATCHED, sync unsynced writes this
+   *                      many milliseconds after the last sync; 0 syncs on
+   *                      every write that follows a sync.
+   */
+  void setDurability(const Durability mode,
+                     const std::uint32_t batch_pages = 64,
+                     const std::uint32_t batch_ms = 100);
+
+  /**
+   * Returns the durability mode of this file.
+   *
+   * @return  Durability mode.
+   */
+  Durability durability() const;
+
+  /**
+   * Writes out the file header and allocation bitmaps if they have changed,
+   * then makes all writes to this file so far durable with a single
+   * fdatasync, unless the durability mode is Durability::NONE or nothing was
+   * written since the last sync.
+   *
+   * @throws  FileIOException  If the sync fails.
+   */
+  void sync();
+
   /**
    * Returns the name of the file this object represents.
    *
@@ -249,14 +591,202 @@ class File {
    * @param page_number   Number of page.
    * @return  Position of page in file.
    */
-  static std::streampos pagePosition(const PageId page_number) {
-    return sizeof(FileHeader) + ((page_number - 1) * Page::SIZE);
+  off_t pagePosition(const PageId page_number) const {
+    if (open_file_->version == 1) {
+      return VERSION1_HEADER_SIZE +
+             static_cast<off_t>(page_number - 1) * Page::SIZE;
+    }
+    // Skip the header block and one bitmap block per group up to this page.
+    const off_t index = page_number - 1;
+    return (2 + index + index / PAGES_PER_BITMAP) * Page::SIZE;
+  }
+
+  /**
+   * Returns the position of the bitmap block for the given group of pages.
+   *
+   * @param group   Group number; group g holds pages g * PAGES_PER_BITMAP + 1
+   *                to (g + 1) * PAGES_PER_BITMAP.
+   * @return  Position of bitmap block in file.
+   */
+  static off_t bitmapPosition(const PageId group) {
+    return (1 + static_cast<off_t>(group) * (PAGES_PER_BITMAP + 1)) *
+           Page::SIZE;
+  }
+
+  /**
+   * Size in bytes of the header at the start of a version 1 file.
+   */
+  static const off_t VERSION1_HEADER_SIZE = 4 * sizeof(PageId);
+
+  /**
+   * Makes sure disk space is reserved up to the given offset, reserving
+   * whole extents past the current reservation if not.  Caller must hold
+   * open_file_->mutex.
+   *
+   * @param end   Offset the file is about to be written up to.
+   * @throws  FileIOException  If space could not be reserved.
+   */
+  void reserveLocked(const off_t end);
+
+  /**
+   * Gives back the disk space of the hole punching run holding the given
+   * page, if every page of the run is free.  Caller must hold
+   * open_file_->mutex.
+   *
+   * @param page_number   Page that has just been freed.
+   * @throws  FileIOException  If the space could not be given back.
+   */
+  void punchFreeRunLocked(const PageId page_number);
+
+  /**
+   * Moves a used page into the lowest free page if that comes before it.
+   * Caller must hold open_file_->mutex.
+   *
+   * @param page_number   Number of a used page.
+   * @return  New number of the page; page_number if it was not moved.
+   */
+  PageId movePageLocked(const PageId page_number);
+
+  /**
+   * Drops the free pages after the last used page and truncates the file.
+   * Caller must hold open_file_->mutex.
+   */
+  void shrinkLocked();
+
+  /**
+   * Checks pages read from the file against their checksums.
+   *
+   * @param first_page  Number of the first page.
+   * @param pages       Pages read, in page number order.
+   * @param used        Whether each page is used; free pages aren't checked.
+   * @throws  CorruptPageException  If a used page doesn't match.
+   */
+  void verifyPages(const PageId first_page, const Page *pages,
+                   const std::vector<bool> &used) const;
+
+  /**
+   * Appends num_pages new pages to the file, updating the header and bitmaps
+   * and writing the pages out.  Caller must hold open_file_->mutex.
+   *
+   * @param num_pages   Number of pages to append.
+   * @return The new pages.
+   */
+  std::vector<Page> appendPagesLocked(const PageId num_pages);
+
+  /**
+   * Returns the address of the given page's image in the mapping, mapping
+   * the file again if it has grown past the current mapping.  The page is
+   * always in open_file_->mapping afterwards.  Caller must hold
+   * open_file_->mutex.
+   *
+   * @param page_number   Number of page.
+   * @return  Page image, or NULL if the page is past the end of the file.
+   * @throws  FileIOException  If the file can't be mapped.
+   */
+  const char *mappedPageLocked(const PageId page_number) const;
+
+  /**
+   * Unmaps earlier mappings that no PageView refers to any more.  Caller
+   * must hold open_file_->mutex.
+   */
+  void releaseMappingsLocked() const;
+
+  /**
+   * Throws if the file may not be modified.
+   *
+   * @throws  FileReadOnlyException  If the file is in an old format.
+   */
+  void checkWritable() const;
+
+  /**
+   * Loads the header (and for version 2, the bitmaps) of a newly opened file
+   * into <open_file_>.
+   */
+  void loadMetadata();
+
+  /**
+   * Returns whether the given page is used according to the bitmap.
+   * Version 2 only; caller must hold open_file_->mutex.
+   */
+  bool isUsedLocked(const PageId page_number) const;
+
+  /**
+   * Marks the given page used or free in the bitmap.  Version 2 only;
+   * caller must hold open_file_->mutex.
+   */
+  void setUsedLocked(const PageId page_number, const bool used);
+
+  /**
+   * Returns the first used page after the given one, or
+   * Page::INVALID_NUMBER.  Version 2 only; caller must hold
+   * open_file_->mutex.
+   */
+  PageId nextUsedLocked(const PageId page_number) const;
+
+  /**
+   * Returns the last used page before the given one, or Page::INVALID_NUMBER.
+   * Version 2 only; caller must hold open_file_->mutex.
+   */
+  PageId prevUsedLocked(const PageId page_number) const;
+
+  /**
+   * Returns the first free page at or after the given one.  There must be
+   * one.  Version 2 only; caller must hold open_file_->mutex.
+   */
+  PageId firstFreeLocked(const PageId page_number) const;
+
+  /**
+   * Returns the number of the used page following the given one in the used
+   * list, or Page::INVALID_NUMBER if it is the last.
+   *
+   * @param page_number   Number of a used page.
+   * @return  Number of the next used page.
+   */
+  PageId nextUsedPage(const PageId page_number) const;
+
+  /**
+   * Returns the number of pages from first_page up to and including the last
+   * used page that is stored contiguously with it, at most max_pages.  The
+   * pages in between may include free ones.  Version 1 files, whose used
+   * list is not in page number order, always return 1.  Returns 0 if
+   * first_page has been freed since it was found and no used page follows
+   * it within the span.
+   *
+   * @param first_page  Number of a used page.
+   * @param max_pages   Largest span to return.
+   * @return  Number of pages in the span.
+   */
+  PageId usedSpan(const PageId first_page, const PageId max_pages) const;
+
+  /**
+   * Reads pages.size() consecutive pages starting at first_page straight into
+   * the given pages with a single read.  Pages past the end of the file read
+   * as free pages.  Next page numbers are left as stored on disk.
+   *
+   * @param first_page  Number of the first page.
+   * @param pages       Pages to read into; at most MAX_CHUNK_PAGES.
+   */
+  void readChunk(const PageId first_page, std::vector<Page> &pages) const;
+
+  /**
+   * Largest number of pages readChunk() reads at once.
+   */
+  static const PageId MAX_CHUNK_PAGES = 512;
+
+  /**
+   * Sets the next page number of a page.
+   *
+   * @param page              Page to change.
+   * @param next_page_number  Number of the next used page.
+   */
+  static void setNextPageNumber(Page &page, const PageId next_page_number) {
+    page.set_next_page_number(next_page_number);
   }
 
   /**
    * Opens the underlying file named in filename_.
    * This method only opens the file if no other File objects exist that access
-   * the same filesystem file; otherwise, it reuses the existing stream.
+   * the same filesystem file; otherwise, it reuses the existing descriptor.
    *
    * @param create_new  Whether to create a new file.
    * @throws  FileExistsException     If the underlying file exists and
@@ -266,19 +796,12 @@ class File {
    */
   void openIfNeeded(const bool create_new);
 
-  /**
-   * Closes the underlying file stream in <stream_>.
-   * This method only closes the file if no other File objects exist that access
-   * the same file.
-   */
-  void close();
-
   /**
    * Reads a page from the file.  If <allow_free> is not set, an exception
    * will be thrown if the page read from disk is not currently in use.
    *
-   * No bounds checking is performed; the underlying file stream will throw
-   * an exception if the page is past the end of the file.
+   * No bounds checking is performed; a page past the end of the file reads
+   * as a free page.
    *
    * @param page_number   Number of page to read.
    * @param allow_free    Whether to allow reading a free (unused) page.
@@ -288,6 +811,40 @@ class File {
    */
   Page readPage(const PageId page_number, const bool allow_free) const;
 
+  /**
+   * Reads an existing page from the file straight into <page>, such as a
+   * buffer frame, as readPage() does.  With direct I/O the transfer bypasses
+   * staging if <page> is aligned to StorageBackend::DIRECT_IO_ALIGNMENT.
+   * <page> is left undefined if an exception is thrown.
+   *
+   * @param page_number   Number of page to read.
+   * @param page          Page to read into.
+   * @throws  InvalidPageException  If the page doesn't exist in the file or is
+   *                                not currently used.
+   * @throws  CorruptPageException  If checksums are on and the page doesn't
+   *                                match its checksum.
+   */
+  void readPage(const PageId page_number, Page &page) const;
+
+  /**
+   * Reads a page from the file into <page>; see readPage(page_number,
+   * allow_free).
+   */
+  void readPageInto(const PageId page_number, Page &page,
+                    const bool allow_free) const;
+
+  /**
+   * Reads a run of consecutive pages with a single sequential read.  Pages
+   * past the end of the file are not returned, and free (unused) pages are
+   * returned as they are on disk, so callers must check isUsed() on each.
+   *
+   * @param first_page  Number of the first page to read.
+   * @param num_pages   Number of pages to read.
+   * @return  The pages read, in page number order.
+   */
+  std::vector<Page> readPages(const PageId first_page,
+                              const PageId num_pages) const;
+
   /**
    * Writes a page into the file at the given page number.  This does not
    * update ensure that the number in the header equals the position on disk.
@@ -311,19 +868,29 @@ class File {
                  const Page &new_page);
 
   /**
-   * Reads the header for this file from disk.
+   * Returns the header for this file from the in-memory copy shared by all
+   * File objects open on it.
    *
    * @return  The file header.
    */
   FileHeader readHeader() const;
 
   /**
-   * Writes the given header to the disk as the header for this file.
+   * Replaces the in-memory header for this file.  The header reaches the
+   * disk on the next sync, when the durability mode syncs, or when the file
+   * is closed.
    *
    * @param header  File header to write.
    */
   void writeHeader(const FileHeader &header);
 
+  /**
+   * Writes the in-memory header and bitmap blocks to disk if they have
+   * changed since they were last written.  Caller must hold
+   * open_file_->mutex.
+   */
+  void flushMetadataLocked();
+
   /**
    * Reads only the header of the given page from disk (not the record data
    * or slot table).  No bounds checking is performed.
@@ -333,28 +900,245 @@ class File {
    */
   PageHeader readPageHeader(const PageId page_number) const;
 
-  typedef std::map<std::string, std::shared_ptr<std::fstream>> StreamMap;
+  /**
+   * Reads <length> bytes at <offset> into <buffer>.  Bytes past the end of
+   * the file read as zeros.
+   *
+   * @throws  FileIOException  If the read fails.
+   */
+  void readAt(void *buffer, const std::size_t length, const off_t offset) const;
+
+  /**
+   * Writes <length> bytes from <buffer> at <offset>.
+   *
+   * @throws  FileIOException  If the write fails.
+   */
+  void writeAt(const void *buffer, const std::size_t length,
+               const off_t offset);
+
+  /**
+   * Accounts for <num_writes> completed writes under the durability mode,
+   * syncing if the mode calls for it.
+   *
+   * @param num_writes  Number of pages (or headers) written.
+   */
+  void wrote(const std::uint32_t num_writes);
+
+  /**
+   * Writes out the header if needed, issues fdatasync and resets the batch.
+   * Caller must hold open_file_->mutex.
+   *
+   * @throws  FileIOException  If the sync fails.
+   */
+  void syncLocked();
+
+  /**
+   * Starts the thread that syncs batched writes once batch_ms has passed
+   * since the last sync.  Caller must hold open_file_->syncer_mutex.
+   */
+  void startSyncer();
+
+  /**
+   * Stops the syncer thread, if it is running, and waits for it to finish.
+   * Caller must hold open_file_->syncer_mutex but not open_file_->mutex.
+   */
+  void stopSyncer();
+
+  /**
+   * Body of the syncer thread: waits for unsynced writes and syncs them when
+   * their time is up, until told to stop.
+   */
+  void runSyncer();
+
+  /**
+   * @brief A read-only mapping of the file.
+   *
+   * Views of mapped pages share ownership of their mapping, so it is only
+   * unmapped once none of them is left (or the file is closed).
+   */
+  struct Mapping {
+    const char *address;
+    std::size_t length;
+  };
+
+  /**
+   * @brief State shared by all File objects open on the same path.
+   */
+  struct OpenFile {
+    explicit OpenFile(std::unique_ptr<StorageBackend> backend)
+        : backend(std::move(backend)),
+          version(FORMAT_VERSION),
+          durability(Durability::NONE),
+          batch_pages(0),
+          batch_ms(0),
+          unsynced_writes(0),
+          last_sync(std::chrono::steady_clock::now()),
+          stop_syncer(false),
+          header_dirty(false),
+          extent_bytes(DEFAULT_EXTENT_BYTES),
+          reserved_end(0),
+          hole_punch_pages(0),
+          checksums(false),
+          memory_mapped(false),
+          mapped_size(0) {}
+
+    /**
+     * Removes the mappings; the backend closes the file.
+     */
+    ~OpenFile();
+
+    /**
+     * Backend of the underlying file.
+     */
+    const std::unique_ptr<StorageBackend> backend;
+
+    /**
+     * On-disk format version; fixed once the file is open.
+     */
+    std::uint32_t version;
+
+    /**
+     * Guards the durability state, the cached header, the bitmaps and the
+     * mappings below.
+     */
+    std::mutex mutex;
+
+    /**
+     * Durability mode of the file.
+     */
+    Durability durability;
+
+    /**
+     * Durability::BATCHED: writes allowed between syncs.
+     */
+    std::uint32_t batch_pages;
+
+    /**
+     * Durability::BATCHED: milliseconds allowed between syncs.
+     */
+    std::uint32_t batch_ms;
+
+    /**
+     * Number of writes since the last sync.
+     */
+    std::uint32_t unsynced_writes;
+
+    /**
+     * Time of the last sync.
+     */
+    std::chrono::steady_clock::time_point last_sync;
+
+    /**
+     * Durability::BATCHED: thread that syncs writes left waiting when no
+     * further write arrives.  Started and stopped under syncer_mutex.
+     */
+    std::mutex syncer_mutex;
+    std::thread syncer;
+
+    /**
+     * Wakes the syncer thread when a batch starts or it should stop.  Used
+     * with <mutex>, which also guards stop_syncer.
+     */
+    std::condition_variable syncer_wakeup;
+    bool stop_syncer;
+
+    /**
+     * In-memory copy of the file header.
+     */
+    FileHeader header;
+
+    /**
+     * Whether <header> has changed since it was last written to disk.
+     */
+    bool header_dirty;
+
+    /**
+     * In-memory copy of the bitmap blocks; bit (p - 1) is set if page p is
+     * used.  Holds Page::SIZE bytes per group of pages.
+     */
+    std::vector<std::uint64_t> bitmap;
+
+    /**
+     * Whether each bitmap block has changed since it was last written.
+     */
+    std::vector<bool> bitmap_dirty;
+
+    /**
+     * Size of the extents in which disk space is reserved; 0 if disabled.
+     */
+    std::size_t extent_bytes;
+
+    /**
+     * Offset up to which disk space has been reserved.
+     */
+    off_t reserved_end;
+
+    /**
+     * Pages per run released by hole punching; 0 if disabled.
+     */
+    PageId hole_punch_pages;
+
+    /**
+     * Whether pages are written with checksums and verified when read.
+     */
+    std::atomic<bool> checksums;
+
+    /**
+     * Whether reads go through the mapping.
+     */
+    std::atomic<bool> memory_mapped;
+
+    /**
+     * Current mapping of the file.  It is grown geometrically, so it may
+     * reach past the end of the file.
+     */
+    std::shared_ptr<const Mapping> mapping;
+
+    /**
+     * Bytes at the start of the mapping known to be backed by the file;
+     * pages past this may not be touched until the file size is checked.
+     */
+    std::size_t mapped_size;
+
+    /**
+     * Earlier, smaller mappings, kept while views still refer to them.
+     */
+    std::vector<std::shared_ptr<const Mapping>> old_mappings;
+  };
+
+  typedef std::map<std::string, std::shared_ptr<OpenFile>> OpenFileMap;
   typedef std::map<std::string, int> CountMap;
 
   /**
-   * Streams for opened files.
+   * Descriptors for opened files.
    */
-  static StreamMap open_streams_;
+  static OpenFileMap open_files_;
 
   /**
    * Counts for opened files.
    */
   static CountMap open_counts_;
 
+  /**
+   * Guards open_files_ and open_counts_.
+   */
+  static std::mutex open_files_mutex_;
+
+  /**
+   * Provider of storage for newly opened files.  Guarded by
+   * open_files_mutex_.
+   */
+  static std::shared_ptr<StorageProvider> storage_;
+
   /**
    * Name of the file this object represents.
    */
   std::string filename_;
 
   /**
-   * Stream for underlying filesystem object.
+   * Descriptor for underlying filesystem object.
    */
-  std::shared_ptr<std::fstream> stream_;
+  std::shared_ptr<OpenFile> open_file_;
 
   /**
    * Whether this file is valid.
@@ -362,6 +1146,8 @@ class File {
   bool valid_;
 
   friend class FileIterator;
+  friend class BufferFileIterator;
+  friend class SequentialFileIterator;
   friend class FileTest;
 };
 
@@ -12,6 +12,7 @@
 
 #include "file.h"
 #include "page.h"
+#include "page_view.h"
 #include "types.h"
 
 namespace badgerdb {
@@ -56,8 +57,7 @@ class FileIterator {
    */
   inline FileIterator &operator++() {
     assert(file_ != NULL);
-    const PageHeader &header = file_->readPageHeader(current_page_number_);
-    current_page_number_ = header.next_page_number;
+    current_page_number_ = file_->nextUsedPage(current_page_number_);
 
     return *this;
   }
@@ -67,8 +67,7 @@ class FileIterator {
     FileIterator tmp = *this;  // copy ourselves
 
     assert(file_ != NULL);
-    const PageHeader &header = file_->readPageHeader(current_page_number_);
-    current_page_number_ = header.next_page_number;
+    current_page_number_ = file_->nextUsedPage(current_page_number_);
 
     return tmp;
   }
@@ -99,6 +98,17 @@ class FileIterator {
     return file_->readPage(current_page_number_);
   }
 
+  /**
+   * Returns a view of the current page in the file's mapping, without
+   * copying it.  The file must be memory mapped.
+   *
+   * @see File::setMemoryMapped()
+   * @return  View of page in file.
+   */
+  inline PageView view() const {
+    return file_->readPageView(current_page_number_);
+  }
+
  private:
   /**
    * File we're iterating over.
@@ -1,20 +1,34 @@
 #include <stdlib.h>
 
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 //#include <stdio.h>
+#include <chrono>
 #include <cstring>
+#include <fstream>
 #include <memory>
 #include <optional>
+#include <thread>
 
 #include "buffer.h"
+#include "buffer_file_iterator.h"
+#include "compressed_storage.h"
 #include "exceptions/buffer_exceeded_exception.h"
+#include "exceptions/corrupt_page_exception.h"
+#include "exceptions/file_io_exception.h"
 #include "exceptions/file_not_found_exception.h"
+#include "exceptions/file_read_only_exception.h"
+#include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_page_exception.h"
 #include "exceptions/page_not_pinned_exception.h"
 #include "exceptions/page_pinned_exception.h"
 #include "file_iterator.h"
 #include "page.h"
 #include "page_iterator.h"
+#include "page_view.h"
+#include "sequential_file_iterator.h"
+#include "tablespace.h"
 
 #define PRINT_ERROR(str)                            \
   {                                                 \
@@ -40,9 +54,83 @@ void test3(File &file4);
 void test4(File &file4);
 void test5(File &file4);
 void test6(File &file1);
+void test7(File &file1);
+void test8(File &file2);
+void test9();
+void test10();
+void test11();
+void test12();
+void test13();
+void test14();
+void test15();
+void test16();
+void test17();
+void test18();
+void test19();
+void test20();
+void test21();
+void test22();
+void test23();
+void test24();
+void test25();
+void test26();
+void test27();
+void test28();
+void test29();
+void test30();
+void test31();
+void test32();
+void test33();
+void test34();
 // Calls the above tests
 void testBufMgr();
 
+// Keeps files in memory and counts how often they are synced.
+class SyncCountingStorage : public StorageProvider {
+ public:
+  class Backend : public StorageBackend {
+   public:
+    Backend(std::unique_ptr<StorageBackend> inner,
+            std::shared_ptr<std::atomic<int>> syncs)
+        : inner_(std::move(inner)), syncs_(syncs) {}
+    std::size_t read(void *buffer, const std::size_t length,
+                     const off_t offset) override {
+      return inner_->read(buffer, length, offset);
+    }
+    void write(const void *buffer, const std::size_t length,
+               const off_t offset) override {
+      inner_->write(buffer, length, offset);
+    }
+    void sync() override {
+      ++*syncs_;
+      inner_->sync();
+    }
+    off_t size() override { return inner_->size(); }
+
+   private:
+    std::unique_ptr<StorageBackend> inner_;
+    std::shared_ptr<std::atomic<int>> syncs_;
+  };
+
+  bool exists(const std::string &name) override {
+    return inner_.exists(name);
+  }
+  std::unique_ptr<StorageBackend> open(const std::string &name,
+                                       const bool create_new) override {
+    return std::make_unique<Backend>(inner_.open(name, create_new), syncs_);
+  }
+  void remove(const std::string &name) override { inner_.remove(name); }
+  void rename(const std::string &from, const std::string &to) override {
+    inner_.rename(from, to);
+  }
+  int syncs() const { return *syncs_; }
+
+ private:
+  MemoryStorage inner_;
+  std::shared_ptr<std::atomic<int>> syncs_ =
+      std::make_shared<std::atomic<int>>(0);
+};
+
 int main() {
   // Following code shows how to you File and Page classes
 
@@ -140,6 +228,34 @@ void testBufMgr() {
     test4(file4);
     test5(file5);
     test6(file1);
+    test7(file1);
+    test8(file2);
+    test9();
+    test10();
+    test11();
+    test12();
+    test13();
+    test14();
+    test15();
+    test16();
+    test17();
+    test18();
+    test19();
+    test20();
+    test21();
+    test22();
+    test23();
+    test24();
+    test25();
+    test26();
+    test27();
+    test28();
+    test29();
+    test30();
+    test31();
+    test32();
+    test33();
+    test34();
 
     // Close the files by going out of scope
   }
@@ -296,4 +412,1775 @@ void test6(File &file1) {
   for (i = 1; i <= num; i++) bufMgr->unPinPage(file1, i, true);
 
   bufMgr->flushFile(file1);
-}
\ No newline at end of file
+}
+void test7(File &file1) {
+  // Dump the resident set and warm a fresh buffer manager from it
+  const std::string dumpname = "test.dump";
+  // Touch the pages last to first, so recency runs against page order.
+  for (i = num / 10; i >= 1; i--) {
+    bufMgr->readPage(file1, i, page);
+    bufMgr->unPinPage(file1, i, false);
+  }
+  bufMgr->dumpResidentSet(dumpname);
+
+  // Pages of a dump from least to most recently used, or nothing if two
+  // share an access time
+  const auto byRecency = [](const std::string &path) {
+    std::vector<std::pair<std::uint64_t, PageId>> lines;
+    std::ifstream in(path);
+    std::uint64_t recency;
+    PageId pageNo;
+    std::string filename;
+    while (in >> recency >> pageNo && std::getline(in >> std::ws, filename)) {
+      lines.emplace_back(recency, pageNo);
+    }
+    std::sort(lines.begin(), lines.end());
+    std::vector<PageId> pages;
+    for (std::size_t j = 0; j < lines.size(); j++) {
+      if (j > 0 && lines[j].first == lines[j - 1].first) return pages;
+    }
+    for (const auto &line : lines) pages.push_back(line.second);
+    return pages;
+  };
+
+  BufMgr warmMgr(num);
+  warmMgr.warmFrom(dumpname, 2);
+  warmMgr.waitForWarming();
+  if (warmMgr.getBufStats().diskreads != (int)(num / 10)) {
+    PRINT_ERROR("ERROR :: WARMED PAGES DID NOT MATCH DUMPED RESIDENT SET");
+  }
+  const std::vector<PageId> dumped = byRecency(dumpname);
+  warmMgr.dumpResidentSet(dumpname);
+  if (dumped.size() != num / 10 || byRecency(dumpname) != dumped) {
+    PRINT_ERROR("ERROR :: WARMED PAGES LOST THEIR RECENCY");
+  }
+
+  for (i = 1; i <= num / 10; i++) {
+    warmMgr.readPage(file1, i, page);
+    sprintf(tmpbuf, "test.1 Page %u %7.1f", i, (float)i);
+    if (strncmp(page->getRecord(rid[i - 1]).c_str(), tmpbuf, strlen(tmpbuf)) !=
+        0) {
+      PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+    }
+    warmMgr.unPinPage(file1, i, false);
+  }
+  std::remove(dumpname.c_str());
+  bufMgr->flushFile(file1);
+
+  std::cout << "Test 7 passed"
+            << "\n";
+}
+
+void test8(File &file2) {
+  // Allocate a run of pages in one call; asking for more pages than there
+  // are frames must fail without growing the file
+  std::vector<PageId> pageNos;
+  std::vector<Page *> pages;
+  PageId lastPage = Page::INVALID_NUMBER;
+  for (FileIterator iter = file2.begin(); iter != file2.end(); ++iter) {
+    lastPage = (*iter).page_number();
+  }
+  try {
+    bufMgr->allocPages(file2, num + 1, pageNos, pages);
+    PRINT_ERROR(
+        "ERROR :: No more frames left for allocation. Exception should "
+        "have been thrown before execution reaches this point.");
+  } catch (const BufferExceededException &e) {
+  }
+
+  bufMgr->allocPages(file2, num / 2, pageNos, pages);
+  for (i = 0; i < num / 2; i++) {
+    if (pageNos[i] != lastPage + 1 + i) {
+      PRINT_ERROR("ERROR :: PAGES NOT CONTIGUOUS");
+    }
+    sprintf(tmpbuf, "test.2 Page %u %7.1f", pageNos[i], (float)pageNos[i]);
+    rid[i] = pages[i]->insertRecord(tmpbuf);
+    bufMgr->unPinPage(file2, pageNos[i], true);
+  }
+  bufMgr->flushFile(file2);
+
+  for (i = 0; i < num / 2; i++) {
+    Page onDisk = file2.readPage(pageNos[i]);
+    sprintf(tmpbuf, "test.2 Page %u %7.1f", pageNos[i], (float)pageNos[i]);
+    if (strncmp(onDisk.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) !=
+        0) {
+      PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+    }
+  }
+
+  std::cout << "Test 8 passed"
+            << "\n";
+}
+
+void test9() {
+  // Files in memory storage go through the buffer manager like any other, but
+  // never reach the filesystem
+  const std::string filename = "test.memory";
+  std::shared_ptr<StorageProvider> posix = File::storage();
+  File::setStorage(std::make_shared<MemoryStorage>());
+  {
+    File memFile = File::create(filename);
+    for (i = 0; i < num / 2; i++) {
+      bufMgr->allocPage(memFile, pid[i], page);
+      sprintf(tmpbuf, "test.memory Page %u %7.1f", pid[i], (float)pid[i]);
+      rid[i] = page->insertRecord(tmpbuf);
+      bufMgr->unPinPage(memFile, pid[i], true);
+    }
+    bufMgr->flushFile(memFile);
+
+    for (i = 0; i < num / 2; i++) {
+      Page onDisk = memFile.readPage(pid[i]);
+      sprintf(tmpbuf, "test.memory Page %u %7.1f", pid[i], (float)pid[i]);
+      if (strncmp(onDisk.getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) !=
+          0) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+    }
+  }
+  if (!File::exists(filename) || posix->exists(filename)) {
+    PRINT_ERROR("ERROR :: FILE NOT KEPT IN MEMORY");
+  }
+  File::remove(filename);
+  File::setStorage(posix);
+
+  std::cout << "Test 9 passed"
+            << "\n";
+}
+
+void test10() {
+  // Scans through the buffer pool see changes that are still only in the
+  // pool, and a ring scan leaves the rest of the pool alone
+  const std::string scanName = "test.scan";
+  const std::string hotName = "test.hot";
+  {
+    BufMgr scanMgr(num);
+    File scanFile = File::create(scanName);
+    File hotFile = File::create(hotName);
+    std::vector<Page> pages = scanFile.allocatePages(3 * num);
+    for (Page &newPage : pages) {
+      newPage.insertRecord("test.scan Page " +
+                           std::to_string(newPage.page_number()));
+      scanFile.writePage(newPage);
+    }
+    scanMgr.readPage(scanFile, pages[0].page_number(), page);
+    rid2 = page->insertRecord("changed in the pool");
+    scanMgr.unPinPage(scanFile, pages[0].page_number(), true);
+
+    PageId scanned = 0;
+    for (BufferFileIterator iter(scanMgr, scanFile); !iter.done(); ++iter) {
+      sprintf(tmpbuf, "test.scan Page %u", iter->page_number());
+      if (iter->getRecord({iter->page_number(), 1}) != tmpbuf) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+      scanned++;
+    }
+    if (scanned != 3 * num) {
+      PRINT_ERROR("ERROR :: SCAN DID NOT VISIT EVERY PAGE");
+    }
+    {
+      BufferFileIterator iter(scanMgr, scanFile);
+      if (iter->getRecord(rid2) != "changed in the pool") {
+        PRINT_ERROR("ERROR :: SCAN DID NOT SEE CACHED PAGE");
+      }
+    }
+    scanMgr.flushFile(scanFile);
+
+    for (i = 0; i < num / 2; i++) {
+      scanMgr.allocPage(hotFile, pid[i], page);
+      scanMgr.unPinPage(hotFile, pid[i], true);
+    }
+    scanned = 0;
+    for (BufferFileIterator iter(scanMgr, scanFile, ScanStrategy::RING);
+         !iter.done(); ++iter) {
+      scanned++;
+    }
+    if (scanned != 3 * num) {
+      PRINT_ERROR("ERROR :: SCAN DID NOT VISIT EVERY PAGE");
+    }
+    scanMgr.clearBufStats();
+    for (i = 0; i < num / 2; i++) {
+      scanMgr.readPage(hotFile, pid[i], page);
+      scanMgr.unPinPage(hotFile, pid[i], false);
+    }
+    if (scanMgr.getBufStats().diskreads != 0) {
+      PRINT_ERROR("ERROR :: RING SCAN EVICTED RESIDENT PAGES");
+    }
+    scanMgr.flushFile(hotFile);
+  }
+  File::remove(scanName);
+  File::remove(hotName);
+
+  std::cout << "Test 10 passed"
+            << "\n";
+}
+
+void test11() {
+  // Many more files than cached descriptors can be open at once; files are
+  // reopened behind the scenes as they are used
+  const int numFiles = 20;
+  const std::size_t maxOpen = 4;
+  std::shared_ptr<StorageProvider> posix = File::storage();
+  std::shared_ptr<PosixStorage> cached =
+      std::make_shared<PosixStorage>(maxOpen);
+  File::setStorage(cached);
+  {
+    std::vector<File> files;
+    for (int f = 0; f < numFiles; f++) {
+      files.push_back(File::create("test.fd." + std::to_string(f)));
+      for (i = 0; i < 3; i++) {
+        Page newPage = files.back().allocatePage();
+        newPage.insertRecord(files.back().filename() + " Page " +
+                             std::to_string(newPage.page_number()));
+        files.back().writePage(newPage);
+      }
+      if (cached->openDescriptors() > maxOpen) {
+        PRINT_ERROR("ERROR :: TOO MANY DESCRIPTORS OPEN");
+      }
+    }
+    for (File &file : files) {
+      for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+        const Page onDisk = *iter;
+        if (onDisk.getRecord({onDisk.page_number(), 1}) !=
+            file.filename() + " Page " +
+                std::to_string(onDisk.page_number())) {
+          PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+        }
+      }
+    }
+    if (cached->openDescriptors() > maxOpen) {
+      PRINT_ERROR("ERROR :: TOO MANY DESCRIPTORS OPEN");
+    }
+  }
+  if (cached->openDescriptors() != 0) {
+    PRINT_ERROR("ERROR :: DESCRIPTORS LEFT OPEN");
+  }
+  for (int f = 0; f < numFiles; f++) {
+    File::remove("test.fd." + std::to_string(f));
+  }
+  File::setStorage(posix);
+
+  std::cout << "Test 11 passed"
+            << "\n";
+}
+
+void test12() {
+  // Files in a tablespace share one container, and go through the buffer
+  // manager like any other
+  const std::string container = "test.tbs";
+  const int numFiles = 10;
+  std::shared_ptr<StorageProvider> posix = File::storage();
+  try {
+    posix->remove(container);
+  } catch (const BadgerDbException &e) {
+  }
+  File::setStorage(std::make_shared<TablespaceStorage>(posix, container));
+  {
+    std::vector<File> files;
+    for (int f = 0; f < numFiles; f++) {
+      files.push_back(File::create("test.tbs." + std::to_string(f)));
+    }
+    // Interleave the files' growth so their extents interleave too.
+    for (i = 0; i < 20; i++) {
+      for (File &file : files) {
+        PageId newPageNo = Page::INVALID_NUMBER;
+        bufMgr->allocPage(file, newPageNo, page);
+        page->insertRecord(file.filename() + " Page " +
+                           std::to_string(newPageNo));
+        bufMgr->unPinPage(file, newPageNo, true);
+      }
+    }
+    for (File &file : files) {
+      bufMgr->flushFile(file);
+    }
+  }
+  File::remove("test.tbs.0");
+  File::setStorage(posix);
+
+  // Reopen the container from disk.
+  File::setStorage(std::make_shared<TablespaceStorage>(posix, container));
+  if (File::exists("test.tbs.0") || !posix->exists(container) ||
+      posix->exists("test.tbs.1")) {
+    PRINT_ERROR("ERROR :: FILES NOT KEPT IN TABLESPACE");
+  }
+  for (int f = 1; f < numFiles; f++) {
+    File file = File::open("test.tbs." + std::to_string(f));
+    PageId scanned = 0;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      const Page onDisk = *iter;
+      if (onDisk.getRecord({onDisk.page_number(), 1}) !=
+          file.filename() + " Page " + std::to_string(onDisk.page_number())) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+      scanned++;
+    }
+    if (scanned != 20) {
+      PRINT_ERROR("ERROR :: PAGES LOST IN TABLESPACE");
+    }
+  }
+  for (int f = 1; f < numFiles; f++) {
+    File::remove("test.tbs." + std::to_string(f));
+  }
+  File::setStorage(posix);
+  posix->remove(container);
+
+  std::cout << "Test 12 passed"
+            << "\n";
+}
+
+void test13() {
+  // Disposing of pages with hole punching on leaves the rest of the file
+  // readable, and compacting moves the remaining pages to the front
+  const std::string filename = "test.compact";
+  {
+    File file = File::create(filename);
+    file.setHolePunching(8);
+    for (i = 0; i < num; i++) {
+      bufMgr->allocPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.compact Page %u %7.1f", pid[i], (float)pid[i]);
+      rid[i] = page->insertRecord(tmpbuf);
+      bufMgr->unPinPage(file, pid[i], true);
+    }
+    // Keep every tenth page.
+    for (i = 0; i < num; i++) {
+      if (i % 10 != 0) bufMgr->disposePage(file, pid[i]);
+    }
+    bufMgr->flushFile(file);
+
+    const std::map<PageId, PageId> moved = file.compact();
+    for (i = 0; i < num; i += 10) {
+      const auto newNo = moved.find(pid[i]);
+      const PageId pageNo = newNo == moved.end() ? pid[i] : newNo->second;
+      if (pageNo > num / 10) {
+        PRINT_ERROR("ERROR :: PAGES NOT MOVED TO FRONT");
+      }
+      bufMgr->readPage(file, pageNo, page);
+      sprintf(tmpbuf, "test.compact Page %u %7.1f", pid[i], (float)pid[i]);
+      if (strncmp(page->getRecord({pageNo, rid[i].slot_number}).c_str(),
+                  tmpbuf, strlen(tmpbuf)) != 0) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+      bufMgr->unPinPage(file, pageNo, false);
+    }
+    bufMgr->flushFile(file);
+    if (file.allocatePage().page_number() != num / 10 + 1) {
+      PRINT_ERROR("ERROR :: FILE NOT SHRUNK");
+    }
+  }
+  File::remove(filename);
+
+  // Compacting a file whose only used page sits after a free one keeps it
+  {
+    File file = File::create(filename);
+    const PageId first = file.allocatePage().page_number();
+    Page last = file.allocatePage();
+    last.insertRecord("only used page");
+    file.writePage(last);
+    file.deletePage(first);
+
+    const std::map<PageId, PageId> moved = file.compact();
+    if (moved.size() != 1 || moved.begin()->second != first) {
+      PRINT_ERROR("ERROR :: SINGLE PAGE NOT COMPACTED");
+    }
+    int pages = 0;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      if ((*iter).page_number() != first) {
+        PRINT_ERROR("ERROR :: WRONG PAGE AFTER COMPACT");
+      }
+      pages++;
+    }
+    if (pages != 1 || file.readPage(first).getRecord({first, 1}) !=
+                        "only used page") {
+      PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+    }
+    if (file.allocatePage().page_number() != first + 1) {
+      PRINT_ERROR("ERROR :: FILE NOT SHRUNK");
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 13 passed"
+            << "\n";
+}
+
+void test14() {
+  // Reclustering through the buffer manager moves pages, including ones
+  // only changed in the pool, into the holes at the front of the file
+  const std::string filename = "test.recluster";
+  {
+    File file = File::create(filename);
+    for (i = 0; i < num; i++) {
+      bufMgr->allocPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.recluster Page %u %7.1f", pid[i], (float)pid[i]);
+      rid[i] = page->insertRecord(tmpbuf);
+      bufMgr->unPinPage(file, pid[i], true);
+    }
+    bufMgr->flushFile(file);
+    // Free the first half, and leave a change to the last page in the pool.
+    for (i = 0; i < num / 2; i++) {
+      bufMgr->disposePage(file, pid[i]);
+    }
+    bufMgr->readPage(file, pid[num - 1], page);
+    rid2 = page->insertRecord("changed in the pool");
+    bufMgr->unPinPage(file, pid[num - 1], true);
+
+    std::map<PageId, PageId> moved;
+    PageId lastRemaining = num;
+    ReclusterOptions options;
+    options.onMove = [&moved](PageId from, PageId to) { moved[from] = to; };
+    options.onProgress = [&lastRemaining](PageId, PageId remaining) {
+      lastRemaining = remaining;
+    };
+    if (bufMgr->recluster(file, options) != num / 2 || lastRemaining != 0) {
+      PRINT_ERROR("ERROR :: RECLUSTER DID NOT FINISH");
+    }
+
+    for (i = num / 2; i < num; i++) {
+      const auto newNo = moved.find(pid[i]);
+      const PageId pageNo = newNo == moved.end() ? pid[i] : newNo->second;
+      if (pageNo > num / 2) {
+        PRINT_ERROR("ERROR :: PAGES NOT MOVED TO FRONT");
+      }
+      bufMgr->readPage(file, pageNo, page);
+      sprintf(tmpbuf, "test.recluster Page %u %7.1f", pid[i], (float)pid[i]);
+      if (strncmp(page->getRecord({pageNo, rid[i].slot_number}).c_str(),
+                  tmpbuf, strlen(tmpbuf)) != 0 ||
+          (i == num - 1 &&
+           page->getRecord({pageNo, rid2.slot_number}) !=
+               "changed in the pool")) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+      bufMgr->unPinPage(file, pageNo, false);
+    }
+    bufMgr->flushFile(file);
+    if (file.allocatePage().page_number() != num / 2 + 1) {
+      PRINT_ERROR("ERROR :: FILE NOT SHRUNK");
+    }
+  }
+  File::remove(filename);
+
+  // Reclustering a file whose only used page is its last one moves that
+  // page to the front and shrinks the file around it
+  {
+    File file = File::create(filename);
+    PageId first;
+    PageId last;
+    bufMgr->allocPage(file, first, page);
+    bufMgr->unPinPage(file, first, false);
+    bufMgr->allocPage(file, last, page);
+    rid2 = page->insertRecord("only used page");
+    bufMgr->unPinPage(file, last, true);
+    bufMgr->disposePage(file, first);
+
+    PageId lastRemaining = 1;
+    ReclusterOptions options;
+    options.onProgress = [&lastRemaining](PageId, PageId remaining) {
+      lastRemaining = remaining;
+    };
+    if (bufMgr->recluster(file, options) != 1 || lastRemaining != 0) {
+      PRINT_ERROR("ERROR :: RECLUSTER DID NOT FINISH");
+    }
+    FileIterator iter = file.begin();
+    if (iter == file.end() || (*iter).page_number() != first ||
+        ++iter != file.end()) {
+      PRINT_ERROR("ERROR :: SINGLE PAGE NOT RECLUSTERED");
+    }
+    bufMgr->readPage(file, first, page);
+    if (page->getRecord({first, rid2.slot_number}) != "only used page") {
+      PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+    }
+    bufMgr->unPinPage(file, first, false);
+    bufMgr->flushFile(file);
+    if (file.allocatePage().page_number() != first + 1) {
+      PRINT_ERROR("ERROR :: FILE NOT SHRUNK");
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 14 passed"
+            << "\n";
+}
+
+void test15() {
+  // A page damaged on disk is caught by its checksum when the buffer manager
+  // reads it in, and the rest of the file is still readable
+  const std::string filename = "test.checksum";
+  {
+    File file = File::create(filename);
+    file.setChecksums(true);
+    for (i = 0; i < num; i++) {
+      bufMgr->allocPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.checksum Page %u %7.1f", pid[i], (float)pid[i]);
+      rid[i] = page->insertRecord(tmpbuf);
+      bufMgr->unPinPage(file, pid[i], true);
+    }
+    bufMgr->flushFile(file);
+  }
+
+  // Flip a byte in the data of the first page, which sits after the file
+  // header and the first bitmap block.
+  {
+    std::unique_ptr<StorageBackend> backend =
+        File::storage()->open(filename, false /* create_new */);
+    char byte;
+    const off_t offset = 2 * Page::SIZE + 100;
+    backend->read(&byte, 1, offset);
+    byte = ~byte;
+    backend->write(&byte, 1, offset);
+  }
+
+  {
+    File file = File::open(filename);
+    if (!file.checksums()) {
+      PRINT_ERROR("ERROR :: CHECKSUM SETTING NOT KEPT");
+    }
+    try {
+      bufMgr->readPage(file, pid[0], page);
+      PRINT_ERROR(
+          "ERROR :: Damaged page read. Exception should have been thrown "
+          "before execution reaches this point.");
+    } catch (const CorruptPageException &e) {
+      if (e.page_number() != pid[0]) {
+        PRINT_ERROR("ERROR :: WRONG PAGE REPORTED");
+      }
+    }
+    for (i = 1; i < num; i++) {
+      bufMgr->readPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.checksum Page %u %7.1f", pid[i], (float)pid[i]);
+      if (strncmp(page->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) !=
+          0) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+      bufMgr->unPinPage(file, pid[i], false);
+    }
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 15 passed"
+            << "\n";
+}
+
+void test16() {
+  // Files created through a compressed provider take less space, read back
+  // the same through the buffer manager, and sit beside plain files
+  const std::string filename = "test.compressed";
+  const std::string plainName = "test.plain";
+  std::shared_ptr<StorageProvider> posix = File::storage();
+  {
+    File plain = File::create(plainName);
+    Page plainPage = plain.allocatePage();
+    plainPage.insertRecord("not compressed");
+    plain.writePage(plainPage);
+  }
+  std::shared_ptr<CompressedStorage> compressed =
+      std::make_shared<CompressedStorage>(posix);
+  File::setStorage(compressed);
+  {
+    File file = File::create(filename);
+    for (i = 0; i < num; i++) {
+      bufMgr->allocPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.compressed Page %u %7.1f", pid[i], (float)pid[i]);
+      rid[i] = page->insertRecord(tmpbuf);
+      bufMgr->unPinPage(file, pid[i], true);
+    }
+    bufMgr->flushFile(file);
+  }
+
+  if (!compressed->isCompressed(filename) ||
+      compressed->isCompressed(plainName) ||
+      posix->open(filename, false)->size() >=
+          static_cast<off_t>(num * Page::SIZE / 4) ||
+      compressed->stats().ratio() <= 4) {
+    PRINT_ERROR("ERROR :: FILE NOT COMPRESSED");
+  }
+  {
+    File file = File::open(filename);
+    for (i = 0; i < num; i++) {
+      bufMgr->readPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.compressed Page %u %7.1f", pid[i], (float)pid[i]);
+      if (strncmp(page->getRecord(rid[i]).c_str(), tmpbuf, strlen(tmpbuf)) !=
+          0) {
+        PRINT_ERROR("ERROR :: CONTENTS DID NOT MATCH");
+      }
+      bufMgr->unPinPage(file, pid[i], false);
+    }
+    bufMgr->flushFile(file);
+
+    File plain = File::open(plainName);
+    if (plain.readPage(1).getRecord({1, 1}) != "not compressed") {
+      PRINT_ERROR("ERROR :: PLAIN FILE NOT READABLE");
+    }
+  }
+  File::remove(filename);
+  File::remove(plainName);
+  File::setStorage(posix);
+
+  std::cout << "Test 16 passed"
+            << "\n";
+}
+
+void test17() {
+  // Record views point into the pinned frame and match the copies, both by
+  // ID and through a page iterator
+  const std::string filename = "test.views";
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    for (i = 0; i < 20; i++) {
+      sprintf(tmpbuf, "test.views Record %u", i);
+      rid[i] = page->insertRecord(tmpbuf);
+    }
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    const char *frame = reinterpret_cast<const char *>(page);
+    for (i = 0; i < 20; i++) {
+      const std::string_view view = page->getRecordView(rid[i]);
+      if (view.data() < frame ||
+          view.data() + view.size() > frame + Page::SIZE ||
+          view != page->getRecord(rid[i])) {
+        PRINT_ERROR("ERROR :: RECORD VIEW DID NOT MATCH");
+      }
+    }
+    i = 0;
+    for (PageIterator iter = page->begin(); iter != page->end(); ++iter, ++i) {
+      sprintf(tmpbuf, "test.views Record %u", i);
+      if (*iter != tmpbuf) {
+        PRINT_ERROR("ERROR :: ITERATOR VIEW DID NOT MATCH");
+      }
+    }
+    if (i != 20) {
+      PRINT_ERROR("ERROR :: ITERATOR MISSED RECORDS");
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 17 passed"
+            << "\n";
+}
+
+void test18() {
+  // Binary records go in from views and from space reserved in the frame,
+  // and read back byte for byte
+  const std::string filename = "test.reserve";
+  struct Tuple {
+    std::uint32_t key;
+    double value;
+  };
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    for (i = 0; i < 20; i++) {
+      const Tuple tuple = {i, i * 0.5};
+      if (i % 2 == 0) {
+        rid[i] = page->insertRecord(std::string_view(
+            reinterpret_cast<const char *>(&tuple), sizeof(tuple)));
+      } else {
+        char *bytes;
+        rid[i] = page->reserveRecord(sizeof(tuple), bytes);
+        std::memcpy(bytes, &tuple, sizeof(tuple));
+      }
+    }
+    const char zeros[3] = {0, 0, 0};
+    page->updateRecord(rid[0], std::string_view(zeros, sizeof(zeros)));
+    try {
+      char *bytes;
+      page->reserveRecord(Page::SIZE, bytes);
+      PRINT_ERROR(
+          "ERROR :: Oversized record reserved. Exception should have been "
+          "thrown before execution reaches this point.");
+    } catch (const InsufficientSpaceException &e) {
+    }
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    if (page->getRecordView(rid[0]) != std::string_view(zeros, 3)) {
+      PRINT_ERROR("ERROR :: UPDATED RECORD DID NOT MATCH");
+    }
+    for (i = 1; i < 20; i++) {
+      const std::string_view bytes = page->getRecordView(rid[i]);
+      Tuple tuple;
+      std::memcpy(&tuple, bytes.data(), sizeof(tuple));
+      if (bytes.size() != sizeof(tuple) || tuple.key != i ||
+          tuple.value != i * 0.5) {
+        PRINT_ERROR("ERROR :: BINARY RECORD DID NOT MATCH");
+      }
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 18 passed"
+            << "\n";
+}
+
+void test19() {
+  // Freed slots on a page full of small records are handed out lowest
+  // first, and iteration skips the runs between used ones, before and after
+  // a round trip through the file.  Pages in the old linear slot format stay
+  // readable and writable.
+  const std::string filename = "test.slots";
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    if (page->format() != Page::CURRENT_FORMAT) {
+      PRINT_ERROR("ERROR :: NEW PAGE HAS WRONG FORMAT");
+    }
+    std::vector<RecordId> rids;
+    std::vector<std::string> records;
+    while (page->hasSpaceForRecord(4)) {
+      sprintf(tmpbuf, "%04u", (unsigned)rids.size());
+      rids.push_back(page->insertRecord(tmpbuf));
+      records.push_back(tmpbuf);
+    }
+    // Keep every 100th record and the last, so that most masks are empty.
+    std::vector<SlotId> freed;
+    for (i = 0; i < rids.size(); i++) {
+      if (i % 100 != 0 && i + 1 != rids.size()) {
+        page->deleteRecord(rids[i]);
+        records[i].clear();
+        freed.push_back(rids[i].slot_number);
+      }
+    }
+    std::size_t kept = 0;
+    for (PageIterator iter = page->begin(); iter != page->end(); ++iter) {
+      while (records[kept].empty()) {
+        kept++;
+      }
+      if (*iter != records[kept++]) {
+        PRINT_ERROR("ERROR :: ITERATOR DID NOT SKIP FREE SLOTS");
+      }
+    }
+    if (kept != rids.size()) {
+      PRINT_ERROR("ERROR :: ITERATOR MISSED RECORDS");
+    }
+    for (i = 0; i < 150; i++) {
+      sprintf(tmpbuf, "r%03u", i);
+      const RecordId reused = page->insertRecord(tmpbuf);
+      if (reused.slot_number != freed[i]) {
+        PRINT_ERROR("ERROR :: FREE SLOT NOT REUSED LOWEST FIRST");
+      }
+      records[reused.slot_number - 1] = tmpbuf;
+    }
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    kept = 0;
+    for (PageIterator iter = page->begin(); iter != page->end(); ++iter) {
+      while (records[kept].empty()) {
+        kept++;
+      }
+      if (*iter != records[kept++]) {
+        PRINT_ERROR("ERROR :: RECORDS DID NOT SURVIVE ROUND TRIP");
+      }
+    }
+    if (kept != rids.size()) {
+      PRINT_ERROR("ERROR :: ITERATOR MISSED RECORDS");
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  // A page as written before page formats: slots 1 and 3 used, 2 free.
+  char image[Page::SIZE] = {};
+  const PageHeader header = {3 * sizeof(PageSlot), Page::DATA_SIZE - 6, 3, 1,
+                             1, Page::INVALID_NUMBER};
+  const PageSlot slots[3] = {{true, Page::DATA_SIZE - 3, 3},
+                             {false, 0, 0},
+                             {true, Page::DATA_SIZE - 6, 3}};
+  std::memcpy(image, &header, sizeof(header));
+  std::memcpy(image + sizeof(header), slots, sizeof(slots));
+  std::memcpy(image + Page::SIZE - 6, "defabc", 6);
+  Page legacy;
+  std::memcpy(static_cast<void *>(&legacy), image, Page::SIZE);
+  if (legacy.format() != Page::FORMAT_LINEAR ||
+      legacy.getRecord({1, 1}) != "abc" || legacy.getRecord({1, 3}) != "def" ||
+      legacy.insertRecord("xyz").slot_number != 2) {
+    PRINT_ERROR("ERROR :: LINEAR PAGE DID NOT READ BACK");
+  }
+  std::string all;
+  for (PageIterator iter = legacy.begin(); iter != legacy.end(); ++iter) {
+    all += *iter;
+  }
+  legacy.deleteRecord({1, 3});
+  if (all != "abcxyzdef" ||
+      legacy.getFreeSpace() != Page::DATA_SIZE - 2 * sizeof(PageSlot) - 6) {
+    PRINT_ERROR("ERROR :: LINEAR PAGE DID NOT UPDATE");
+  }
+
+  std::cout << "Test 19 passed"
+            << "\n";
+}
+
+void test20() {
+  // Deletes leave the other records where they are, and an insert too big
+  // for any of the holes left behind still fits once the page compacts
+  const std::string filename = "test.holes";
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    std::vector<RecordId> rids;
+    const std::string record(50, 'h');
+    while (page->hasSpaceForRecord(record)) {
+      rids.push_back(page->insertRecord(record));
+    }
+    const std::uint16_t full = page->getFreeSpace();
+    std::vector<const char *> places;
+    for (i = 0; i < rids.size(); i++) {
+      places.push_back(page->getRecordView(rids[i]).data());
+    }
+    // Keep the last record, so that no slots are given back.
+    std::uint16_t holes = 0;
+    for (i = 0; i + 1 < rids.size(); i += 2) {
+      page->deleteRecord(rids[i]);
+      holes += record.size();
+    }
+    for (i = 1; i < rids.size(); i += 2) {
+      if (page->getRecordView(rids[i]).data() != places[i]) {
+        PRINT_ERROR("ERROR :: DELETE MOVED OTHER RECORDS");
+      }
+    }
+    if (page->getFreeSpace() != full + holes) {
+      PRINT_ERROR("ERROR :: FREE SPACE DID NOT COUNT HOLES");
+    }
+    const std::string big(holes - 10, 'b');
+    const RecordId bigRid = page->insertRecord(big);
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    if (page->getRecord(bigRid) != big) {
+      PRINT_ERROR("ERROR :: COMPACTED INSERT DID NOT MATCH");
+    }
+    for (i = 1; i < rids.size(); i += 2) {
+      if (page->getRecord(rids[i]) != record) {
+        PRINT_ERROR("ERROR :: COMPACTION LOST A RECORD");
+      }
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 20 passed"
+            << "\n";
+}
+
+void test21() {
+  // Updates that fit where the old version is stay in place and give back
+  // their tail; updates that grow move the record
+  const std::string filename = "test.update";
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    for (i = 0; i < 20; i++) {
+      sprintf(tmpbuf, "test.update Record %02u", i);
+      rid[i] = page->insertRecord(tmpbuf);
+    }
+    const char *place = page->getRecordView(rid[5]).data();
+    const std::uint16_t free = page->getFreeSpace();
+    page->updateRecord(rid[5], "test.update Status 05");
+    if (page->getRecordView(rid[5]).data() != place ||
+        page->getFreeSpace() != free) {
+      PRINT_ERROR("ERROR :: SAME LENGTH UPDATE MOVED THE RECORD");
+    }
+    // The new version is the tail of the old one, read through a view.
+    page->updateRecord(rid[5], page->getRecordView(rid[5]).substr(12));
+    if (page->getRecord(rid[5]) != "Status 05" ||
+        page->getFreeSpace() != free + 12) {
+      PRINT_ERROR("ERROR :: SHORTER UPDATE DID NOT GIVE BACK ITS TAIL");
+    }
+    const std::string grown(100, 'g');
+    page->updateRecord(rid[5], grown);
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    for (i = 0; i < 20; i++) {
+      sprintf(tmpbuf, "test.update Record %02u", i);
+      if (page->getRecord(rid[i]) != (i == 5 ? grown : tmpbuf)) {
+        PRINT_ERROR("ERROR :: UPDATED PAGE DID NOT MATCH");
+      }
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 21 passed"
+            << "\n";
+}
+
+void test22() {
+  // New pages pack their slots into four bytes and hold more small records
+  // than pages of the earlier formats, which stay readable
+  const std::string filename = "test.packed";
+  const std::string record(24, 'p');
+  std::vector<RecordId> rids;
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    if (page->format() != Page::FORMAT_PACKED_SLOTS) {
+      PRINT_ERROR("ERROR :: NEW PAGE DOES NOT PACK ITS SLOTS");
+    }
+    while (page->hasSpaceForRecord(record)) {
+      rids.push_back(page->insertRecord(record));
+    }
+    page->deleteRecord(rids[7]);
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    std::size_t count = 0;
+    for (PageIterator iter = page->begin(); iter != page->end(); ++iter) {
+      count++;
+    }
+    if (count != rids.size() - 1 || page->getRecord(rids[8]) != record) {
+      PRINT_ERROR("ERROR :: PACKED SLOTS DID NOT READ BACK");
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  // Empty pages as the earlier formats initialized them.
+  const PageHeader linear_header = {0, Page::DATA_SIZE, 0, 0, 1,
+                                    Page::INVALID_NUMBER};
+  const PageHeader masked_header = {
+      (Page::FORMAT_SLOT_MASKS << 13) | sizeof(PageExtension),
+      Page::DATA_SIZE, 0, 0, 1, Page::INVALID_NUMBER};
+  const PageExtension extension = {1, 0, {0, 0}};
+  for (const PageHeader &header : {linear_header, masked_header}) {
+    char image[Page::SIZE] = {};
+    std::memcpy(image, &header, sizeof(header));
+    if (&header == &masked_header) {
+      std::memcpy(image + sizeof(header), &extension, sizeof(extension));
+    }
+    Page old;
+    std::memcpy(static_cast<void *>(&old), image, Page::SIZE);
+    std::size_t count = 0;
+    while (old.hasSpaceForRecord(record)) {
+      old.insertRecord(record);
+      count++;
+    }
+    if (count >= rids.size() || old.getRecord({1, 3}) != record) {
+      PRINT_ERROR("ERROR :: EARLIER PAGE FORMAT DID NOT MATCH");
+    }
+  }
+
+  std::cout << "Test 22 passed"
+            << "\n";
+}
+
+void test23() {
+  // A batch of records fills pages one after another, each page taking
+  // what fits and leaving the rest for the next
+  const std::string filename = "test.batch";
+  std::vector<std::string> records;
+  for (i = 0; i < 1000; i++) {
+    sprintf(tmpbuf, "test.batch Record %u", i);
+    records.push_back(tmpbuf);
+  }
+  const std::vector<std::string_view> views(records.begin(), records.end());
+  {
+    File file = File::create(filename);
+    std::vector<PageId> pageNos;
+    std::vector<std::vector<RecordId>> rids;
+    for (std::size_t done = 0; done < views.size();) {
+      PageId pageNo = Page::INVALID_NUMBER;
+      bufMgr->allocPage(file, pageNo, page);
+      rids.push_back(
+          page->insertRecords(views.data() + done, views.size() - done));
+      if (rids.back().empty()) {
+        PRINT_ERROR("ERROR :: EMPTY PAGE TOOK NO RECORDS");
+      }
+      done += rids.back().size();
+      bufMgr->unPinPage(file, pageNo, true);
+      pageNos.push_back(pageNo);
+    }
+    bufMgr->flushFile(file);
+
+    std::size_t next = 0;
+    for (std::size_t p = 0; p < pageNos.size(); p++) {
+      bufMgr->readPage(file, pageNos[p], page);
+      for (const RecordId &recordId : rids[p]) {
+        if (page->getRecord(recordId) != records[next++]) {
+          PRINT_ERROR("ERROR :: BATCHED RECORD DID NOT MATCH");
+        }
+      }
+      if (p + 1 < pageNos.size() &&
+          page->hasSpaceForRecord(records[next])) {
+        PRINT_ERROR("ERROR :: BATCH STOPPED BEFORE THE PAGE WAS FULL");
+      }
+      bufMgr->unPinPage(file, pageNos[p], false);
+    }
+    if (next != records.size()) {
+      PRINT_ERROR("ERROR :: BATCH LOST RECORDS");
+    }
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 23 passed"
+            << "\n";
+}
+
+void test24() {
+  // Threads read and write pages of one file at the same time, each opening
+  // and closing the file through its own File objects
+  const std::string filename = "test.threads";
+  const PageId threads = 4;
+  const PageId pagesPerThread = 10;
+  {
+    File file = File::create(filename);
+    for (i = 0; i < threads * pagesPerThread; i++) {
+      Page new_page = file.allocatePage();
+      sprintf(tmpbuf, "test.threads Page %02u Round %03u", i, 0);
+      rid[i] = new_page.insertRecord(tmpbuf);
+      file.writePage(new_page);
+    }
+  }
+  const PageId rounds = 50;
+  std::atomic<bool> failed(false);
+  std::vector<std::thread> workers;
+  for (PageId t = 0; t < threads; t++) {
+    workers.emplace_back([&, t]() {
+      char expected[100];
+      for (PageId round = 1; round <= rounds; round++) {
+        // Every thread is sometimes the last to close the file.
+        File own = File::open(filename);
+        for (PageId j = t * pagesPerThread; j < (t + 1) * pagesPerThread;
+             j++) {
+          Page own_page = own.readPage(rid[j].page_number);
+          sprintf(expected, "test.threads Page %02u Round %03u", j,
+                  round - 1);
+          if (own_page.getRecord(rid[j]) != expected) {
+            failed = true;
+          }
+          sprintf(expected, "test.threads Page %02u Round %03u", j, round);
+          own_page.updateRecord(rid[j], expected);
+          own.writePage(own_page);
+        }
+      }
+    });
+  }
+  for (std::thread &worker : workers) {
+    worker.join();
+  }
+  if (failed) {
+    PRINT_ERROR("ERROR :: CONCURRENT READ DID NOT MATCH LAST WRITE");
+  }
+  if (File::isOpen(filename)) {
+    PRINT_ERROR("ERROR :: FILE LEFT OPEN AFTER THREADS CLOSED IT");
+  }
+  {
+    File file = File::open(filename);
+    for (i = 0; i < threads * pagesPerThread; i++) {
+      sprintf(tmpbuf, "test.threads Page %02u Round %03u", i, rounds);
+      if (file.readPage(rid[i].page_number).getRecord(rid[i]) != tmpbuf) {
+        PRINT_ERROR("ERROR :: CONCURRENT WRITE WAS LOST");
+      }
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 24 passed"
+            << "\n";
+}
+
+void test25() {
+  // Strict writes sync one by one, batched writes sync once the batch is
+  // full or has waited long enough, and flushing a file through the buffer
+  // manager ends with a single sync
+  const std::string filename = "test.durable";
+  std::shared_ptr<StorageProvider> posix = File::storage();
+  std::shared_ptr<SyncCountingStorage> counting =
+      std::make_shared<SyncCountingStorage>();
+  File::setStorage(counting);
+  {
+    File file = File::create(filename);
+    std::vector<Page> pages = file.allocatePages(20);
+    file.setDurability(Durability::STRICT);
+    int syncs = counting->syncs();
+    for (i = 0; i < 5; i++) {
+      file.writePage(pages[i]);
+      if (counting->syncs() != ++syncs) {
+        PRINT_ERROR("ERROR :: STRICT WRITE WAS NOT SYNCED");
+      }
+    }
+
+    file.setDurability(Durability::BATCHED, 4, 60 * 1000);
+    syncs = counting->syncs();
+    for (i = 0; i < 12; i++) {
+      file.writePage(pages[i]);
+      if (counting->syncs() != syncs + (int)(i + 1) / 4) {
+        PRINT_ERROR("ERROR :: BATCH WAS NOT SYNCED WHEN FULL");
+      }
+    }
+
+    // Writes left over when writing stops are synced when their time is up.
+    file.setDurability(Durability::BATCHED, 1000, 20);
+    syncs = counting->syncs();
+    file.writePage(pages[0]);
+    for (int wait = 0; wait < 500 && counting->syncs() == syncs; wait++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    if (counting->syncs() != syncs + 1) {
+      PRINT_ERROR("ERROR :: IDLE BATCH WAS NOT SYNCED");
+    }
+
+    file.setDurability(Durability::BATCHED, 1000, 60 * 1000);
+    for (i = 0; i < 20; i++) {
+      bufMgr->readPage(file, pages[i].page_number(), page);
+      page->insertRecord("test.durable Record");
+      bufMgr->unPinPage(file, pages[i].page_number(), true);
+    }
+    syncs = counting->syncs();
+    bufMgr->flushFile(file);
+    if (counting->syncs() != syncs + 1) {
+      PRINT_ERROR("ERROR :: FLUSH DID NOT END WITH ONE SYNC");
+    }
+  }
+  File::remove(filename);
+  File::setStorage(posix);
+
+  std::cout << "Test 25 passed"
+            << "\n";
+}
+
+void test26() {
+  // Allocations and deletes kept only in the cached header and bitmaps reach
+  // the disk when the file is closed, whether explicitly or by going out of
+  // scope, without a sync
+  const std::string filename = "test.header";
+  File file = File::create(filename);
+  for (i = 0; i < 10; i++) {
+    pid[i] = file.allocatePage().page_number();
+  }
+  file.deletePage(pid[3]);
+  file.close();
+  if (file.isValid() || File::isOpen(filename)) {
+    PRINT_ERROR("ERROR :: CLOSED FILE STILL OPEN");
+  }
+  file.close();
+  {
+    File reopened = File::open(filename);
+    PageId count = 0;
+    for (FileIterator iter = reopened.begin(); iter != reopened.end();
+         ++iter) {
+      if ((*iter).page_number() == pid[3]) {
+        PRINT_ERROR("ERROR :: DELETED PAGE CAME BACK");
+      }
+      count++;
+    }
+    if (count != 9 || reopened.allocatePage().page_number() != pid[3]) {
+      PRINT_ERROR("ERROR :: HEADER DID NOT SURVIVE CLOSE");
+    }
+    reopened.deletePage(pid[9]);
+  }
+  {
+    File reopened = File::open(filename);
+    PageId count = 0;
+    for (FileIterator iter = reopened.begin(); iter != reopened.end();
+         ++iter) {
+      count++;
+    }
+    if (count != 9 || reopened.allocatePage().page_number() != pid[9]) {
+      PRINT_ERROR("ERROR :: HEADER DID NOT SURVIVE DESTRUCTOR");
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 26 passed"
+            << "\n";
+}
+
+void test27() {
+  // A file in the version 1 format, which chains its used and free pages
+  // through next page numbers, opens read-only, and upgrading it keeps every
+  // page and the order of the used ones
+  const std::string filename = "test.v1";
+  const PageId numPages = 6;
+  {
+    // Pages 1, 3 and 5 are used; pages 2 and 4 are free.
+    const PageId header[4] = {numPages, 1 /* first_used_page */,
+                              2 /* num_free_pages */, 2 /* first_free_page */};
+    const PageId next[numPages] = {0, 3, 4, 5, Page::INVALID_NUMBER,
+                                   Page::INVALID_NUMBER};
+    std::unique_ptr<StorageBackend> raw = File::storage()->open(filename, true);
+    raw->write(header, sizeof(header), 0);
+    for (i = 1; i < numPages; i++) {
+      Page oldPage;
+      PageHeader pageHeader;
+      if (i % 2 == 1) {
+        sprintf(tmpbuf, "test.v1 Page %u", i);
+        oldPage.insertRecord(tmpbuf);
+      }
+      std::memcpy(&pageHeader, &oldPage, sizeof(pageHeader));
+      pageHeader.current_page_number = i % 2 == 1 ? i : Page::INVALID_NUMBER;
+      pageHeader.next_page_number = next[i];
+      std::memcpy(static_cast<void *>(&oldPage), &pageHeader,
+                  sizeof(pageHeader));
+      raw->write(&oldPage, Page::SIZE, sizeof(header) + (i - 1) * Page::SIZE);
+    }
+  }
+  for (int upgraded = 0; upgraded < 2; upgraded++) {
+    File file = File::open(filename);
+    if (file.formatVersion() != (upgraded ? File::FORMAT_VERSION : 1)) {
+      PRINT_ERROR("ERROR :: FILE HAS WRONG FORMAT VERSION");
+    }
+    PageId expected = 1;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      const Page onDisk = *iter;
+      sprintf(tmpbuf, "test.v1 Page %u", expected);
+      if (onDisk.page_number() != expected ||
+          onDisk.getRecord({expected, 1}) != tmpbuf) {
+        PRINT_ERROR("ERROR :: USED PAGES DID NOT MATCH");
+      }
+      expected += 2;
+    }
+    if (expected != numPages + 1) {
+      PRINT_ERROR("ERROR :: USED PAGES LOST");
+    }
+    if (upgraded) {
+      if (file.allocatePage().page_number() != 2 ||
+          file.allocatePage().page_number() != 4 ||
+          file.allocatePage().page_number() != numPages) {
+        PRINT_ERROR("ERROR :: FREE PAGES LOST IN UPGRADE");
+      }
+      break;
+    }
+    try {
+      file.allocatePage();
+      PRINT_ERROR(
+          "ERROR :: Page allocated in version 1 file. Exception should have "
+          "been thrown before execution reaches this point.");
+    } catch (const FileReadOnlyException &e) {
+    }
+    try {
+      file.writePage(file.readPage(3));
+      PRINT_ERROR(
+          "ERROR :: Page written to version 1 file. Exception should have "
+          "been thrown before execution reaches this point.");
+    } catch (const FileReadOnlyException &e) {
+    }
+    try {
+      file.deletePage(3);
+      PRINT_ERROR(
+          "ERROR :: Page deleted from version 1 file. Exception should have "
+          "been thrown before execution reaches this point.");
+    } catch (const FileReadOnlyException &e) {
+    }
+    file.close();
+    File::upgrade(filename);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 27 passed"
+            << "\n";
+}
+
+void test28() {
+  // Pages on either side of the boundary between two bitmap blocks are
+  // freed, skipped by the used list and reused lowest first, before and
+  // after the file is reopened
+  const std::string filename = "test.bitmap";
+  const PageId boundary = File::PAGES_PER_BITMAP;
+  {
+    File file = File::create(filename);
+    for (PageId allocated = 0; allocated < boundary + 4;) {
+      const PageId batch = std::min<PageId>(4096, boundary + 4 - allocated);
+      file.allocatePages(batch);
+      allocated += batch;
+    }
+    for (PageId pageNo = boundary - 1; pageNo <= boundary + 2; pageNo++) {
+      file.deletePage(pageNo);
+    }
+    if (file.readPage(boundary - 2).next_page_number() != boundary + 3) {
+      PRINT_ERROR("ERROR :: USED LIST DID NOT SKIP FREED PAGES");
+    }
+    // Free the rest of the first group, so that the used list starts in the
+    // second.
+    for (PageId pageNo = 1; pageNo < boundary - 1; pageNo++) {
+      file.deletePage(pageNo);
+    }
+    if (file.begin() == file.end() || (*file.begin()).page_number() !=
+                                          boundary + 3) {
+      PRINT_ERROR("ERROR :: USED LIST DID NOT START IN SECOND GROUP");
+    }
+  }
+  {
+    File file = File::open(filename);
+    if ((*file.begin()).page_number() != boundary + 3) {
+      PRINT_ERROR("ERROR :: BITMAPS DID NOT SURVIVE REOPEN");
+    }
+    for (PageId pageNo = 1; pageNo < boundary - 1; pageNo++) {
+      file.allocatePage();
+    }
+    for (PageId pageNo = boundary - 1; pageNo <= boundary + 2; pageNo++) {
+      if (file.allocatePage().page_number() != pageNo) {
+        PRINT_ERROR("ERROR :: FREED PAGE NOT REUSED ACROSS BITMAPS");
+      }
+    }
+    if (file.allocatePage().page_number() != boundary + 5 ||
+        file.readPage(boundary - 1).next_page_number() != boundary) {
+      PRINT_ERROR("ERROR :: BITMAPS DID NOT MATCH AFTER REUSE");
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 28 passed"
+            << "\n";
+}
+
+void test29() {
+  // Pages go between the disk and aligned buffer frames with direct I/O on,
+  // and a transfer the filesystem rejects falls back to buffered I/O
+  const std::string filename = "test.direct";
+  {
+    File file = File::create(filename);
+    const bool direct = file.setDirectIO(true);
+    if (file.directIO() != direct) {
+      PRINT_ERROR("ERROR :: DIRECT I/O SETTING NOT KEPT");
+    }
+    for (i = 0; i < num / 2; i++) {
+      bufMgr->allocPage(file, pid[i], page);
+      sprintf(tmpbuf, "test.direct Page %u", pid[i]);
+      rid[i] = page->insertRecord(tmpbuf);
+      bufMgr->unPinPage(file, pid[i], true);
+    }
+    bufMgr->flushFile(file);
+    for (i = 0; i < num / 2; i++) {
+      bufMgr->readPage(file, pid[i], page);
+      if (reinterpret_cast<std::uintptr_t>(page) %
+              StorageBackend::DIRECT_IO_ALIGNMENT !=
+          0) {
+        PRINT_ERROR("ERROR :: FRAME NOT ALIGNED FOR DIRECT I/O");
+      }
+      sprintf(tmpbuf, "test.direct Page %u", pid[i]);
+      if (page->getRecord(rid[i]) != tmpbuf) {
+        PRINT_ERROR("ERROR :: DIRECT READ DID NOT MATCH");
+      }
+      bufMgr->unPinPage(file, pid[i], false);
+    }
+    bufMgr->flushFile(file);
+    if (file.directIO() != direct) {
+      PRINT_ERROR("ERROR :: DIRECT I/O TURNED OFF");
+    }
+  }
+  {
+    // Direct I/O needs aligned offsets, so this read is rejected and retried
+    // through the cache.
+    std::unique_ptr<StorageBackend> raw =
+        File::storage()->open(filename, false);
+    char buffered[100];
+    char direct[100];
+    raw->read(buffered, sizeof(buffered), Page::SIZE + 100);
+    if (raw->setDirectIO(true)) {
+      raw->read(direct, sizeof(direct), Page::SIZE + 100);
+      if (raw->directIO() ||
+          std::memcmp(buffered, direct, sizeof(direct)) != 0) {
+        PRINT_ERROR("ERROR :: REJECTED DIRECT READ DID NOT FALL BACK");
+      }
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 29 passed"
+            << "\n";
+}
+
+void test30() {
+  // Views of a memory mapped file match the pages read through the
+  // descriptor, follow later writes, and stay valid as the file grows and
+  // is advised
+  const std::string filename = "test.mmap";
+  {
+    File file = File::create(filename);
+    for (i = 0; i < 10; i++) {
+      Page newPage = file.allocatePage();
+      sprintf(tmpbuf, "test.mmap Page %u", newPage.page_number());
+      rid[i] = newPage.insertRecord(tmpbuf);
+      file.writePage(newPage);
+    }
+    file.deletePage(rid[4].page_number);
+    try {
+      file.readPageView(rid[0].page_number);
+      PRINT_ERROR(
+          "ERROR :: View of unmapped file. Exception should have been thrown "
+          "before execution reaches this point.");
+    } catch (const FileIOException &e) {
+    }
+    if (!file.setMemoryMapped(true) || !file.memoryMapped() ||
+        file.setDirectIO(true)) {
+      PRINT_ERROR("ERROR :: FILE NOT MEMORY MAPPED");
+    }
+
+    file.advise(Advice::SEQUENTIAL);
+    PageId scanned = 0;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      const PageView view = iter.view();
+      const Page copy = *iter;
+      sprintf(tmpbuf, "test.mmap Page %u", view.page_number());
+      if (view.page_number() != copy.page_number() ||
+          view.next_page_number() != copy.next_page_number() ||
+          view.getRecordView({view.page_number(), 1}) != tmpbuf ||
+          copy.getRecord({copy.page_number(), 1}) != tmpbuf) {
+        PRINT_ERROR("ERROR :: VIEW DID NOT MATCH PAGE");
+      }
+      scanned++;
+    }
+    if (scanned != 9) {
+      PRINT_ERROR("ERROR :: VIEW SCAN DID NOT VISIT EVERY PAGE");
+    }
+    try {
+      file.readPageView(rid[4].page_number);
+      PRINT_ERROR(
+          "ERROR :: View of deleted page. Exception should have been thrown "
+          "before execution reaches this point.");
+    } catch (const InvalidPageException &e) {
+    }
+
+    const PageView first = file.readPageView(rid[0].page_number);
+    Page changed = file.readPage(rid[0].page_number);
+    changed.updateRecord(rid[0], "test.mmap Changed");
+    file.writePage(changed);
+    if (first.getRecord(rid[0]) != "test.mmap Changed") {
+      PRINT_ERROR("ERROR :: VIEW DID NOT SEE WRITE");
+    }
+
+    // Grow the file well past the current mapping.
+    std::vector<Page> grown = file.allocatePages(200);
+    Page last = grown.back();
+    last.insertRecord("test.mmap Last");
+    file.writePage(last);
+    file.advise(Advice::WILLNEED, last.page_number() - 10, 10);
+    if (file.readPageView(last.page_number()).getRecord(
+            {last.page_number(), 1}) != "test.mmap Last" ||
+        file.readPage(last.page_number()).getRecord(
+            {last.page_number(), 1}) != "test.mmap Last") {
+      PRINT_ERROR("ERROR :: VIEW DID NOT SEE GROWN FILE");
+    }
+    file.advise(Advice::DONTNEED);
+    file.advise(Advice::RANDOM, rid[0].page_number, 1);
+    if (first.getRecord(rid[0]) != "test.mmap Changed" ||
+        file.readPageView(rid[9].page_number).getRecord(rid[9]) !=
+            "test.mmap Page " + std::to_string(rid[9].page_number)) {
+      PRINT_ERROR("ERROR :: VIEW LOST AFTER FILE GREW");
+    }
+  }
+
+  // A file that keeps growing is mapped again only a few times, and earlier
+  // mappings are given back once no view refers to them
+  const auto mappings = [&filename]() {
+    std::ifstream maps("/proc/self/maps");
+    const std::string suffix = "/" + filename;
+    int count = 0;
+    std::string line;
+    while (std::getline(maps, line)) {
+      if (line.size() >= suffix.size() &&
+          line.compare(line.size() - suffix.size(), suffix.size(), suffix) ==
+              0) {
+        count++;
+      }
+    }
+    return count;
+  };
+  {
+    File file = File::open(filename);
+    file.setMemoryMapped(true);
+    PageView held = file.readPageView(rid[0].page_number);
+    for (i = 0; i < 2000; i++) {
+      Page newPage = file.allocatePage();
+      newPage.insertRecord("test.mmap Grown");
+      file.writePage(newPage);
+      if (file.readPageView(newPage.page_number())
+              .getRecord({newPage.page_number(), 1}) != "test.mmap Grown") {
+        PRINT_ERROR("ERROR :: VIEW DID NOT SEE GROWN FILE");
+      }
+    }
+    // The held view's mapping and the current one
+    if (mappings() != 2 || held.getRecord(rid[0]) != "test.mmap Changed") {
+      PRINT_ERROR("ERROR :: MAPPINGS NOT REUSED OR RELEASED");
+    }
+    held = PageView();
+    file.readPageView(rid[0].page_number);
+    if (mappings() != 1) {
+      PRINT_ERROR("ERROR :: MAPPING NOT RELEASED AFTER LAST VIEW");
+    }
+  }
+  if (mappings() != 0) {
+    PRINT_ERROR("ERROR :: MAPPING NOT RELEASED AT CLOSE");
+  }
+  File::remove(filename);
+
+  std::cout << "Test 30 passed"
+            << "\n";
+}
+
+void test31() {
+  // Throttled storage holds each transfer for the device's latency plus its
+  // share of the bandwidth, and vectored transfers the filesystem rejects
+  // for direct I/O fall back to buffered I/O
+  typedef std::chrono::steady_clock Clock;
+  const DeviceProfile profile = {std::chrono::milliseconds(20),
+                                 std::chrono::milliseconds(10),
+                                 std::chrono::milliseconds(30), 4 << 20};
+  const std::size_t length = 64 << 10;
+  const auto transferTime = std::chrono::microseconds(
+      length * UINT64_C(1000000) / profile.bytes_per_second);
+  std::vector<char> bytes(length, 't');
+  {
+    ThrottledStorage throttled(std::make_shared<MemoryStorage>(), profile);
+    std::unique_ptr<StorageBackend> backend =
+        throttled.open("test.throttled", true);
+    auto start = Clock::now();
+    backend->write(bytes.data(), length, 0);
+    if (Clock::now() - start < profile.write_latency + transferTime) {
+      PRINT_ERROR("ERROR :: THROTTLED WRITE TOO FAST");
+    }
+    start = Clock::now();
+    struct iovec halves[2] = {{bytes.data(), length / 2},
+                              {bytes.data() + length / 2, length / 2}};
+    if (backend->readv(halves, 2, 0) != length ||
+        Clock::now() - start < profile.read_latency + transferTime) {
+      PRINT_ERROR("ERROR :: THROTTLED READ TOO FAST");
+    }
+    start = Clock::now();
+    backend->sync();
+    if (Clock::now() - start < profile.sync_latency) {
+      PRINT_ERROR("ERROR :: THROTTLED SYNC TOO FAST");
+    }
+    // Concurrent transfers share the bandwidth.
+    start = Clock::now();
+    std::thread other([&]() { backend->write(bytes.data(), length, 0); });
+    backend->write(bytes.data(), length, length);
+    other.join();
+    if (Clock::now() - start < profile.write_latency + 2 * transferTime ||
+        backend->size() != static_cast<off_t>(2 * length)) {
+      PRINT_ERROR("ERROR :: THROTTLED BANDWIDTH NOT SHARED");
+    }
+  }
+
+  const std::string filename = "test.vectors";
+  {
+    std::unique_ptr<StorageBackend> raw = File::storage()->open(filename, true);
+    for (std::size_t b = 0; b < length; b++) {
+      bytes[b] = static_cast<char>(b % 251);
+    }
+    raw->write(bytes.data(), length, 0);
+    // Direct I/O needs aligned offsets, so these transfers are rejected and
+    // retried through the cache.
+    std::vector<char> read(length);
+    struct iovec halves[2] = {{read.data(), 3000}, {read.data() + 3000, 3000}};
+    if (raw->setDirectIO(true) &&
+        (raw->readv(halves, 2, 100) != 6000 || raw->directIO() ||
+         std::memcmp(read.data(), bytes.data() + 100, 6000) != 0)) {
+      PRINT_ERROR("ERROR :: REJECTED DIRECT READV DID NOT FALL BACK");
+    }
+    std::memset(read.data(), 'v', 6000);
+    if (raw->setDirectIO(true)) {
+      raw->writev(halves, 2, 100);
+      raw->setDirectIO(false);
+      raw->read(bytes.data(), length, 0);
+      if (std::count(bytes.begin() + 100, bytes.begin() + 6100, 'v') !=
+          6000) {
+        PRINT_ERROR("ERROR :: REJECTED DIRECT WRITEV DID NOT FALL BACK");
+      }
+    }
+  }
+  File::storage()->remove(filename);
+
+  std::cout << "Test 31 passed"
+            << "\n";
+}
+
+void test32() {
+  // A chunked scan of a file with scattered and whole chunks of deleted
+  // pages visits the same pages, in the same order and with the same next
+  // page numbers, as a scan page by page, and still ends if pages ahead of
+  // it are deleted while it runs
+  const std::string filename = "test.sequential";
+  const PageId numPages = 300;
+  const std::size_t chunkBytes = 8 * Page::SIZE;
+  {
+    File file = File::create(filename);
+    std::vector<Page> pages = file.allocatePages(numPages);
+    for (Page &newPage : pages) {
+      sprintf(tmpbuf, "test.sequential Page %u", newPage.page_number());
+      newPage.insertRecord(tmpbuf);
+      file.writePage(newPage);
+    }
+    for (const Page &oldPage : pages) {
+      const PageId pageNo = oldPage.page_number();
+      if (pageNo == 1 || pageNo % 3 == 0 || (pageNo > 100 && pageNo <= 130) ||
+          pageNo == numPages) {
+        file.deletePage(pageNo);
+      }
+    }
+
+    std::vector<Page> expected;
+    for (FileIterator iter = file.begin(); iter != file.end(); ++iter) {
+      expected.push_back(*iter);
+    }
+    std::size_t scanned = 0;
+    for (SequentialFileIterator iter(file, chunkBytes); !iter.done();
+         ++iter) {
+      if (scanned == expected.size() ||
+          iter->page_number() != expected[scanned].page_number() ||
+          iter->next_page_number() != expected[scanned].next_page_number() ||
+          iter->getRecord({iter->page_number(), 1}) !=
+              expected[scanned].getRecord({iter->page_number(), 1})) {
+        PRINT_ERROR("ERROR :: CHUNKED SCAN DID NOT MATCH PAGE SCAN");
+      }
+      scanned++;
+    }
+    if (scanned != expected.size()) {
+      PRINT_ERROR("ERROR :: CHUNKED SCAN MISSED PAGES");
+    }
+
+    scanned = 0;
+    for (SequentialFileIterator iter(file, chunkBytes); !iter.done();
+         ++iter) {
+      if (scanned++ == 10) {
+        // Past the chunk being read ahead, so no read sees a page being
+        // deleted.
+        for (std::size_t k = 40; k < expected.size(); k++) {
+          file.deletePage(expected[k].page_number());
+        }
+      }
+      sprintf(tmpbuf, "test.sequential Page %u", iter->page_number());
+      if (iter->getRecord({iter->page_number(), 1}) != tmpbuf) {
+        PRINT_ERROR("ERROR :: CHUNKED SCAN RETURNED A DELETED PAGE");
+      }
+    }
+    if (scanned != 40) {
+      PRINT_ERROR("ERROR :: CHUNKED SCAN DID NOT STOP AT DELETED PAGES");
+    }
+  }
+  File::remove(filename);
+
+  std::cout << "Test 32 passed"
+            << "\n";
+}
+
+void test33() {
+  // Extents a file gives up in a tablespace are not handed to another file
+  // until the directory without them is published, so the last published
+  // directory still finds the file's old contents after a crash
+  const std::string container = "test.tbs.crash";
+  const std::uint32_t extentBytes = 4096;
+  std::shared_ptr<StorageProvider> posix = File::storage();
+  try {
+    posix->remove(container);
+  } catch (const BadgerDbException &e) {
+  }
+  {
+    TablespaceStorage tablespace(posix, container, extentBytes);
+    std::unique_ptr<StorageBackend> shrunk = tablespace.open("shrunk", true);
+    std::unique_ptr<StorageBackend> grown = tablespace.open("grown", true);
+    const std::vector<char> old(4 * extentBytes, 's');
+    shrunk->write(old.data(), old.size(), 0);
+    shrunk->sync();
+
+    shrunk->truncate(extentBytes);
+    const std::vector<char> fresh(3 * extentBytes, 'g');
+    grown->write(fresh.data(), fresh.size(), 0);
+
+    // Open the container as it would be found after a crash now.
+    TablespaceStorage crashed(posix, container);
+    std::unique_ptr<StorageBackend> found = crashed.open("shrunk", false);
+    std::vector<char> contents(old.size());
+    if (found->size() != static_cast<off_t>(old.size()) ||
+        found->read(contents.data(), contents.size(), 0) != old.size() ||
+        contents != old) {
+      PRINT_ERROR("ERROR :: PUBLISHED DIRECTORY LOST FILE CONTENTS");
+    }
+
+    // Once published, the extents are free again.
+    tablespace.sync();
+    const std::uint32_t extents = tablespace.numExtents();
+    std::unique_ptr<StorageBackend> reused = tablespace.open("reused", true);
+    reused->write(fresh.data(), fresh.size(), 0);
+    if (tablespace.numExtents() != extents) {
+      PRINT_ERROR("ERROR :: RELEASED EXTENTS NOT REUSED AFTER PUBLISHING");
+    }
+  }
+  posix->remove(container);
+
+  std::cout << "Test 33 passed"
+            << "\n";
+}
+
+void test34() {
+  // Records inserted or grown from views of other records on the same page
+  // keep their bytes when making room moves or clears those records
+  const std::string filename = "test.alias";
+  {
+    File file = File::create(filename);
+    PageId pageNo = Page::INVALID_NUMBER;
+    bufMgr->allocPage(file, pageNo, page);
+    std::vector<RecordId> rids;
+    std::vector<std::string> records;
+    for (;;) {
+      std::string record(rids.size() % 2 == 0 ? 40 : 60,
+                         'a' + rids.size() % 26);
+      if (!page->hasSpaceForRecord(record)) {
+        break;
+      }
+      rids.push_back(page->insertRecord(record));
+      records.push_back(record);
+    }
+    // Leave holes, so that the next insert compacts the page.
+    page->deleteRecord(rids[0]);
+    page->deleteRecord(rids[2]);
+    const RecordId copyRid = page->insertRecord(page->getRecordView(rids[5]));
+    if (page->getRecord(copyRid) != records[5]) {
+      PRINT_ERROR("ERROR :: INSERT FROM VIEW DID NOT MATCH");
+    }
+    page->updateRecord(rids[4], page->getRecordView(rids[7]));
+    records[4] = records[7];
+    if (page->getRecord(rids[4]) != records[7]) {
+      PRINT_ERROR("ERROR :: GROWING UPDATE FROM VIEW DID NOT MATCH");
+    }
+    // A batch of views, too big for the space left without compacting.
+    page->deleteRecord(rids[9]);
+    page->deleteRecord(rids[11]);
+    const std::string_view views[2] = {page->getRecordView(rids[8]),
+                                       page->getRecordView(rids[10])};
+    const std::vector<RecordId> batchRids = page->insertRecords(views, 2);
+    if (batchRids.size() != 2 || page->getRecord(batchRids[0]) != records[8] ||
+        page->getRecord(batchRids[1]) != records[10]) {
+      PRINT_ERROR("ERROR :: BATCH FROM VIEWS DID NOT MATCH");
+    }
+    bufMgr->unPinPage(file, pageNo, true);
+    bufMgr->flushFile(file);
+
+    bufMgr->readPage(file, pageNo, page);
+    for (i = 0; i < rids.size(); i++) {
+      if (i != 0 && i != 2 && i != 9 && i != 11 &&
+          page->getRecord(rids[i]) != records[i]) {
+        PRINT_ERROR("ERROR :: RECORD MOVED BY COMPACTION DID NOT MATCH");
+      }
+    }
+    bufMgr->unPinPage(file, pageNo, false);
+    bufMgr->flushFile(file);
+  }
+  File::remove(filename);
+
+  std::cout << "Test 34 passed"
+            << "\n";
+}
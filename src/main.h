@@ -102,9 +102,9 @@
  *  badgerdb::File existing_file = badgerdb::File::open("filename.db");
  * @endcode
  *
- * Multiple File objects share the same stream to the underlying file.  The
- * stream will be automatically closed when the last File object is out of
- * scope; no explicit close command is necessary.
+ * Multiple File objects share the same descriptor for the underlying file.
+ * The descriptor will be automatically closed when the last File object is out
+ * of scope; no explicit close command is necessary.
  *
  * You can delete a file with File::remove:
  * @code
@@ -157,6 +157,19 @@
  *   }
  * @endcode
  *
+ * Read-mostly files can be scanned without copying pages by memory mapping
+ * them and iterating over views of the mapped pages:
+ * @code
+ *   db_file.setMemoryMapped(true);
+ *   db_file.advise(badgerdb::Advice::SEQUENTIAL);
+ *   for (badgerdb::FileIterator iter = db_file.begin();
+ *        iter != db_file.end();
+ *        ++iter) {
+ *     const badgerdb::PageView page = iter.view();
+ *     std::cout << "Free space: " << page.getFreeSpace() << std::endl;
+ *   }
+ * @endcode
+ *
  * @subsubsection page_sec Reading and writing data in a page
  *
  * Pages hold variable-length records containing arbitrary data.
@@ -8,7 +8,10 @@
 
 #include "page.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <string>
 
 #include "exceptions/insufficient_space_exception.h"
 #include "exceptions/invalid_record_exception.h"
@@ -21,41 +24,152 @@ namespace badgerdb {
 Page::Page() { initialize(); }
 
 void Page::initialize() {
-  header_.free_space_lower_bound = 0;
+  header_.free_space_lower_bound = CURRENT_FORMAT << FORMAT_SHIFT;
   header_.free_space_upper_bound = DATA_SIZE;
   header_.num_slots = 0;
   header_.num_free_slots = 0;
   header_.current_page_number = INVALID_NUMBER;
   header_.next_page_number = INVALID_NUMBER;
-  data_.assign(DATA_SIZE, char());
+  std::memset(data_, 0, DATA_SIZE);
+  setLowerBound(slotArrayEnd(0));
+  extension()->free_slot_hint = 1;
 }
 
-RecordId Page::insertRecord(const std::string &record_data) {
-  if (!hasSpaceForRecord(record_data)) {
-    throw InsufficientSpaceException(page_number(), record_data.length(),
-                                     getFreeSpace());
+RecordId Page::insertRecord(std::string_view record_data) {
+  // Making room may compact the page, so a view of one of its records is
+  // copied out first.
+  char copy[DATA_SIZE];
+  if (holds(record_data)) {
+    std::memcpy(copy, record_data.data(), record_data.size());
+    record_data = std::string_view(copy, record_data.size());
+  }
+  char *destination;
+  const RecordId record_id = reserveRecord(record_data.size(), destination);
+  std::memcpy(destination, record_data.data(), record_data.size());
+  return record_id;
+}
+
+std::vector<RecordId> Page::insertRecords(const std::string_view *records,
+                                         const std::size_t count) {
+  // Count the records that fit.  Each takes its bytes, plus a new slot once
+  // the free ones are used up.
+  const std::size_t free_space = getFreeSpace();
+  std::size_t num_fit = 0;
+  std::size_t record_bytes = 0;
+  std::size_t slot_bytes = 0;
+  for (; num_fit < count; ++num_fit) {
+    const std::size_t new_slots = num_fit + 1 > header_.num_free_slots
+                                      ? num_fit + 1 - header_.num_free_slots
+                                      : 0;
+    const std::size_t needed_slot_bytes =
+        slotArrayEnd(header_.num_slots + new_slots) - lowerBound();
+    if (record_bytes + records[num_fit].size() + needed_slot_bytes >
+        free_space) {
+      break;
+    }
+    record_bytes += records[num_fit].size();
+    slot_bytes = needed_slot_bytes;
+  }
+  std::string copies;
+  std::vector<std::string_view> copied_records;
+  if (record_bytes + slot_bytes > contiguousFreeSpace()) {
+    if (std::any_of(records, records + num_fit,
+                    [this](const std::string_view record) {
+                      return holds(record);
+                    })) {
+      // Compacting moves the records on this page, so new records that are
+      // views of them are copied out first.
+      copies.reserve(record_bytes);
+      for (std::size_t k = 0; k < num_fit; ++k) {
+        copied_records.emplace_back(copies.data() + copies.size(),
+                                    records[k].size());
+        copies.append(records[k]);
+      }
+      records = copied_records.data();
+    }
+    compact();
+  }
+
+  // There is room for them all, so they go in one after another: into the
+  // free slots first, then into new slots at the end of the slot array.
+  std::vector<RecordId> record_ids(num_fit);
+  for (std::size_t k = 0; k < num_fit; ++k) {
+    SlotId slot_number;
+    if (header_.num_free_slots > 0) {
+      slot_number = getAvailableSlot();
+      --header_.num_free_slots;
+    } else {
+      slot_number = ++header_.num_slots;
+      const SlotId index = slot_number - 1;
+      if (format() != FORMAT_LINEAR && index % SLOTS_PER_GROUP == 0) {
+        setSlotMask(index / SLOTS_PER_GROUP, 0);
+      }
+    }
+    const std::uint16_t length = records[k].size();
+    header_.free_space_upper_bound -= length;
+    std::memcpy(data_ + header_.free_space_upper_bound, records[k].data(),
+                length);
+    setSlot(slot_number, {true, header_.free_space_upper_bound, length});
+    record_ids[k] = {page_number(), slot_number};
+  }
+  setLowerBound(slotArrayEnd(header_.num_slots));
+  return record_ids;
+}
+
+RecordId Page::reserveRecord(const std::size_t length, char *&record_data) {
+  if (!hasSpaceForRecord(length)) {
+    throw InsufficientSpaceException(page_number(), length, getFreeSpace());
+  }
+  if (spaceForRecord(length) > contiguousFreeSpace()) {
+    compact();
   }
   const SlotId slot_number = getAvailableSlot();
-  insertRecordInSlot(slot_number, record_data);
+  record_data = reserveRecordInSlot(slot_number, length);
   return {page_number(), slot_number};
 }
 
 std::string Page::getRecord(const RecordId &record_id) const {
+  return std::string(getRecordView(record_id));
+}
+
+std::string_view Page::getRecordView(const RecordId &record_id) const {
   validateRecordId(record_id);
-  const PageSlot *slot = getSlot(record_id.slot_number);
-  return data_.substr(slot->item_offset, slot->item_length);
+  const PageSlot slot = getSlot(record_id.slot_number);
+  return std::string_view(data_ + slot.item_offset, slot.item_length);
 }
 
 void Page::updateRecord(const RecordId &record_id,
-                        const std::string &record_data) {
+                        std::string_view record_data) {
   validateRecordId(record_id);
-  const PageSlot *slot = getSlot(record_id.slot_number);
+  PageSlot slot = getSlot(record_id.slot_number);
+  if (record_data.length() <= slot.item_length) {
+    // The new version fits in the old one's place.  It goes at the end of
+    // it, so that the tail given back borders the free space if the old
+    // version did.  The bytes may be a view of the old version, so they are
+    // moved before the tail is cleared.
+    const std::uint16_t offset = slot.item_offset;
+    const std::uint16_t tail = slot.item_length - record_data.length();
+    std::memmove(data_ + offset + tail, record_data.data(),
+                 record_data.length());
+    slot.item_offset = offset + tail;
+    slot.item_length = record_data.length();
+    setSlot(record_id.slot_number, slot);
+    releaseSpace(offset, tail);
+    return;
+  }
   const std::size_t free_space_after_delete =
-      getFreeSpace() + slot->item_length;
+      getFreeSpace() + slot.item_length;
   if (record_data.length() > free_space_after_delete) {
     throw InsufficientSpaceException(page_number(), record_data.length(),
                                      free_space_after_delete);
   }
+  // Deleting the old version zeroes it and making room may compact the page,
+  // so a view of a record on this page is copied out first.
+  char copy[DATA_SIZE];
+  if (holds(record_data)) {
+    std::memcpy(copy, record_data.data(), record_data.size());
+    record_data = std::string_view(copy, record_data.size());
+  }
   // We have to disallow slot compaction here because we're going to place the
   // record data in the same slot, and compaction might delete the slot if we
   // permit it.
@@ -70,36 +184,12 @@ void Page::deleteRecord(const RecordId &record_id) {
 void Page::deleteRecord(const RecordId &record_id,
                         const bool allow_slot_compaction) {
   validateRecordId(record_id);
-  PageSlot *slot = getSlot(record_id.slot_number);
-  data_.replace(slot->item_offset, slot->item_length, slot->item_length, '\0');
-
-  // Compact the data by removing the hole left by this record (if necessary).
-  std::uint16_t move_offset = slot->item_offset;
-  std::size_t move_bytes = 0;
-  for (SlotId i = 1; i <= header_.num_slots; ++i) {
-    PageSlot *other_slot = getSlot(i);
-    if (other_slot->used && other_slot->item_offset < slot->item_offset) {
-      if (other_slot->item_offset < move_offset) {
-        move_offset = other_slot->item_offset;
-      }
-      move_bytes += other_slot->item_length;
-      // Update the slot for the other data to reflect the soon-to-be-new
-      // location.
-      other_slot->item_offset += slot->item_length;
-    }
-  }
-  // If we have data to move, shift it to the right.
-  if (move_bytes > 0) {
-    const std::string &data_to_move = data_.substr(move_offset, move_bytes);
-    data_.replace(move_offset + slot->item_length, move_bytes, data_to_move);
-  }
-  header_.free_space_upper_bound += slot->item_length;
+  const PageSlot slot = getSlot(record_id.slot_number);
 
   // Mark slot as unused.
-  slot->used = false;
-  slot->item_offset = 0;
-  slot->item_length = 0;
+  setSlot(record_id.slot_number, {false, 0, 0});
   ++header_.num_free_slots;
+  releaseSpace(slot.item_offset, slot.item_length);
 
   if (allow_slot_compaction && record_id.slot_number == header_.num_slots) {
     // Last slot in the list, so we need to free any unused slots that are at
@@ -107,8 +197,7 @@ void Page::deleteRecord(const RecordId &record_id,
     int num_slots_to_delete = 1;
     for (SlotId i = 1; i < header_.num_slots; ++i) {
       // Traverse list backwards, looking for unused slots.
-      const PageSlot *other_slot = getSlot(header_.num_slots - i);
-      if (!other_slot->used) {
+      if (!getSlot(header_.num_slots - i).used) {
         ++num_slots_to_delete;
       } else {
         // Stop at the first used slot we find, since we can't move used
@@ -118,76 +207,207 @@ void Page::deleteRecord(const RecordId &record_id,
     }
     header_.num_slots -= num_slots_to_delete;
     header_.num_free_slots -= num_slots_to_delete;
-    header_.free_space_lower_bound -= sizeof(PageSlot) * num_slots_to_delete;
+    setLowerBound(slotArrayEnd(header_.num_slots));
   }
 }
 
-bool Page::hasSpaceForRecord(const std::string &record_data) const {
-  std::size_t record_size = record_data.length();
+bool Page::hasSpaceForRecord(const std::size_t length) const {
+  return spaceForRecord(length) <= getFreeSpace();
+}
+
+std::size_t Page::spaceForRecord(const std::size_t length) const {
+  std::size_t record_size = length;
   if (header_.num_free_slots == 0) {
-    record_size += sizeof(PageSlot);
+    record_size +=
+        slotArrayEnd(header_.num_slots + 1) - slotArrayEnd(header_.num_slots);
+  }
+  return record_size;
+}
+
+void Page::releaseSpace(const std::uint16_t offset,
+                        const std::uint16_t length) {
+  if (length == 0) {
+    return;
+  }
+  std::memset(data_ + offset, 0, length);
+  if (offset == header_.free_space_upper_bound) {
+    header_.free_space_upper_bound += length;
+  } else if (format() == FORMAT_LINEAR) {
+    // There is nowhere to note holes on these pages, so they are kept
+    // compact.
+    compact();
+  } else {
+    // Leave the hole until the space is needed.
+    extension()->fragmented_bytes += length;
+  }
+}
+
+void Page::compact() {
+  // Pack the records in use against the end of a scratch copy of the data
+  // area, in slot order, and copy them back in one go.  No record can be
+  // overwritten before it has been copied, so nothing needs sorting.
+  char packed[DATA_SIZE];
+  std::uint16_t end = DATA_SIZE;
+  for (SlotId i = nextUsedSlot(INVALID_SLOT); i != INVALID_SLOT;
+       i = nextUsedSlot(i)) {
+    const PageSlot slot = getSlot(i);
+    end -= slot.item_length;
+    std::memcpy(packed + end, data_ + slot.item_offset, slot.item_length);
+    setSlotOffset(i, end);
+  }
+  // The space given back keeps nothing of the records that were there.
+  std::memset(data_ + header_.free_space_upper_bound, 0,
+              end - header_.free_space_upper_bound);
+  std::memcpy(data_ + end, packed + end, DATA_SIZE - end);
+  header_.free_space_upper_bound = end;
+  if (format() != FORMAT_LINEAR) {
+    extension()->fragmented_bytes = 0;
+  }
+}
+
+void Page::setSlot(const SlotId slot_number, const PageSlot &slot) {
+  char *stored = data_ + slotOffset(format(), slot_number);
+  if (format() == FORMAT_PACKED_SLOTS) {
+    const PackedPageSlot packed = {
+        static_cast<std::uint16_t>(slot.item_offset |
+                                   (slot.used ? PackedPageSlot::USED : 0)),
+        slot.item_length};
+    std::memcpy(stored, &packed, sizeof(packed));
+  } else {
+    // Field by field, to leave the padding byte alone.
+    PageSlot *unpacked = reinterpret_cast<PageSlot *>(stored);
+    unpacked->used = slot.used;
+    unpacked->item_offset = slot.item_offset;
+    unpacked->item_length = slot.item_length;
+  }
+  if (format() == FORMAT_LINEAR) {
+    return;
+  }
+
+  // Keep the slot's group mask and the free slot hint up to date.
+  const SlotId index = slot_number - 1;
+  const std::uint64_t bit = std::uint64_t(1) << (index % SLOTS_PER_GROUP);
+  const SlotId group = index / SLOTS_PER_GROUP;
+  if (slot.used) {
+    setSlotMask(group, slotMask(group) | bit);
+  } else {
+    setSlotMask(group, slotMask(group) & ~bit);
+    if (slot_number < extension()->free_slot_hint) {
+      extension()->free_slot_hint = slot_number;
+    }
   }
-  return record_size <= getFreeSpace();
 }
 
-PageSlot *Page::getSlot(const SlotId slot_number) {
-  return reinterpret_cast<PageSlot *>(
-      &data_[(slot_number - 1) * sizeof(PageSlot)]);
+std::uint64_t Page::slotMask(const SlotId group) const {
+  std::uint64_t mask;
+  std::memcpy(&mask,
+              &data_[sizeof(PageExtension) + group * groupBytes(format())],
+              sizeof(mask));
+  return mask;
 }
 
-const PageSlot *Page::getSlot(const SlotId slot_number) const {
-  return reinterpret_cast<const PageSlot *>(
-      &data_[(slot_number - 1) * sizeof(PageSlot)]);
+void Page::setSlotMask(const SlotId group, const std::uint64_t mask) {
+  std::memcpy(&data_[sizeof(PageExtension) + group * groupBytes(format())],
+              &mask, sizeof(mask));
+}
+
+SlotId Page::nextUsedSlot(const SlotId start) const {
+  if (format() == FORMAT_LINEAR) {
+    for (SlotId i = start + 1; i <= header_.num_slots; ++i) {
+      if (getSlot(i).used) {
+        return i;
+      }
+    }
+    return INVALID_SLOT;
+  }
+  // Slot <start> + 1 is at index <start>.  Bits past the last slot are clear,
+  // so the first set bit found is always a real slot.
+  for (SlotId index = start; index < header_.num_slots;) {
+    const SlotId group = index / SLOTS_PER_GROUP;
+    const std::uint64_t used =
+        slotMask(group) & (~std::uint64_t(0) << (index % SLOTS_PER_GROUP));
+    if (used != 0) {
+      return group * SLOTS_PER_GROUP + __builtin_ctzll(used) + 1;
+    }
+    index = (group + 1) * SLOTS_PER_GROUP;
+  }
+  return INVALID_SLOT;
 }
 
 SlotId Page::getAvailableSlot() {
   SlotId slot_number = INVALID_SLOT;
   if (header_.num_free_slots > 0) {
-    // Have an allocated but unused slot that we can reuse.
-    for (SlotId i = 1; i <= header_.num_slots; ++i) {
-      const PageSlot *slot = getSlot(i);
-      if (!slot->used) {
-        // We don't decrement the number of free slots until someone
-        // actually puts data in the slot.
-        slot_number = i;
-        break;
+    // Have an allocated but unused slot that we can reuse.  We don't decrement
+    // the number of free slots until someone actually puts data in the slot.
+    if (format() == FORMAT_LINEAR) {
+      for (SlotId i = 1; i <= header_.num_slots; ++i) {
+        if (!getSlot(i).used) {
+          slot_number = i;
+          break;
+        }
+      }
+    } else {
+      // No slot before the hint is free, so the first clear bit from there
+      // on is the first free slot.  It comes before any bits past the last
+      // slot, which are clear too.
+      const SlotId index = extension()->free_slot_hint - 1;
+      SlotId group = index / SLOTS_PER_GROUP;
+      std::uint64_t free =
+          ~slotMask(group) & (~std::uint64_t(0) << (index % SLOTS_PER_GROUP));
+      while (free == 0) {
+        free = ~slotMask(++group);
       }
+      slot_number = group * SLOTS_PER_GROUP + __builtin_ctzll(free) + 1;
+      extension()->free_slot_hint = slot_number;
     }
   } else {
     // Have to allocate a new slot.
     slot_number = header_.num_slots + 1;
+    if (format() != FORMAT_LINEAR) {
+      const SlotId index = slot_number - 1;
+      if (index % SLOTS_PER_GROUP == 0) {
+        setSlotMask(index / SLOTS_PER_GROUP, 0);
+      }
+    }
     ++header_.num_slots;
     ++header_.num_free_slots;
-    header_.free_space_lower_bound = sizeof(PageSlot) * header_.num_slots;
+    setLowerBound(slotArrayEnd(header_.num_slots));
+    setSlot(slot_number, {false, 0, 0});
   }
-  assert(slot_number != INVALID_SLOT);
+  assert(slot_number != INVALID_SLOT && slot_number <= header_.num_slots);
   return slot_number;
 }
 
 void Page::insertRecordInSlot(const SlotId slot_number,
-                              const std::string &record_data) {
+                              std::string_view record_data) {
+  std::memcpy(reserveRecordInSlot(slot_number, record_data.size()),
+              record_data.data(), record_data.size());
+}
+
+char *Page::reserveRecordInSlot(const SlotId slot_number,
+                                const std::size_t length) {
   if (slot_number > header_.num_slots || slot_number == INVALID_SLOT) {
     throw InvalidSlotException(page_number(), slot_number);
   }
-  PageSlot *slot = getSlot(slot_number);
-  if (slot->used) {
+  if (getSlot(slot_number).used) {
     throw SlotInUseException(page_number(), slot_number);
   }
-  const int record_length = record_data.length();
-  slot->used = true;
-  slot->item_length = record_length;
-  slot->item_offset = header_.free_space_upper_bound - record_length;
-  header_.free_space_upper_bound = slot->item_offset;
+  if (length > contiguousFreeSpace()) {
+    compact();
+  }
+  const int record_length = length;
+  header_.free_space_upper_bound -= record_length;
+  setSlot(slot_number, {true, header_.free_space_upper_bound,
+                        static_cast<std::uint16_t>(record_length)});
   --header_.num_free_slots;
-  data_.replace(slot->item_offset, slot->item_length, record_data);
+  return data_ + header_.free_space_upper_bound;
 }
 
 void Page::validateRecordId(const RecordId &record_id) const {
   if (record_id.page_number != page_number()) {
     throw InvalidRecordException(record_id, page_number());
   }
-  const PageSlot *slot = getSlot(record_id.slot_number);
-  if (!slot->used) {
+  if (!getSlot(record_id.slot_number).used) {
     throw InvalidRecordException(record_id, page_number());
   }
 }
@@ -11,8 +11,12 @@
 #include <stdint.h>
 
 #include <cstddef>
+#include <cstring>
 #include <memory>
 #include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
 
 #include "types.h"
 
@@ -28,6 +32,9 @@ struct PageHeader {
   /**
    * Lower bound of the free space.  This is the offset of the first unused byte
    * after the slot array.
+   *
+   * The top three bits hold the page's format (see Page::format()), which
+   * old pages leave zero since the bound never exceeds Page::DATA_SIZE.
    */
   std::uint16_t free_space_lower_bound;
 
@@ -93,7 +100,55 @@ struct PageSlot {
   std::uint16_t item_length;
 };
 
+/**
+ * @brief Slot metadata as stored on pages in Page::FORMAT_PACKED_SLOTS.
+ *
+ * Offsets into an 8 KiB page need only 13 bits, so whether the slot is used
+ * is kept in the top bit of the offset, and a slot takes four bytes instead
+ * of the six of a padded PageSlot.
+ */
+struct PackedPageSlot {
+  /**
+   * Bit of item_offset that is set if the slot currently holds data.
+   */
+  static const std::uint16_t USED = 0x8000;
+
+  /**
+   * Offset of the data item in the page, with USED set if the slot is in use.
+   */
+  std::uint16_t item_offset;
+
+  /**
+   * Length of the data item in this slot.
+   */
+  std::uint16_t item_length;
+};
+
+/**
+ * @brief Bookkeeping kept at the start of the data area of pages in
+ *        Page::FORMAT_SLOT_MASKS and later formats.
+ */
+struct PageExtension {
+  /**
+   * Lowest slot that may be unused; all slots before it are in use.
+   */
+  SlotId free_slot_hint;
+
+  /**
+   * Bytes of deleted records left between the free space and the records
+   * still in use.  They are free, but can only be reused once the page is
+   * compacted.
+   */
+  std::uint16_t fragmented_bytes;
+
+  /**
+   * Unused; zero.
+   */
+  std::uint16_t reserved[2];
+};
+
 class PageIterator;
+class PageView;
 
 /**
  * @brief Class which represents a fixed-size database page containing records.
@@ -103,9 +158,14 @@ class PageIterator;
  * slots and identified by a RecordId.  Although a record's actual contents may
  * be moved on the page, accessing a record by its slot is consistent.
  *
+ * A page is a plain SIZE-byte block laid out exactly as on disk, header
+ * first, with nothing on the heap: it is read and written with a single
+ * transfer, copied with a single memcpy, and a std::vector<Page> is a run of
+ * page images that can be read from the file in one go.
+ *
  * @warning This class is not threadsafe.
  */
-class Page {
+class alignas(alignof(std::max_align_t)) Page {
  public:
   /**
    * Page size in bytes.  If this is changed, database files created with a
@@ -128,18 +188,77 @@ class Page {
    */
   static const SlotId INVALID_SLOT = 0;
 
+  /**
+   * Format of pages with a plain slot array at the start of the data area.
+   * Pages written before formats were introduced are in this format.
+   */
+  static const unsigned FORMAT_LINEAR = 0;
+
+  /**
+   * Format of pages whose data area starts with a PageExtension, followed by
+   * the slot array in groups of SLOTS_PER_GROUP, each group preceded by a
+   * 64-bit mask of which of its slots are in use.  The masks let free slots
+   * and used slots be found a word at a time.
+   */
+  static const unsigned FORMAT_SLOT_MASKS = 1;
+
+  /**
+   * Format laid out as FORMAT_SLOT_MASKS, but with each slot stored as a
+   * four-byte PackedPageSlot.
+   */
+  static const unsigned FORMAT_PACKED_SLOTS = 2;
+
+  /**
+   * Format of newly initialized pages.
+   */
+  static const unsigned CURRENT_FORMAT = FORMAT_PACKED_SLOTS;
+
+  /**
+   * Number of slots covered by one used-slot mask.
+   */
+  static const SlotId SLOTS_PER_GROUP = 64;
+
   /**
    * Constructs a new, uninitialized page.
    */
   Page();
 
   /**
-   * Inserts a new record into the page.
+   * Inserts a new record into the page.  Any bytes will do, so binary
+   * tuples can be passed as a view of their buffer without building a
+   * string.
    *
    * @param record_data  Bytes that compose the record.
    * @return  ID of the newly inserted record.
+   * @throws  InsufficientSpaceException  If the page can't hold the record.
    */
-  RecordId insertRecord(const std::string &record_data);
+  RecordId insertRecord(std::string_view record_data);
+
+  /**
+   * Inserts records into the page in order, stopping at the first one that
+   * doesn't fit so that the rest can go on another page.  The space they
+   * need is worked out once, and the page compacted at most once.
+   *
+   * @param records  Bytes of the records to insert.
+   * @param count    Number of records.
+   * @return  IDs of the records inserted, one for each record up to the
+   *          first that didn't fit.
+   */
+  std::vector<RecordId> insertRecords(const std::string_view *records,
+                                      const std::size_t count);
+
+  /**
+   * Inserts a new record of the given length and returns where its bytes
+   * go, so that it can be serialized straight into the page.  The bytes are
+   * unspecified until written, and the pointer is valid until the page is
+   * next changed.
+   *
+   * @param length       Length of the record in bytes.
+   * @param record_data  Set to the start of the record's <length> bytes.
+   * @return  ID of the newly inserted record.
+   * @throws  InsufficientSpaceException  If the page can't hold the record.
+   */
+  RecordId reserveRecord(const std::size_t length, char *&record_data);
 
   /**
    * Returns the record with the given ID.  Returned data is a copy of what is
@@ -151,20 +270,34 @@ class Page {
    */
   std::string getRecord(const RecordId &record_id) const;
 
+  /**
+   * Returns the record with the given ID without copying it.  The view
+   * points into the page, so it is valid until the page is changed or goes
+   * away; for a page in the buffer pool, while the page stays pinned.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   * @throws  InvalidRecordException  If the ID has a bad page or slot number.
+   */
+  std::string_view getRecordView(const RecordId &record_id) const;
+
   /**
    * Updates the record with the given ID, replacing its data with a new
    * version.  This is equivalent to deleting the old record and inserting a
-   * new one, with the exception that the record ID will not change.
+   * new one, with the exception that the record ID will not change.  A
+   * version no longer than the old one is written in place; only one that
+   * grows is moved.
    *
    * @param record_id   ID of record to update.
    * @param record_data Updated bytes that compose the record.
    */
-  void updateRecord(const RecordId &record_id, const std::string &record_data);
+  void updateRecord(const RecordId &record_id, std::string_view record_data);
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array.
+   * Deletes the record with the given ID.  The record's bytes are left as a
+   * hole that is reclaimed when an insert or update next needs the space;
+   * pages in FORMAT_LINEAR are compacted at once instead.  Slot array is
+   * compacted if the slot deleted is at the end of the slot array.
    *
    * @param record_id   ID of the record to delete.
    */
@@ -176,17 +309,37 @@ class Page {
    * @param record_data Bytes that compose the record.
    * @return  Whether the page can hold the data.
    */
-  bool hasSpaceForRecord(const std::string &record_data) const;
+  bool hasSpaceForRecord(std::string_view record_data) const {
+    return hasSpaceForRecord(record_data.size());
+  }
+
+  /**
+   * Returns true if the page has enough free space to hold a record of the
+   * given length.
+   *
+   * @param length  Length of the record in bytes.
+   * @return  Whether the page can hold the record.
+   */
+  bool hasSpaceForRecord(const std::size_t length) const;
 
   /**
-   * Returns this page's free space in bytes.
+   * Returns this page's free space in bytes, including holes left by deleted
+   * records.
    *
    * @return  Free space in bytes.
    */
   std::uint16_t getFreeSpace() const {
-    return header_.free_space_upper_bound - header_.free_space_lower_bound;
+    return header_.free_space_upper_bound - lowerBound() + fragmentedBytes();
   }
 
+  /**
+   * Returns the layout this page's slots are stored in, one of the FORMAT_
+   * constants.
+   *
+   * @return  Page format.
+   */
+  unsigned format() const { return formatOf(header_); }
+
   /**
    * Returns this page's number in its file.
    *
@@ -241,10 +394,9 @@ class Page {
   }
 
   /**
-   * Deletes the record with the given ID.  Page is compacted upon delete to
-   * ensure that data of all records is contiguous.  Slot array is compacted if
-   * the slot deleted is at the end of the slot array and
-   * <allow_slot_compaction> is set.
+   * Deletes the record with the given ID, as deleteRecord(record_id) does.
+   * Slot array is compacted if the slot deleted is at the end of the slot
+   * array and <allow_slot_compaction> is set.
    *
    * @param record_id             ID of the record to delete.
    * @param allow_slot_compaction If true, the slot array will be compacted if
@@ -259,19 +411,254 @@ class Page {
    * have a valid slot number.
    *
    * @param slot_number   Number of slot to retrieve.
-   * @return  Pointer to the slot.
+   * @return  Copy of the slot.
    */
-  PageSlot *getSlot(const SlotId slot_number);
+  PageSlot getSlot(const SlotId slot_number) const {
+    return readSlot(data_, format(), slot_number);
+  }
 
   /**
-   * Returns the slot with the given number.  This method will return
-   * unallocated slots if requested; it is up to the caller to ensure they
-   * have a valid slot number.
+   * Stores the given slot, in whatever form the page's format keeps slots
+   * in, and keeps the slot's group mask and the free slot hint up to date.
+   *
+   * @param slot_number   Number of slot to store.
+   * @param slot          New contents of the slot.
+   */
+  void setSlot(const SlotId slot_number, const PageSlot &slot);
+
+  /**
+   * Changes where the record of the given used slot is, without touching
+   * the rest of the slot.
+   *
+   * @param slot_number   Number of a used slot.
+   * @param item_offset   New offset of the record.
+   */
+  void setSlotOffset(const SlotId slot_number,
+                     const std::uint16_t item_offset) {
+    char *stored = data_ + slotOffset(format(), slot_number);
+    if (format() == FORMAT_PACKED_SLOTS) {
+      const std::uint16_t packed_offset = item_offset | PackedPageSlot::USED;
+      std::memcpy(stored + offsetof(PackedPageSlot, item_offset),
+                  &packed_offset, sizeof(packed_offset));
+    } else {
+      reinterpret_cast<PageSlot *>(stored)->item_offset = item_offset;
+    }
+  }
+
+  /**
+   * Returns the given slot from the data area of a page of the given format.
    *
+   * @param data          Start of the page's data area.
+   * @param page_format   Format of the page.
    * @param slot_number   Number of slot to retrieve.
-   * @return  The slot.
+   * @return  Copy of the slot.
+   */
+  static PageSlot readSlot(const char *data, const unsigned page_format,
+                           const SlotId slot_number) {
+    const char *stored = data + slotOffset(page_format, slot_number);
+    if (page_format == FORMAT_PACKED_SLOTS) {
+      PackedPageSlot packed;
+      std::memcpy(&packed, stored, sizeof(packed));
+      return {(packed.item_offset & PackedPageSlot::USED) != 0,
+              static_cast<std::uint16_t>(packed.item_offset &
+                                         ~PackedPageSlot::USED),
+              packed.item_length};
+    }
+    const PageSlot *unpacked = reinterpret_cast<const PageSlot *>(stored);
+    return {unpacked->used, unpacked->item_offset, unpacked->item_length};
+  }
+
+  /**
+   * Returns the format stored in the given page header.
+   *
+   * @param page_header   Header of the page.
+   * @return  Page format.
    */
-  const PageSlot *getSlot(const SlotId slot_number) const;
+  static unsigned formatOf(const PageHeader &page_header) {
+    return page_header.free_space_lower_bound >> FORMAT_SHIFT;
+  }
+
+  /**
+   * Returns the bytes taken by a slot on a page of the given format.
+   *
+   * @param page_format   Format of the page.
+   * @return  Size of a stored slot.
+   */
+  static std::size_t slotBytes(const unsigned page_format) {
+    return page_format == FORMAT_PACKED_SLOTS ? sizeof(PackedPageSlot)
+                                              : sizeof(PageSlot);
+  }
+
+  /**
+   * Returns the bytes taken by a full group of slots and its mask on a page
+   * of the given format.
+   *
+   * @param page_format   Format of the page.
+   * @return  Size of a group.
+   */
+  static std::size_t groupBytes(const unsigned page_format) {
+    return sizeof(std::uint64_t) + SLOTS_PER_GROUP * slotBytes(page_format);
+  }
+
+  /**
+   * Returns the offset in the data area of the given slot on a page of the
+   * given format.
+   *
+   * @param page_format   Format of the page.
+   * @param slot_number   Number of the slot.
+   * @return  Offset of the slot.
+   */
+  static std::size_t slotOffset(const unsigned page_format,
+                                const SlotId slot_number) {
+    const std::size_t index = slot_number - 1;
+    if (page_format == FORMAT_LINEAR) {
+      return index * sizeof(PageSlot);
+    }
+    return sizeof(PageExtension) +
+           index / SLOTS_PER_GROUP * groupBytes(page_format) +
+           sizeof(std::uint64_t) +
+           index % SLOTS_PER_GROUP * slotBytes(page_format);
+  }
+
+  /**
+   * Returns the offset of the end of a slot array of the given size on a page
+   * of this page's format.
+   *
+   * @param num_slots   Number of slots in the array.
+   * @return  Offset of the first byte after the slot array.
+   */
+  std::uint16_t slotArrayEnd(const SlotId num_slots) const {
+    if (format() == FORMAT_LINEAR) {
+      return num_slots * sizeof(PageSlot);
+    }
+    const SlotId num_groups = (num_slots + SLOTS_PER_GROUP - 1) /
+                              SLOTS_PER_GROUP;
+    return sizeof(PageExtension) + num_groups * sizeof(std::uint64_t) +
+           num_slots * slotBytes(format());
+  }
+
+  /**
+   * Returns the lower bound of the free space, without the format bits.
+   *
+   * @return  Offset of the first unused byte after the slot array.
+   */
+  std::uint16_t lowerBound() const {
+    return header_.free_space_lower_bound & BOUND_MASK;
+  }
+
+  /**
+   * Sets the lower bound of the free space, keeping the page's format.
+   *
+   * @param bound   Offset of the first unused byte after the slot array.
+   */
+  void setLowerBound(const std::uint16_t bound) {
+    header_.free_space_lower_bound =
+        (header_.free_space_lower_bound & ~BOUND_MASK) | bound;
+  }
+
+  /**
+   * Returns the extension at the start of the data area.  Only meaningful
+   * for pages in FORMAT_SLOT_MASKS and later formats.
+   *
+   * @return  Page extension.
+   */
+  PageExtension *extension() {
+    return reinterpret_cast<PageExtension *>(data_);
+  }
+
+  /**
+   * Returns the extension at the start of the data area.  Only meaningful
+   * for pages in FORMAT_SLOT_MASKS and later formats.
+   *
+   * @return  Page extension.
+   */
+  const PageExtension *extension() const {
+    return reinterpret_cast<const PageExtension *>(data_);
+  }
+
+  /**
+   * Returns the bytes of deleted records not yet reclaimed by compaction.
+   *
+   * @return  Fragmented bytes.
+   */
+  std::uint16_t fragmentedBytes() const {
+    return format() == FORMAT_LINEAR ? 0 : extension()->fragmented_bytes;
+  }
+
+  /**
+   * Returns the free space between the slot array and the records, which
+   * can be handed out without compacting.
+   *
+   * @return  Contiguous free space in bytes.
+   */
+  std::uint16_t contiguousFreeSpace() const {
+    return header_.free_space_upper_bound - lowerBound();
+  }
+
+  /**
+   * Returns the space taken by a new record of the given length, including
+   * a new slot if no free slot can be reused.
+   *
+   * @param length  Length of the record in bytes.
+   * @return  Space needed in bytes.
+   */
+  std::size_t spaceForRecord(const std::size_t length) const;
+
+  /**
+   * Gives back bytes of the data area that no record uses any more, zeroing
+   * them.  Bytes bordering the free space join it; others are left as a hole
+   * until the page is compacted.
+   *
+   * @param offset  Offset of the bytes in the data area.
+   * @param length  Number of bytes.
+   */
+  void releaseSpace(const std::uint16_t offset, const std::uint16_t length);
+
+  /**
+   * Moves the records in use up against the end of the page, in one pass, so
+   * that all free space lies between the slot array and the records.
+   */
+  void compact();
+
+  /**
+   * Returns whether the given bytes start in this page's data area, as a
+   * view of one of its records does.  Such bytes move when the page is
+   * compacted and are zeroed when their record is deleted.
+   *
+   * @param bytes   Bytes to check.
+   * @return  True if the bytes are part of this page.
+   */
+  bool holds(const std::string_view bytes) const {
+    return bytes.data() >= data_ && bytes.data() < data_ + DATA_SIZE;
+  }
+
+  /**
+   * Returns the used-slot mask of the given group of slots.  Only meaningful
+   * for pages in FORMAT_SLOT_MASKS and later formats.  Bit i is set if slot
+   * group * SLOTS_PER_GROUP + i + 1 is in use.
+   *
+   * @param group   Index of the group.
+   * @return  The mask.
+   */
+  std::uint64_t slotMask(const SlotId group) const;
+
+  /**
+   * Sets the used-slot mask of the given group of slots.
+   *
+   * @param group   Index of the group.
+   * @param mask    New mask.
+   */
+  void setSlotMask(const SlotId group, const std::uint64_t mask);
+
+  /**
+   * Returns the first used slot after the given slot, or INVALID_SLOT if no
+   * slots after it are used.
+   *
+   * @param start   Slot to start the search after; INVALID_SLOT to start at
+   *                the first slot.
+   * @return  Next used slot after the given slot or INVALID_SLOT.
+   */
+  SlotId nextUsedSlot(const SlotId start) const;
 
   /**
    * Returns the slot number of an available slot.  If no slots are available
@@ -279,8 +666,8 @@ class Page {
    * header metadata, but does not mark returned slot as used.  If a new slot is
    * allocated, updates the free space lower bound.
    *
-   * Callers are responsible for making sure there is enough space to allocate a
-   * new slot before calling this method.
+   * Callers are responsible for making sure there is enough contiguous space
+   * to allocate a new slot before calling this method.
    *
    * Since the returned slot is not marked as used, callers must take care to
    * fill the slot or mark it used before someone else calls this method.
@@ -303,7 +690,22 @@ class Page {
    * @throws  SlotInUseException  Thrown when given slot is in use.
    */
   void insertRecordInSlot(const SlotId slot_number,
-                          const std::string &record_data);
+                          std::string_view record_data);
+
+  /**
+   * Takes space for a record of the given length in the given slot, under
+   * the same conditions as insertRecordInSlot, and returns where its bytes
+   * go.  Compacts the page first if the free space is there but not in one
+   * piece.
+   *
+   * @param slot_number   Number of slot to put the record in.
+   * @param length        Length of the record in bytes.
+   * @return  Start of the record's bytes.
+   * @throws  InvalidSlotException  Thrown when given slot number refers to an
+   *                                unallocated slot.
+   * @throws  SlotInUseException  Thrown when given slot is in use.
+   */
+  char *reserveRecordInSlot(const SlotId slot_number, const std::size_t length);
 
   /**
    * Throws an exception if the given record ID is not valid for this page
@@ -322,20 +724,47 @@ class Page {
    */
   bool isUsed() const { return page_number() != INVALID_NUMBER; }
 
+  /**
+   * Returns the start of the page's SIZE-byte image: the header followed by
+   * the data.
+   *
+   * @return  Start of the image.
+   */
+  char *image() { return reinterpret_cast<char *>(&header_); }
+
+  /**
+   * Returns the start of the page's SIZE-byte image: the header followed by
+   * the data.
+   *
+   * @return  Start of the image.
+   */
+  const char *image() const {
+    return reinterpret_cast<const char *>(&header_);
+  }
+
+  /**
+   * Bits of free_space_lower_bound holding the bound itself; the rest hold
+   * the format.
+   */
+  static const std::uint16_t BOUND_MASK = 0x1FFF;
+  static const unsigned FORMAT_SHIFT = 13;
+  static_assert(DATA_SIZE <= BOUND_MASK,
+                "Free space bounds must leave room for the page format.");
+
   /**
    * Header metadata.
    */
   PageHeader header_;
 
   /**
-   * Data stored on the page.  Includes bookkeeping information about slots as
-   * well as actual content.
+   * Data stored on the page, right after the header.  Includes bookkeeping
+   * information about slots as well as actual content.
    */
-
-  std::string data_;
+  char data_[DATA_SIZE];
 
   friend class File;
   friend class PageIterator;
+  friend class PageView;
   friend class PageTest;
   friend class BufferTest;
 };
@@ -343,5 +772,9 @@ class Page {
 static_assert(Page::SIZE > sizeof(PageHeader),
               "Page size must be large enough to hold header and data.");
 static_assert(Page::DATA_SIZE > 0, "Page must have some space to hold data.");
+static_assert(sizeof(Page) == Page::SIZE,
+              "Page must be exactly its on-disk image.");
+static_assert(std::is_trivially_copyable<Page>::value,
+              "Pages must be copyable with memcpy.");
 
 }  // namespace badgerdb
@@ -90,13 +90,13 @@ class PageIterator {
   }
 
   /**
-   * Dereferences the iterator, returning a copy of the current record in the
-   * page.
+   * Dereferences the iterator, returning a view of the current record in the
+   * page.  The view is valid while the page is unchanged.
    *
    * @return  Record in page.
    */
-  inline std::string operator*() const {
-    return page_->getRecord(current_record_);
+  inline std::string_view operator*() const {
+    return page_->getRecordView(current_record_);
   }
 
   /**
@@ -107,15 +107,7 @@ class PageIterator {
    * @return  Next used slot after given slot or Page::INVALID_SLOT.
    */
   SlotId getNextUsedSlot(const SlotId start) const {
-    SlotId slot_number = Page::INVALID_SLOT;
-    for (SlotId i = start + 1; i <= page_->header_.num_slots; ++i) {
-      const PageSlot *slot = page_->getSlot(i);
-      if (slot->used) {
-        slot_number = i;
-        break;
-      }
-    }
-    return slot_number;
+    return page_->nextUsedSlot(start);
   }
 
  private:
@@ -0,0 +1,163 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#include "exceptions/invalid_record_exception.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Read-only view of a page image held elsewhere.
+ *
+ * A view refers to a page's on-disk image without copying it, e.g. into a
+ * file mapped with File::readPageView().  It offers the read accessors of
+ * Page.  The view is valid for as long as the memory it refers to; for a
+ * mapped file, until the file is closed.
+ */
+class PageView {
+ public:
+  /**
+   * Constructs an empty view.
+   */
+  PageView() : image_(NULL), next_page_number_(Page::INVALID_NUMBER) {}
+
+  /**
+   * Constructs a view of the page image at the given address.
+   *
+   * @param image             Start of a Page::SIZE byte page image.
+   * @param next_page_number  Number of the next used page in the file, which
+   *                          overrides the (possibly stale) one in the image.
+   */
+  PageView(const char *image, const PageId next_page_number)
+      : image_(image), next_page_number_(next_page_number) {}
+
+  /**
+   * Constructs a view of the page image at the given address which shares
+   * ownership of the memory holding it.
+   *
+   * @param image             Start of a Page::SIZE byte page image.
+   * @param next_page_number  Number of the next used page in the file.
+   * @param owner             Keeps the memory holding the image alive.
+   */
+  PageView(const char *image, const PageId next_page_number,
+           std::shared_ptr<const void> owner)
+      : image_(image),
+        next_page_number_(next_page_number),
+        owner_(std::move(owner)) {}
+
+  /**
+   * Returns the record with the given ID.  Returned data is a copy of what is
+   * stored on the page.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  The record.
+   * @throws  InvalidRecordException  If the ID has a bad page or slot number.
+   */
+  std::string getRecord(const RecordId &record_id) const {
+    return std::string(getRecordView(record_id));
+  }
+
+  /**
+   * Returns the record with the given ID without copying it.  The view
+   * points into the image, so it is valid as long as this view is.
+   *
+   * @param record_id  ID of the record to return.
+   * @return  View of the record.
+   * @throws  InvalidRecordException  If the ID has a bad page or slot number.
+   */
+  std::string_view getRecordView(const RecordId &record_id) const {
+    const PageHeader &page_header = header();
+    if (record_id.page_number != page_header.current_page_number ||
+        record_id.slot_number == Page::INVALID_SLOT ||
+        record_id.slot_number > page_header.num_slots) {
+      throw InvalidRecordException(record_id, page_number());
+    }
+    const PageSlot slot = Page::readSlot(
+        data(), Page::formatOf(page_header), record_id.slot_number);
+    if (!slot.used) {
+      throw InvalidRecordException(record_id, page_number());
+    }
+    return std::string_view(data() + slot.item_offset, slot.item_length);
+  }
+
+  /**
+   * Returns the page's free space in bytes, including holes left by deleted
+   * records.
+   *
+   * @return  Free space in bytes.
+   */
+  std::uint16_t getFreeSpace() const {
+    const PageHeader &page_header = header();
+    std::uint16_t free_space =
+        page_header.free_space_upper_bound -
+        (page_header.free_space_lower_bound & Page::BOUND_MASK);
+    if (Page::formatOf(page_header) != Page::FORMAT_LINEAR) {
+      PageExtension extension;
+      std::memcpy(&extension, data(), sizeof(extension));
+      free_space += extension.fragmented_bytes;
+    }
+    return free_space;
+  }
+
+  /**
+   * Returns the page's number in its file.
+   *
+   * @return  Page number.
+   */
+  PageId page_number() const { return header().current_page_number; }
+
+  /**
+   * Returns the number of the next used page after this page in its file.
+   *
+   * @return  Page number of next used page in file.
+   */
+  PageId next_page_number() const { return next_page_number_; }
+
+  /**
+   * Returns the page's header as stored in the image.
+   *
+   * @return  Page header.
+   */
+  const PageHeader &header() const {
+    return *reinterpret_cast<const PageHeader *>(image_);
+  }
+
+  /**
+   * Returns the page's data area (slots and records) as stored in the image.
+   *
+   * @return  Start of the Page::DATA_SIZE byte data area.
+   */
+  const char *data() const { return image_ + sizeof(PageHeader); }
+
+ private:
+  /**
+   * Start of the page image.
+   */
+  const char *image_;
+
+  /**
+   * Number of the next used page in the file.
+   */
+  PageId next_page_number_;
+
+  /**
+   * Owner of the memory holding the image, if shared.
+   */
+  std::shared_ptr<const void> owner_;
+};
+
+}  // namespace badgerdb
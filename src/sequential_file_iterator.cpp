@@ -0,0 +1,95 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "sequential_file_iterator.h"
+
+#include <algorithm>
+#include <utility>
+
+namespace badgerdb {
+
+SequentialFileIterator::SequentialFileIterator(File &file,
+                                               std::size_t chunk_bytes)
+    : file_(&file),
+      chunk_pages_(std::min<std::size_t>(
+          std::max<std::size_t>(chunk_bytes / Page::SIZE, 1),
+          File::MAX_CHUNK_PAGES)),
+      current_(0) {
+  startRead(file_->readHeader().first_used_page);
+  advanceChunk();
+}
+
+SequentialFileIterator::~SequentialFileIterator() {
+  if (next_read_.valid()) {
+    next_read_.wait();
+  }
+}
+
+SequentialFileIterator &SequentialFileIterator::operator++() {
+  if (++current_ == used_.size()) {
+    advanceChunk();
+  }
+  return *this;
+}
+
+void SequentialFileIterator::startRead(const PageId first_page) {
+  if (first_page == Page::INVALID_NUMBER) {
+    return;
+  }
+  next_chunk_.first_page = first_page;
+  // Page objects are reused from chunk to chunk, so their storage is
+  // allocated only once.
+  next_chunk_.pages.resize(file_->usedSpan(first_page, chunk_pages_));
+  next_read_ = std::async(std::launch::async, [this]() {
+    file_->readChunk(next_chunk_.first_page, next_chunk_.pages);
+  });
+}
+
+void SequentialFileIterator::advanceChunk() {
+  // A chunk may turn out to hold no used pages, or no pages at all, if they
+  // were deleted since the span was worked out; carry on with the next one.
+  do {
+    current_ = 0;
+    used_.clear();
+    if (!next_read_.valid()) {
+      return;  // no more chunks
+    }
+    next_read_.get();
+    // The caller has moved past the current chunk, so it can take the next
+    // read.
+    std::swap(chunk_, next_chunk_);
+
+    for (PageId i = 0; i < chunk_.pages.size(); ++i) {
+      if (chunk_.pages[i].page_number() != Page::INVALID_NUMBER) {
+        used_.push_back(i);
+      }
+    }
+
+    // Work out where the scan continues after this chunk.
+    PageId next_page = Page::INVALID_NUMBER;
+    if (file_->formatVersion() == 1) {
+      // The used list is chained through the pages themselves.
+      if (!used_.empty()) {
+        next_page = chunk_.pages[used_.back()].next_page_number();
+      }
+    } else {
+      const PageId last_page = chunk_.first_page + chunk_.pages.size() - 1;
+      next_page = file_->nextUsedPage(last_page);
+      for (std::size_t k = 0; k < used_.size(); ++k) {
+        File::setNextPageNumber(chunk_.pages[used_[k]],
+                                k + 1 < used_.size()
+                                    ? chunk_.first_page + used_[k + 1]
+                                    : next_page);
+      }
+    }
+
+    startRead(next_page);
+  } while (used_.empty());
+}
+
+}  // namespace badgerdb
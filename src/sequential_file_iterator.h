@@ -0,0 +1,148 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <future>
+#include <vector>
+
+#include "file.h"
+#include "page.h"
+#include "types.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Iterator for scanning all used pages of a file in order, reading
+ *        ahead in large chunks.
+ *
+ * Unlike FileIterator, which reads one page at a time, this iterator reads
+ * runs of neighbouring pages with a single read of up to chunk_bytes straight
+ * into a reusable set of pages, and yields them by reference.  While the
+ * caller works through one chunk, the next one is read in the background
+ * into a second set.
+ *
+ * Pages are yielded as they were when their chunk was read, and references
+ * are valid until the iterator leaves the chunk.  The iterator is not
+ * copyable.
+ *
+ * Usage:
+ * @code
+ *   for (badgerdb::SequentialFileIterator iter(file); !iter.done(); ++iter) {
+ *     std::cout << "Read page: " << iter->page_number() << std::endl;
+ *   }
+ * @endcode
+ */
+class SequentialFileIterator {
+ public:
+  /**
+   * Default size of a chunk.
+   */
+  static const std::size_t DEFAULT_CHUNK_BYTES = 1 << 20;
+
+  /**
+   * Constructs an iterator at the first used page of the file.
+   *
+   * @param file          File to iterate over.  Must outlive the iterator.
+   * @param chunk_bytes   Largest read issued, rounded down to whole pages
+   *                      (at least one, at most File::MAX_CHUNK_PAGES).
+   */
+  explicit SequentialFileIterator(File &file,
+                                  std::size_t chunk_bytes = DEFAULT_CHUNK_BYTES);
+
+  /**
+   * Waits for any read still in flight.
+   */
+  ~SequentialFileIterator();
+
+  SequentialFileIterator(const SequentialFileIterator &) = delete;
+  SequentialFileIterator &operator=(const SequentialFileIterator &) = delete;
+
+  /**
+   * Returns true once the iterator has moved past the last used page.
+   *
+   * @return  Whether the scan is finished.
+   */
+  bool done() const { return current_ == used_.size(); }
+
+  /**
+   * Advances the iterator to the next used page in the file.
+   */
+  SequentialFileIterator &operator++();
+
+  /**
+   * Returns the current page.  Must not be called once done() is true.
+   *
+   * @return  Current page.
+   */
+  const Page &operator*() const {
+    return chunk_.pages[used_[current_]];
+  }
+
+  /**
+   * Returns a pointer to the current page.  Must not be called once done()
+   * is true.
+   *
+   * @return  Current page.
+   */
+  const Page *operator->() const {
+    return &chunk_.pages[used_[current_]];
+  }
+
+ private:
+  /**
+   * Run of consecutive pages read from the file.
+   */
+  struct Chunk {
+    PageId first_page;
+    std::vector<Page> pages;
+  };
+
+  /**
+   * Starts reading the chunk beginning at the given used page into
+   * <next_chunk_>.  Does nothing for Page::INVALID_NUMBER.
+   *
+   * @param first_page  First page of the chunk.
+   */
+  void startRead(const PageId first_page);
+
+  /**
+   * Waits for the chunk in flight and makes it the current one, then starts
+   * reading the chunk after it.
+   */
+  void advanceChunk();
+
+  /**
+   * File being scanned.
+   */
+  File *file_;
+
+  /**
+   * Largest number of pages in a chunk.
+   */
+  PageId chunk_pages_;
+
+  /**
+   * Current chunk, and the positions of its used pages.
+   */
+  Chunk chunk_;
+  std::vector<PageId> used_;
+
+  /**
+   * Position in used_ of the current page.
+   */
+  std::size_t current_;
+
+  /**
+   * Chunk being read in the background, and the read itself.
+   */
+  Chunk next_chunk_;
+  std::future<void> next_read_;
+};
+
+}  // namespace badgerdb
@@ -0,0 +1,804 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "storage.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iterator>
+#include <list>
+#include <new>
+#include <thread>
+
+#include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+struct PosixStorage::DescriptorCache {
+  /**
+   * Descriptor of one open file.
+   */
+  struct Slot {
+    // Open descriptor, or -1.
+    int fd = -1;
+    // Number of transfers using fd.
+    int users = 0;
+    // Position in idle while users is 0 and fd is open.
+    std::list<Slot *>::iterator idle_position;
+  };
+
+  explicit DescriptorCache(const std::size_t capacity)
+      : capacity(capacity), open_count(0) {}
+
+  /**
+   * Returns the slot's descriptor, opening the file with <flags> if it has
+   * none, and marks it busy until release().
+   */
+  int acquire(Slot &slot, const std::string &name, const int flags);
+
+  /**
+   * Ends a transfer started with acquire().
+   */
+  void release(Slot &slot);
+
+  /**
+   * Takes over a descriptor the file was just opened with.
+   */
+  void adopt(Slot &slot, const int fd);
+
+  /**
+   * Closes the slot's descriptor for good.  The slot must not be busy.
+   */
+  void forget(Slot &slot);
+
+  /**
+   * Closes the least recently used idle descriptors until at most <limit>
+   * are open, or none are idle.
+   */
+  void trimLocked(const std::size_t limit);
+
+  const std::size_t capacity;
+  std::mutex mutex;
+  std::size_t open_count;
+  // Slots with an open descriptor no transfer is using, least recently used
+  // first.
+  std::list<Slot *> idle;
+};
+
+namespace {
+
+const std::size_t DIRECT_IO_ALIGNMENT = StorageBackend::DIRECT_IO_ALIGNMENT;
+
+/**
+ * Heap buffer aligned for direct I/O.
+ */
+class AlignedBuffer {
+ public:
+  explicit AlignedBuffer(const std::size_t length) : data_(nullptr) {
+    void *data;
+    if (::posix_memalign(&data, DIRECT_IO_ALIGNMENT, length) != 0) {
+      throw std::bad_alloc();
+    }
+    data_ = static_cast<char *>(data);
+  }
+  ~AlignedBuffer() { std::free(data_); }
+  AlignedBuffer(const AlignedBuffer &) = delete;
+  AlignedBuffer &operator=(const AlignedBuffer &) = delete;
+
+  char *data() { return data_; }
+
+ private:
+  char *data_;
+};
+
+// Returns this thread's aligned staging buffer, grown to at least <length>
+// bytes.
+char *stagingBuffer(const std::size_t length) {
+  static thread_local std::unique_ptr<AlignedBuffer> buffer;
+  static thread_local std::size_t buffer_length = 0;
+  if (length > buffer_length) {
+    buffer.reset(new AlignedBuffer(length));
+    buffer_length = length;
+  }
+  return buffer->data();
+}
+
+std::size_t totalLength(const struct iovec *vectors, const int count) {
+  std::size_t total = 0;
+  for (int i = 0; i < count; ++i) {
+    total += vectors[i].iov_len;
+  }
+  return total;
+}
+
+// Returns the vectors that remain after the first <done> bytes.
+std::vector<struct iovec> remainingVectors(const struct iovec *vectors,
+                                           const int count, std::size_t done) {
+  std::vector<struct iovec> remaining;
+  for (int i = 0; i < count; ++i) {
+    if (done >= vectors[i].iov_len) {
+      done -= vectors[i].iov_len;
+      continue;
+    }
+    remaining.push_back({static_cast<char *>(vectors[i].iov_base) + done,
+                         vectors[i].iov_len - done});
+    done = 0;
+  }
+  return remaining;
+}
+
+/**
+ * Backend for a file in the filesystem.
+ */
+class PosixBackend : public StorageBackend {
+ public:
+  PosixBackend(const std::string &name, const int fd,
+               std::shared_ptr<PosixStorage::DescriptorCache> descriptors)
+      : name_(name), descriptors_(descriptors), direct_io_(false) {
+    descriptors_->adopt(slot_, fd);
+  }
+
+  ~PosixBackend() override { descriptors_->forget(slot_); }
+
+  std::size_t read(void *buffer, const std::size_t length,
+                   const off_t offset) override {
+    if (direct_io_ &&
+        reinterpret_cast<std::uintptr_t>(buffer) % DIRECT_IO_ALIGNMENT != 0) {
+      char *staging = stagingBuffer(length);
+      const std::size_t bytes_read = read(staging, length, offset);
+      std::memcpy(buffer, staging, bytes_read);
+      return bytes_read;
+    }
+    const Descriptor fd(*this);
+    char *position = static_cast<char *>(buffer);
+    std::size_t done = 0;
+    while (done < length) {
+      const ssize_t bytes_read =
+          ::pread(fd, position + done, length - done, offset + done);
+      if (bytes_read < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EINVAL && disableDirectIO(fd)) continue;
+        throw FileIOException(name_, errno);
+      }
+      if (bytes_read == 0) {
+        break;  // end of file
+      }
+      done += bytes_read;
+    }
+    return done;
+  }
+
+  std::size_t readv(const struct iovec *vectors, const int count,
+                    const off_t offset) override {
+    const std::size_t total = totalLength(vectors, count);
+    if (direct_io_) {
+      // Gather through one aligned buffer.
+      char *staging = stagingBuffer(total);
+      const std::size_t bytes_read = read(staging, total, offset);
+      std::size_t copied = 0;
+      for (int i = 0; i < count && copied < bytes_read; ++i) {
+        const std::size_t length =
+            std::min(vectors[i].iov_len, bytes_read - copied);
+        std::memcpy(vectors[i].iov_base, staging + copied, length);
+        copied += length;
+      }
+      return bytes_read;
+    }
+    const Descriptor fd(*this);
+    ssize_t bytes_read;
+    while ((bytes_read = ::preadv(fd, vectors, count, offset)) < 0) {
+      // The descriptor may still be direct if direct I/O was turned on
+      // since direct_io_ was checked.
+      if (errno == EINTR) continue;
+      if (errno == EINVAL && disableDirectIO(fd)) continue;
+      throw FileIOException(name_, errno);
+    }
+    if (bytes_read == 0 || static_cast<std::size_t>(bytes_read) == total) {
+      return bytes_read;
+    }
+    // Short read; finish (or find the end of file) a buffer at a time.
+    const std::vector<struct iovec> rest =
+        remainingVectors(vectors, count, bytes_read);
+    return bytes_read +
+           StorageBackend::readv(rest.data(), rest.size(), offset + bytes_read);
+  }
+
+  void write(const void *buffer, const std::size_t length,
+             const off_t offset) override {
+    if (direct_io_ &&
+        reinterpret_cast<std::uintptr_t>(buffer) % DIRECT_IO_ALIGNMENT != 0) {
+      char *staging = stagingBuffer(length);
+      std::memcpy(staging, buffer, length);
+      write(staging, length, offset);
+      return;
+    }
+    const Descriptor fd(*this);
+    const char *position = static_cast<const char *>(buffer);
+    std::size_t done = 0;
+    while (done < length) {
+      const ssize_t bytes_written =
+          ::pwrite(fd, position + done, length - done, offset + done);
+      if (bytes_written < 0) {
+        if (errno == EINTR) continue;
+        if (errno == EINVAL && disableDirectIO(fd)) continue;
+        throw FileIOException(name_, errno);
+      }
+      done += bytes_written;
+    }
+  }
+
+  void writev(const struct iovec *vectors, const int count,
+              const off_t offset) override {
+    const std::size_t total = totalLength(vectors, count);
+    if (direct_io_) {
+      char *staging = stagingBuffer(total);
+      std::size_t copied = 0;
+      for (int i = 0; i < count; ++i) {
+        std::memcpy(staging + copied, vectors[i].iov_base, vectors[i].iov_len);
+        copied += vectors[i].iov_len;
+      }
+      write(staging, total, offset);
+      return;
+    }
+    const Descriptor fd(*this);
+    ssize_t bytes_written;
+    while ((bytes_written = ::pwritev(fd, vectors, count, offset)) < 0) {
+      if (errno == EINTR) continue;
+      if (errno == EINVAL && disableDirectIO(fd)) continue;
+      throw FileIOException(name_, errno);
+    }
+    if (static_cast<std::size_t>(bytes_written) < total) {
+      // Rare partial write (e.g. a full disk); retry the rest.
+      const std::vector<struct iovec> rest =
+          remainingVectors(vectors, count, bytes_written);
+      StorageBackend::writev(rest.data(), rest.size(), offset + bytes_written);
+    }
+  }
+
+  void sync() override {
+    const Descriptor fd(*this);
+    int result;
+    do {
+      result = ::fdatasync(fd);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+      throw FileIOException(name_, errno);
+    }
+  }
+
+  off_t size() override {
+    const Descriptor fd(*this);
+    struct stat file_status;
+    if (::fstat(fd, &file_status) != 0) {
+      throw FileIOException(name_, errno);
+    }
+    return file_status.st_size;
+  }
+
+  bool reserve(const off_t offset, const off_t length) override {
+    const Descriptor fd(*this);
+    // FALLOC_FL_KEEP_SIZE leaves the file size alone, so bytes past the last
+    // ones written still read back as past the end of the file.
+    if (::fallocate(fd, FALLOC_FL_KEEP_SIZE, offset, length) != 0) {
+      if (errno == EOPNOTSUPP || errno == ENOSYS) {
+        return false;
+      }
+      throw FileIOException(name_, errno);
+    }
+    return true;
+  }
+
+  bool punchHole(const off_t offset, const off_t length) override {
+    const Descriptor fd(*this);
+    if (::fallocate(fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE, offset,
+                    length) != 0) {
+      if (errno == EOPNOTSUPP || errno == ENOSYS) {
+        return false;
+      }
+      throw FileIOException(name_, errno);
+    }
+    return true;
+  }
+
+  bool truncate(const off_t length) override {
+    const Descriptor fd(*this);
+    int result;
+    do {
+      result = ::ftruncate(fd, length);
+    } while (result < 0 && errno == EINTR);
+    if (result < 0) {
+      throw FileIOException(name_, errno);
+    }
+    return true;
+  }
+
+  bool setDirectIO(const bool enable) override {
+    // Descriptors opened later pick the setting up from direct_io_.
+    const Descriptor fd(*this);
+    const int flags = ::fcntl(fd, F_GETFL);
+    if (flags < 0) {
+      throw FileIOException(name_, errno);
+    }
+    const int new_flags = enable ? flags | O_DIRECT : flags & ~O_DIRECT;
+    if (::fcntl(fd, F_SETFL, new_flags) != 0) {
+      if (errno != EINVAL) {
+        throw FileIOException(name_, errno);
+      }
+      // Filesystem doesn't support direct I/O (e.g. tmpfs); stay buffered.
+      direct_io_ = false;
+      return false;
+    }
+    direct_io_ = enable;
+    return enable;
+  }
+
+  bool directIO() const override { return direct_io_; }
+
+  void advise(const off_t offset, const off_t length,
+              const Advice advice) override {
+    int file_advice = POSIX_FADV_NORMAL;
+    switch (advice) {
+      case Advice::NORMAL:
+        break;
+      case Advice::SEQUENTIAL:
+        file_advice = POSIX_FADV_SEQUENTIAL;
+        break;
+      case Advice::RANDOM:
+        file_advice = POSIX_FADV_RANDOM;
+        break;
+      case Advice::WILLNEED:
+        file_advice = POSIX_FADV_WILLNEED;
+        break;
+      case Advice::DONTNEED:
+        file_advice = POSIX_FADV_DONTNEED;
+        break;
+    }
+    // Advice is only a hint, so failures are ignored.  It is lost if the
+    // descriptor is closed and reopened later.
+    const Descriptor fd(*this);
+    ::posix_fadvise(fd, offset, length, file_advice);
+  }
+
+  bool mappable() const override { return true; }
+
+  const char *map(const std::size_t length) override {
+    // The mapping stays valid after the descriptor is closed.
+    const Descriptor fd(*this);
+    void *address =
+        ::mmap(NULL, length, PROT_READ, MAP_SHARED, fd, 0 /* offset */);
+    if (address == MAP_FAILED) {
+      throw FileIOException(name_, errno);
+    }
+    return static_cast<const char *>(address);
+  }
+
+  void unmap(const char *address, const std::size_t length) override {
+    ::munmap(const_cast<char *>(address), length);
+  }
+
+ private:
+  /**
+   * Holds one of the file's descriptors open for the duration of a transfer.
+   */
+  class Descriptor {
+   public:
+    explicit Descriptor(PosixBackend &backend)
+        : backend_(backend),
+          fd_(backend.descriptors_->acquire(backend.slot_, backend.name_,
+                                            backend.openFlags())) {}
+    ~Descriptor() { backend_.descriptors_->release(backend_.slot_); }
+    Descriptor(const Descriptor &) = delete;
+    Descriptor &operator=(const Descriptor &) = delete;
+
+    operator int() const { return fd_; }
+
+   private:
+    PosixBackend &backend_;
+    const int fd_;
+  };
+
+  // Flags for reopening the file.
+  int openFlags() const { return O_RDWR | (direct_io_ ? O_DIRECT : 0); }
+
+  // Switches back to buffered I/O after the filesystem rejected a direct
+  // transfer.  Returns true if direct I/O was in use, i.e. the transfer may
+  // be retried.
+  bool disableDirectIO(const int fd) {
+    if (!direct_io_.exchange(false)) {
+      return false;
+    }
+    const int flags = ::fcntl(fd, F_GETFL);
+    if (flags >= 0) {
+      ::fcntl(fd, F_SETFL, flags & ~O_DIRECT);
+    }
+    return true;
+  }
+
+  const std::string name_;
+  const std::shared_ptr<PosixStorage::DescriptorCache> descriptors_;
+  PosixStorage::DescriptorCache::Slot slot_;
+  std::atomic<bool> direct_io_;
+};
+
+/**
+ * Backend for a file held in memory.
+ */
+class MemoryBackend : public StorageBackend {
+ public:
+  explicit MemoryBackend(std::shared_ptr<MemoryStorage::Contents> contents)
+      : contents_(contents) {}
+
+  std::size_t read(void *buffer, const std::size_t length,
+                   const off_t offset) override {
+    std::lock_guard<std::mutex> lock(contents_->mutex);
+    const std::vector<char> &bytes = contents_->bytes;
+    if (offset >= static_cast<off_t>(bytes.size())) {
+      return 0;
+    }
+    const std::size_t bytes_read =
+        std::min(length, static_cast<std::size_t>(bytes.size() - offset));
+    std::memcpy(buffer, bytes.data() + offset, bytes_read);
+    return bytes_read;
+  }
+
+  void write(const void *buffer, const std::size_t length,
+             const off_t offset) override {
+    std::lock_guard<std::mutex> lock(contents_->mutex);
+    std::vector<char> &bytes = contents_->bytes;
+    if (offset + length > bytes.size()) {
+      bytes.resize(offset + length);
+    }
+    std::memcpy(bytes.data() + offset, buffer, length);
+  }
+
+  void sync() override {}
+
+  off_t size() override {
+    std::lock_guard<std::mutex> lock(contents_->mutex);
+    return contents_->bytes.size();
+  }
+
+  bool reserve(const off_t offset, const off_t length) override {
+    std::lock_guard<std::mutex> lock(contents_->mutex);
+    contents_->bytes.reserve(offset + length);
+    return true;
+  }
+
+  bool truncate(const off_t length) override {
+    std::lock_guard<std::mutex> lock(contents_->mutex);
+    std::vector<char> &bytes = contents_->bytes;
+    if (length < static_cast<off_t>(bytes.size())) {
+      bytes.resize(length);
+      bytes.shrink_to_fit();
+    }
+    return true;
+  }
+
+ private:
+  std::shared_ptr<MemoryStorage::Contents> contents_;
+};
+
+/**
+ * Backend that delays the transfers of another backend.
+ */
+class ThrottledBackend : public StorageBackend {
+ public:
+  ThrottledBackend(std::unique_ptr<StorageBackend> inner,
+                   std::shared_ptr<ThrottledStorage::Device> device)
+      : inner_(std::move(inner)), device_(device) {}
+
+  std::size_t read(void *buffer, const std::size_t length,
+                   const off_t offset) override {
+    device_->transfer(length, device_->profile.read_latency);
+    return inner_->read(buffer, length, offset);
+  }
+
+  std::size_t readv(const struct iovec *vectors, const int count,
+                    const off_t offset) override {
+    device_->transfer(totalLength(vectors, count),
+                      device_->profile.read_latency);
+    return inner_->readv(vectors, count, offset);
+  }
+
+  void write(const void *buffer, const std::size_t length,
+             const off_t offset) override {
+    device_->transfer(length, device_->profile.write_latency);
+    inner_->write(buffer, length, offset);
+  }
+
+  void writev(const struct iovec *vectors, const int count,
+              const off_t offset) override {
+    device_->transfer(totalLength(vectors, count),
+                      device_->profile.write_latency);
+    inner_->writev(vectors, count, offset);
+  }
+
+  void sync() override {
+    device_->transfer(0, device_->profile.sync_latency);
+    inner_->sync();
+  }
+
+  off_t size() override { return inner_->size(); }
+
+  bool reserve(const off_t offset, const off_t length) override {
+    return inner_->reserve(offset, length);
+  }
+
+  bool punchHole(const off_t offset, const off_t length) override {
+    return inner_->punchHole(offset, length);
+  }
+
+  bool truncate(const off_t length) override {
+    return inner_->truncate(length);
+  }
+
+  bool setDirectIO(const bool enable) override {
+    return inner_->setDirectIO(enable);
+  }
+
+  bool directIO() const override { return inner_->directIO(); }
+
+  void advise(const off_t offset, const off_t length,
+              const Advice advice) override {
+    inner_->advise(offset, length, advice);
+  }
+
+ private:
+  std::unique_ptr<StorageBackend> inner_;
+  std::shared_ptr<ThrottledStorage::Device> device_;
+};
+
+}  // namespace
+
+std::size_t StorageBackend::readv(const struct iovec *vectors, const int count,
+                                  const off_t offset) {
+  std::size_t done = 0;
+  for (int i = 0; i < count; ++i) {
+    const std::size_t bytes_read =
+        read(vectors[i].iov_base, vectors[i].iov_len, offset + done);
+    done += bytes_read;
+    if (bytes_read < vectors[i].iov_len) {
+      break;  // end of store
+    }
+  }
+  return done;
+}
+
+void StorageBackend::writev(const struct iovec *vectors, const int count,
+                            const off_t offset) {
+  std::size_t done = 0;
+  for (int i = 0; i < count; ++i) {
+    write(vectors[i].iov_base, vectors[i].iov_len, offset + done);
+    done += vectors[i].iov_len;
+  }
+}
+
+int PosixStorage::DescriptorCache::acquire(Slot &slot, const std::string &name,
+                                           const int flags) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (slot.fd >= 0) {
+    if (slot.users++ == 0) {
+      idle.erase(slot.idle_position);
+    }
+    return slot.fd;
+  }
+
+  trimLocked(capacity - 1);
+  int fd;
+  while (true) {
+    fd = ::open(name.c_str(), flags);
+    if (fd >= 0) break;
+    if (errno == EINTR) continue;
+    // Out of descriptors for reasons outside the cache; make room if we can.
+    if ((errno == EMFILE || errno == ENFILE) && !idle.empty()) {
+      trimLocked(open_count - 1);
+      continue;
+    }
+    throw FileIOException(name, errno);
+  }
+  slot.fd = fd;
+  slot.users = 1;
+  open_count++;
+  return fd;
+}
+
+void PosixStorage::DescriptorCache::release(Slot &slot) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (--slot.users == 0) {
+    slot.idle_position = idle.insert(idle.end(), &slot);
+    // The cache may have gone over capacity while every descriptor was busy.
+    trimLocked(capacity);
+  }
+}
+
+void PosixStorage::DescriptorCache::adopt(Slot &slot, const int fd) {
+  std::lock_guard<std::mutex> lock(mutex);
+  slot.fd = fd;
+  slot.users = 0;
+  slot.idle_position = idle.insert(idle.end(), &slot);
+  open_count++;
+  trimLocked(capacity);
+}
+
+void PosixStorage::DescriptorCache::forget(Slot &slot) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (slot.fd >= 0) {
+    idle.erase(slot.idle_position);
+    ::close(slot.fd);
+    slot.fd = -1;
+    open_count--;
+  }
+}
+
+void PosixStorage::DescriptorCache::trimLocked(const std::size_t limit) {
+  while (open_count > limit && !idle.empty()) {
+    Slot *victim = idle.front();
+    idle.pop_front();
+    ::close(victim->fd);
+    victim->fd = -1;
+    open_count--;
+  }
+}
+
+PosixStorage::PosixStorage(const std::size_t max_open_files) {
+  std::size_t capacity = max_open_files;
+  if (capacity == DEFAULT_MAX_OPEN_FILES) {
+    // Leave the other half of the process's descriptors to everything else.
+    struct rlimit limit;
+    capacity = 1 << 16;
+    if (::getrlimit(RLIMIT_NOFILE, &limit) == 0 &&
+        limit.rlim_cur != RLIM_INFINITY && limit.rlim_cur / 2 < capacity) {
+      capacity = limit.rlim_cur / 2;
+    }
+  }
+  descriptors_ = std::make_shared<DescriptorCache>(std::max<std::size_t>(
+      capacity, 1));
+}
+
+std::size_t PosixStorage::openDescriptors() const {
+  std::lock_guard<std::mutex> lock(descriptors_->mutex);
+  return descriptors_->open_count;
+}
+
+bool PosixStorage::exists(const std::string &name) {
+  struct stat file_status;
+  return ::stat(name.c_str(), &file_status) == 0;
+}
+
+std::unique_ptr<StorageBackend> PosixStorage::open(const std::string &name,
+                                                   const bool create_new) {
+  int flags = O_RDWR;
+  if (create_new) {
+    // Error if we try to overwrite an existing file.
+    flags |= O_CREAT | O_EXCL;
+  }
+  int fd;
+  do {
+    fd = ::open(name.c_str(), flags, 0666);
+  } while (fd < 0 && errno == EINTR);
+  if (fd < 0) {
+    if (errno == EEXIST) {
+      throw FileExistsException(name);
+    }
+    if (errno == ENOENT) {
+      // Error if we try to open a file that doesn't exist.
+      throw FileNotFoundException(name);
+    }
+    throw FileIOException(name, errno);
+  }
+  return std::unique_ptr<StorageBackend>(
+      new PosixBackend(name, fd, descriptors_));
+}
+
+void PosixStorage::remove(const std::string &name) {
+  if (std::remove(name.c_str()) != 0) {
+    throw FileIOException(name, errno);
+  }
+}
+
+void PosixStorage::rename(const std::string &from, const std::string &to) {
+  if (std::rename(from.c_str(), to.c_str()) != 0) {
+    throw FileIOException(to, errno);
+  }
+}
+
+bool MemoryStorage::exists(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  return files_.find(name) != files_.end();
+}
+
+std::unique_ptr<StorageBackend> MemoryStorage::open(const std::string &name,
+                                                    const bool create_new) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto file = files_.find(name);
+  if (create_new) {
+    if (file != files_.end()) {
+      throw FileExistsException(name);
+    }
+    file = files_.emplace(name, std::make_shared<Contents>()).first;
+  } else if (file == files_.end()) {
+    throw FileNotFoundException(name);
+  }
+  return std::unique_ptr<StorageBackend>(new MemoryBackend(file->second));
+}
+
+void MemoryStorage::remove(const std::string &name) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (files_.erase(name) == 0) {
+    throw FileNotFoundException(name);
+  }
+}
+
+void MemoryStorage::rename(const std::string &from, const std::string &to) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  auto file = files_.find(from);
+  if (file == files_.end()) {
+    throw FileNotFoundException(from);
+  }
+  std::shared_ptr<Contents> contents = file->second;
+  files_.erase(file);
+  files_[to] = contents;
+}
+
+ThrottledStorage::ThrottledStorage(std::shared_ptr<StorageProvider> inner,
+                                   const DeviceProfile &profile)
+    : inner_(inner), device_(std::make_shared<Device>()) {
+  device_->profile = profile;
+  device_->busy_until = std::chrono::steady_clock::now();
+}
+
+bool ThrottledStorage::exists(const std::string &name) {
+  return inner_->exists(name);
+}
+
+std::unique_ptr<StorageBackend> ThrottledStorage::open(const std::string &name,
+                                                       const bool create_new) {
+  return std::unique_ptr<StorageBackend>(
+      new ThrottledBackend(inner_->open(name, create_new), device_));
+}
+
+void ThrottledStorage::remove(const std::string &name) {
+  inner_->remove(name);
+}
+
+void ThrottledStorage::rename(const std::string &from, const std::string &to) {
+  inner_->rename(from, to);
+}
+
+void ThrottledStorage::Device::transfer(
+    const std::size_t bytes, const std::chrono::microseconds latency) {
+  std::chrono::steady_clock::time_point done;
+  {
+    // The data moves once the latency has passed and the device has
+    // finished the transfers queued before this one.
+    std::lock_guard<std::mutex> lock(mutex);
+    const auto start =
+        std::max(std::chrono::steady_clock::now() + latency, busy_until);
+    const std::chrono::nanoseconds transfer_time(
+        profile.bytes_per_second == 0
+            ? 0
+            : bytes * UINT64_C(1000000000) / profile.bytes_per_second);
+    busy_until = start + transfer_time;
+    done = busy_until;
+  }
+  std::this_thread::sleep_until(done);
+}
+
+}  // namespace badgerdb
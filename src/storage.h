@@ -0,0 +1,385 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <sys/types.h>
+#include <sys/uio.h>
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace badgerdb {
+
+/**
+ * @brief Expected access pattern for a range of pages, passed on to the
+ *        operating system with File::advise().
+ */
+enum class Advice {
+  /**
+   * No particular pattern; undoes earlier advice.
+   */
+  NORMAL,
+
+  /**
+   * Pages will be read in increasing order, so read ahead aggressively and
+   * drop pages soon after they are read.
+   */
+  SEQUENTIAL,
+
+  /**
+   * Pages will be read in no particular order, so don't read ahead.
+   */
+  RANDOM,
+
+  /**
+   * Pages will be read soon, so start reading them in now.
+   */
+  WILLNEED,
+
+  /**
+   * Pages won't be read soon, so their cached copies may be dropped.
+   */
+  DONTNEED
+};
+
+/**
+ * @brief Byte-addressed store holding the contents of one open file.
+ *
+ * File lays its header, bitmaps and pages out at byte offsets and moves them
+ * through a StorageBackend, obtained from a StorageProvider when the file is
+ * opened.  Backends throw FileIOException when a transfer fails.  Several
+ * threads may read and write disjoint ranges at once.
+ *
+ * Only read, write, sync and size are required; the other operations
+ * describe optional capabilities and default to "not supported".
+ */
+class StorageBackend {
+ public:
+  /**
+   * Alignment of buffers, offsets and lengths for transfers that bypass the
+   * operating system's cache.  File keeps its pages and metadata blocks at
+   * multiples of Page::SIZE, which is a multiple of this.
+   */
+  static const std::size_t DIRECT_IO_ALIGNMENT = 4096;
+
+  virtual ~StorageBackend() {}
+
+  /**
+   * Reads <length> bytes at <offset> into <buffer>.
+   *
+   * @return  Number of bytes read; less than <length> only at the end of the
+   *          store.
+   */
+  virtual std::size_t read(void *buffer, const std::size_t length,
+                           const off_t offset) = 0;
+
+  /**
+   * Reads consecutive bytes at <offset> into several buffers.
+   *
+   * @return  Number of bytes read; less than the total length only at the
+   *          end of the store.
+   */
+  virtual std::size_t readv(const struct iovec *vectors, const int count,
+                            const off_t offset);
+
+  /**
+   * Writes <length> bytes from <buffer> at <offset>, growing the store if
+   * needed.
+   */
+  virtual void write(const void *buffer, const std::size_t length,
+                     const off_t offset) = 0;
+
+  /**
+   * Writes several buffers to consecutive bytes at <offset>.
+   */
+  virtual void writev(const struct iovec *vectors, const int count,
+                      const off_t offset);
+
+  /**
+   * Makes all writes so far durable.
+   */
+  virtual void sync() = 0;
+
+  /**
+   * Returns the size of the store in bytes.
+   */
+  virtual off_t size() = 0;
+
+  /**
+   * Reserves space for the given range without changing the size.
+   *
+   * @return  False if the store can't reserve space.
+   */
+  virtual bool reserve(const off_t offset, const off_t length) {
+    return false;
+  }
+
+  /**
+   * Gives back the space of a range without changing the size.  The range
+   * reads back as zeros afterwards.
+   *
+   * @return  False if the store can't give space back.
+   */
+  virtual bool punchHole(const off_t offset, const off_t length) {
+    return false;
+  }
+
+  /**
+   * Shrinks the store to <length> bytes.
+   *
+   * @return  False if the store can't be shrunk.
+   */
+  virtual bool truncate(const off_t length) { return false; }
+
+  /**
+   * Turns transfers that bypass the operating system's cache on or off.
+   *
+   * @return  Whether such transfers are now in use.
+   */
+  virtual bool setDirectIO(const bool enable) { return false; }
+
+  /**
+   * Returns whether transfers bypass the operating system's cache.
+   */
+  virtual bool directIO() const { return false; }
+
+  /**
+   * Passes on the expected access pattern for a range.
+   */
+  virtual void advise(const off_t offset, const off_t length,
+                      const Advice advice) {}
+
+  /**
+   * Returns whether map() is supported.
+   */
+  virtual bool mappable() const { return false; }
+
+  /**
+   * Maps the first <length> bytes read-only into memory.  Later writes are
+   * visible through the mapping.
+   *
+   * @return  Address of the mapping.
+   */
+  virtual const char *map(const std::size_t length) { return NULL; }
+
+  /**
+   * Removes a mapping returned by map().
+   */
+  virtual void unmap(const char *address, const std::size_t length) {}
+};
+
+/**
+ * @brief Namespace of named stores, and the source of their backends.
+ *
+ * File goes through the provider set with File::setStorage() to check for,
+ * open, remove and rename files.
+ */
+class StorageProvider {
+ public:
+  virtual ~StorageProvider() {}
+
+  /**
+   * Returns whether a store with the given name exists.
+   */
+  virtual bool exists(const std::string &name) = 0;
+
+  /**
+   * Opens the store with the given name.
+   *
+   * @param name        Name of the store.
+   * @param create_new  If true, create a new, empty store.
+   * @return  Backend for the store.
+   * @throws  FileExistsException     If create_new is true and the store
+   *                                  already exists.
+   * @throws  FileNotFoundException   If create_new is false and the store
+   *                                  doesn't exist.
+   */
+  virtual std::unique_ptr<StorageBackend> open(const std::string &name,
+                                               const bool create_new) = 0;
+
+  /**
+   * Removes the store with the given name, which must exist.
+   */
+  virtual void remove(const std::string &name) = 0;
+
+  /**
+   * Renames a store, replacing any store that has the new name.
+   */
+  virtual void rename(const std::string &from, const std::string &to) = 0;
+};
+
+/**
+ * @brief Stores files in the filesystem, accessed with positional system
+ *        calls.  Supports every optional backend capability.
+ *
+ * Open files do not each hold a file descriptor.  Descriptors are kept in a
+ * cache shared by all files opened through the provider, which closes the
+ * least recently used idle descriptor when it is full and reopens files on
+ * demand, so the number of open files is not limited by the process's
+ * descriptor limit.  A descriptor is never closed while a transfer on it is
+ * in progress; if every cached descriptor is busy the cache briefly goes
+ * over its capacity instead of waiting.  Relative names are resolved again
+ * on every reopen, so the working directory must not change while files are
+ * open.
+ */
+class PosixStorage : public StorageProvider {
+ public:
+  /**
+   * Capacity requesting half of the process's descriptor limit.
+   */
+  static const std::size_t DEFAULT_MAX_OPEN_FILES = 0;
+
+  /**
+   * Constructs a provider whose descriptor cache holds at most
+   * <max_open_files> idle descriptors.
+   *
+   * @param max_open_files  Capacity of the descriptor cache, or
+   *                        DEFAULT_MAX_OPEN_FILES.
+   */
+  explicit PosixStorage(
+      const std::size_t max_open_files = DEFAULT_MAX_OPEN_FILES);
+
+  bool exists(const std::string &name) override;
+  std::unique_ptr<StorageBackend> open(const std::string &name,
+                                       const bool create_new) override;
+  void remove(const std::string &name) override;
+  void rename(const std::string &from, const std::string &to) override;
+
+  /**
+   * Returns the number of descriptors currently open, busy or not.
+   */
+  std::size_t openDescriptors() const;
+
+  /**
+   * Descriptors of the files opened through this provider, shared with
+   * their backends.
+   */
+  struct DescriptorCache;
+
+ private:
+  std::shared_ptr<DescriptorCache> descriptors_;
+};
+
+/**
+ * @brief Stores files in memory.  Contents last until the file is removed or
+ *        the provider is destroyed.
+ */
+class MemoryStorage : public StorageProvider {
+ public:
+  bool exists(const std::string &name) override;
+  std::unique_ptr<StorageBackend> open(const std::string &name,
+                                       const bool create_new) override;
+  void remove(const std::string &name) override;
+  void rename(const std::string &from, const std::string &to) override;
+
+  /**
+   * Contents of one file, shared with its backends.
+   */
+  struct Contents {
+    std::mutex mutex;
+    std::vector<char> bytes;
+  };
+
+ private:
+  /**
+   * Guards files_.
+   */
+  std::mutex mutex_;
+
+  /**
+   * Files by name.
+   */
+  std::map<std::string, std::shared_ptr<Contents>> files_;
+};
+
+/**
+ * @brief Performance characteristics of a simulated device.
+ */
+struct DeviceProfile {
+  /**
+   * Time from issuing a read until its data starts to arrive.
+   */
+  std::chrono::microseconds read_latency;
+
+  /**
+   * Time from issuing a write until its data starts to be accepted.
+   */
+  std::chrono::microseconds write_latency;
+
+  /**
+   * Time taken by a sync.
+   */
+  std::chrono::microseconds sync_latency;
+
+  /**
+   * Transfer rate shared by all I/O to the device; 0 for unlimited.
+   */
+  std::uint64_t bytes_per_second;
+};
+
+/**
+ * @brief Wraps another provider, delaying every transfer as if it went to a
+ *        device with the given profile.
+ *
+ * All files opened through one ThrottledStorage share a single simulated
+ * device: latencies overlap between concurrent transfers, while the
+ * bandwidth is consumed by one transfer at a time.  Memory mapping is not
+ * offered, since mapped reads could not be delayed.
+ */
+class ThrottledStorage : public StorageProvider {
+ public:
+  /**
+   * Constructs a throttled view of another provider.
+   *
+   * @param inner     Provider that holds the data.
+   * @param profile   Characteristics of the simulated device.
+   */
+  ThrottledStorage(std::shared_ptr<StorageProvider> inner,
+                   const DeviceProfile &profile);
+
+  bool exists(const std::string &name) override;
+  std::unique_ptr<StorageBackend> open(const std::string &name,
+                                       const bool create_new) override;
+  void remove(const std::string &name) override;
+  void rename(const std::string &from, const std::string &to) override;
+
+  /**
+   * State of the simulated device, shared with its backends.
+   */
+  struct Device {
+    DeviceProfile profile;
+    std::mutex mutex;
+    std::chrono::steady_clock::time_point busy_until;
+
+    /**
+     * Blocks for the time a transfer of <bytes> bytes with the given latency
+     * takes on the device.
+     */
+    void transfer(const std::size_t bytes,
+                  const std::chrono::microseconds latency);
+  };
+
+ private:
+  /**
+   * Provider that holds the data.
+   */
+  std::shared_ptr<StorageProvider> inner_;
+
+  /**
+   * Simulated device.
+   */
+  std::shared_ptr<Device> device_;
+};
+
+}  // namespace badgerdb
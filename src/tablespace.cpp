@@ -0,0 +1,550 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#include "tablespace.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "exceptions/badgerdb_exception.h"
+#include "exceptions/file_exists_exception.h"
+#include "exceptions/file_io_exception.h"
+#include "exceptions/file_not_found_exception.h"
+
+namespace badgerdb {
+
+namespace {
+
+// Identifies a tablespace container ("TBSP").
+const std::uint32_t TABLESPACE_MAGIC = 0x50534254;
+
+const std::uint32_t TABLESPACE_VERSION = 1;
+
+// Bytes before the first extent, holding the superblock.  Keeps extents
+// aligned for files that use direct I/O in the container's provider.
+const off_t SUPERBLOCK_BYTES = 8192;
+
+/**
+ * Superblock at offset 0 of a container.
+ */
+struct Superblock {
+  std::uint32_t magic;
+  std::uint32_t version;
+  std::uint32_t extent_bytes;
+  std::uint32_t num_extents;
+  // Run of extents holding the directory.
+  std::uint32_t directory_extent;
+  std::uint32_t directory_extents;
+  std::uint64_t directory_bytes;
+};
+
+/**
+ * Run of container bytes backing part of a file.
+ */
+struct Segment {
+  off_t offset;
+  std::size_t length;
+};
+
+void append(std::vector<char> &out, const void *value, const std::size_t size) {
+  const char *bytes = static_cast<const char *>(value);
+  out.insert(out.end(), bytes, bytes + size);
+}
+
+}  // namespace
+
+struct TablespaceStorage::Space {
+  /**
+   * Directory entry of one file.  Shared with the file's backend, so that
+   * renaming the file doesn't disturb it.
+   */
+  struct Entry {
+    std::uint64_t size = 0;
+    std::vector<std::uint32_t> extents;
+  };
+
+  std::string name;
+  std::unique_ptr<StorageBackend> container;
+  std::uint32_t extent_bytes;
+
+  /**
+   * Guards everything below.
+   */
+  std::mutex mutex;
+
+  std::map<std::string, std::shared_ptr<Entry>> files;
+
+  /**
+   * Whether each extent of the container is in use.
+   */
+  std::vector<bool> used;
+
+  /**
+   * Extents holding the directory last written.
+   */
+  std::uint32_t directory_extent = 0;
+  std::uint32_t directory_extents = 0;
+
+  /**
+   * Extents given back since the directory was last written.  That
+   * directory may still map them to a file, so they are reused only once a
+   * new one is published.
+   */
+  std::vector<std::uint32_t> released;
+
+  /**
+   * Set when the directory differs from the one last written.
+   */
+  bool dirty = false;
+
+  off_t extentOffset(const std::uint32_t extent) const {
+    return SUPERBLOCK_BYTES + static_cast<off_t>(extent) * extent_bytes;
+  }
+
+  /**
+   * Reads the superblock and directory of an existing container.
+   */
+  void load();
+
+  /**
+   * Writes the directory to new extents and publishes it, if it has
+   * changed, then makes the container durable.
+   */
+  void syncLocked();
+
+  /**
+   * Hands out a free extent, <preferred> if it is free, extending the
+   * container if there are none.
+   */
+  std::uint32_t allocateLocked(const std::uint32_t preferred);
+
+  /**
+   * Hands out <count> consecutive free extents.
+   */
+  std::uint32_t allocateRunLocked(const std::uint32_t count);
+
+  /**
+   * Gives extents of a file back to the free pool once the directory is
+   * next published.
+   */
+  void releaseLocked(const Entry &entry);
+
+  /**
+   * Makes sure the file has extents for its first <end> bytes.
+   */
+  void coverLocked(Entry &entry, const std::uint64_t end);
+
+  /**
+   * Returns the container runs backing <length> bytes of the file at
+   * <offset>, merging neighbouring extents.  The range must be covered.
+   */
+  std::vector<Segment> segmentsLocked(const Entry &entry, std::uint64_t offset,
+                                      std::size_t length) const;
+};
+
+namespace {
+
+/**
+ * Backend for a file inside a tablespace.
+ */
+class TablespaceBackend : public StorageBackend {
+ public:
+  TablespaceBackend(std::shared_ptr<TablespaceStorage::Space> space,
+                    std::shared_ptr<TablespaceStorage::Space::Entry> entry)
+      : space_(space), entry_(entry) {}
+
+  std::size_t read(void *buffer, const std::size_t length,
+                   const off_t offset) override {
+    std::vector<Segment> segments;
+    std::size_t available;
+    {
+      std::lock_guard<std::mutex> lock(space_->mutex);
+      if (static_cast<std::uint64_t>(offset) >= entry_->size) {
+        return 0;
+      }
+      available = std::min<std::uint64_t>(length, entry_->size - offset);
+      segments = space_->segmentsLocked(*entry_, offset, available);
+    }
+    char *position = static_cast<char *>(buffer);
+    for (const Segment &segment : segments) {
+      const std::size_t bytes_read =
+          space_->container->read(position, segment.length, segment.offset);
+      if (bytes_read < segment.length) {
+        // Extent reserved but never written.
+        std::memset(position + bytes_read, 0, segment.length - bytes_read);
+      }
+      position += segment.length;
+    }
+    return available;
+  }
+
+  std::size_t readv(const struct iovec *vectors, const int count,
+                    const off_t offset) override {
+    // One read into a staging buffer takes the space's lock once, rather
+    // than once per vector.
+    std::size_t total = 0;
+    for (int i = 0; i < count; ++i) {
+      total += vectors[i].iov_len;
+    }
+    std::vector<char> staging(total);
+    const std::size_t bytes_read = read(staging.data(), total, offset);
+    std::size_t copied = 0;
+    for (int i = 0; i < count && copied < bytes_read; ++i) {
+      const std::size_t length =
+          std::min(vectors[i].iov_len, bytes_read - copied);
+      std::memcpy(vectors[i].iov_base, staging.data() + copied, length);
+      copied += length;
+    }
+    return bytes_read;
+  }
+
+  void write(const void *buffer, const std::size_t length,
+             const off_t offset) override {
+    std::vector<Segment> segments;
+    {
+      std::lock_guard<std::mutex> lock(space_->mutex);
+      const std::uint64_t end = offset + length;
+      space_->coverLocked(*entry_, end);
+      if (static_cast<std::uint64_t>(offset) > entry_->size) {
+        // Bytes skipped over read back as zeros, as in a filesystem.  The
+        // lock keeps this from overwriting another thread's write.
+        const std::vector<char> zeros(offset - entry_->size);
+        for (const Segment &segment : space_->segmentsLocked(
+                 *entry_, entry_->size, zeros.size())) {
+          space_->container->write(zeros.data(), segment.length,
+                                   segment.offset);
+        }
+      }
+      if (end > entry_->size) {
+        entry_->size = end;
+        space_->dirty = true;
+      }
+      segments = space_->segmentsLocked(*entry_, offset, length);
+    }
+    const char *position = static_cast<const char *>(buffer);
+    for (const Segment &segment : segments) {
+      space_->container->write(position, segment.length, segment.offset);
+      position += segment.length;
+    }
+  }
+
+  void writev(const struct iovec *vectors, const int count,
+              const off_t offset) override {
+    std::vector<char> staging;
+    for (int i = 0; i < count; ++i) {
+      append(staging, vectors[i].iov_base, vectors[i].iov_len);
+    }
+    write(staging.data(), staging.size(), offset);
+  }
+
+  void sync() override {
+    std::lock_guard<std::mutex> lock(space_->mutex);
+    space_->syncLocked();
+  }
+
+  off_t size() override {
+    std::lock_guard<std::mutex> lock(space_->mutex);
+    return entry_->size;
+  }
+
+  bool truncate(const off_t length) override {
+    std::lock_guard<std::mutex> lock(space_->mutex);
+    if (static_cast<std::uint64_t>(length) >= entry_->size) {
+      return true;
+    }
+    entry_->size = length;
+    space_->dirty = true;
+    // Hand back the extents past the new end, for reuse once the shorter
+    // size is published.
+    const std::size_t keep =
+        (length + space_->extent_bytes - 1) / space_->extent_bytes;
+    TablespaceStorage::Space::Entry dropped;
+    dropped.extents.assign(entry_->extents.begin() + keep,
+                           entry_->extents.end());
+    space_->releaseLocked(dropped);
+    entry_->extents.resize(keep);
+    return true;
+  }
+
+  // reserve() is left unsupported: extents already hand space out in
+  // units, and File's preallocation would give every small file a
+  // megabyte of them.
+
+ private:
+  std::shared_ptr<TablespaceStorage::Space> space_;
+  std::shared_ptr<TablespaceStorage::Space::Entry> entry_;
+};
+
+}  // namespace
+
+void TablespaceStorage::Space::load() {
+  Superblock superblock;
+  if (container->read(&superblock, sizeof(superblock), 0 /* offset */) !=
+          sizeof(superblock) ||
+      superblock.magic != TABLESPACE_MAGIC ||
+      superblock.version != TABLESPACE_VERSION) {
+    throw FileIOException(name, EINVAL);
+  }
+  extent_bytes = superblock.extent_bytes;
+  used.assign(superblock.num_extents, false);
+  directory_extent = superblock.directory_extent;
+  directory_extents = superblock.directory_extents;
+  std::fill(used.begin() + directory_extent,
+            used.begin() + directory_extent + directory_extents, true);
+
+  std::vector<char> directory(superblock.directory_bytes);
+  container->read(directory.data(), directory.size(),
+                  extentOffset(directory_extent));
+  const char *position = directory.data();
+  const auto take = [&position](void *value, const std::size_t size) {
+    std::memcpy(value, position, size);
+    position += size;
+  };
+  std::uint32_t num_files;
+  take(&num_files, sizeof(num_files));
+  for (std::uint32_t i = 0; i < num_files; ++i) {
+    std::uint32_t name_length;
+    take(&name_length, sizeof(name_length));
+    std::string file_name(position, name_length);
+    position += name_length;
+    std::shared_ptr<Entry> entry = std::make_shared<Entry>();
+    take(&entry->size, sizeof(entry->size));
+    std::uint32_t num_extents;
+    take(&num_extents, sizeof(num_extents));
+    entry->extents.resize(num_extents);
+    take(entry->extents.data(), num_extents * sizeof(std::uint32_t));
+    for (const std::uint32_t extent : entry->extents) {
+      used[extent] = true;
+    }
+    files.emplace(file_name, entry);
+  }
+}
+
+void TablespaceStorage::Space::syncLocked() {
+  if (!dirty) {
+    container->sync();
+    return;
+  }
+
+  std::vector<char> directory;
+  const std::uint32_t num_files = files.size();
+  append(directory, &num_files, sizeof(num_files));
+  for (const auto &file : files) {
+    const std::uint32_t name_length = file.first.size();
+    append(directory, &name_length, sizeof(name_length));
+    append(directory, file.first.data(), name_length);
+    const Entry &entry = *file.second;
+    append(directory, &entry.size, sizeof(entry.size));
+    const std::uint32_t num_extents = entry.extents.size();
+    append(directory, &num_extents, sizeof(num_extents));
+    append(directory, entry.extents.data(),
+           num_extents * sizeof(std::uint32_t));
+  }
+
+  // Write the new directory beside the old one, and only switch the
+  // superblock over once it is durable.
+  const std::uint32_t new_extents =
+      (directory.size() + extent_bytes - 1) / extent_bytes;
+  const std::uint32_t new_extent = allocateRunLocked(new_extents);
+  container->write(directory.data(), directory.size(),
+                   extentOffset(new_extent));
+  container->sync();
+
+  const Superblock superblock = {
+      TABLESPACE_MAGIC, TABLESPACE_VERSION,   extent_bytes,
+      static_cast<std::uint32_t>(used.size()), new_extent, new_extents,
+      directory.size()};
+  container->write(&superblock, sizeof(superblock), 0 /* offset */);
+  container->sync();
+
+  // Nothing published refers to the old directory or the released extents
+  // now.
+  std::fill(used.begin() + directory_extent,
+            used.begin() + directory_extent + directory_extents, false);
+  for (const std::uint32_t extent : released) {
+    used[extent] = false;
+  }
+  released.clear();
+  directory_extent = new_extent;
+  directory_extents = new_extents;
+  dirty = false;
+}
+
+std::uint32_t TablespaceStorage::Space::allocateLocked(
+    const std::uint32_t preferred) {
+  std::uint32_t extent = preferred;
+  if (extent >= used.size() || used[extent]) {
+    extent = std::find(used.begin(), used.end(), false) - used.begin();
+  }
+  if (extent == used.size()) {
+    used.push_back(false);
+  }
+  used[extent] = true;
+  dirty = true;
+  return extent;
+}
+
+std::uint32_t TablespaceStorage::Space::allocateRunLocked(
+    const std::uint32_t count) {
+  std::uint32_t run_start = 0;
+  std::uint32_t run_length = 0;
+  for (std::uint32_t extent = 0; extent < used.size() && run_length < count;
+       ++extent) {
+    if (used[extent]) {
+      run_start = extent + 1;
+      run_length = 0;
+    } else {
+      run_length++;
+    }
+  }
+  // Extend the container for whatever part of the run is missing.
+  if (run_length < count) {
+    used.resize(run_start + count, false);
+  }
+  std::fill(used.begin() + run_start, used.begin() + run_start + count, true);
+  return run_start;
+}
+
+void TablespaceStorage::Space::releaseLocked(const Entry &entry) {
+  released.insert(released.end(), entry.extents.begin(), entry.extents.end());
+  dirty = true;
+}
+
+void TablespaceStorage::Space::coverLocked(Entry &entry,
+                                           const std::uint64_t end) {
+  while (static_cast<std::uint64_t>(entry.extents.size()) * extent_bytes <
+         end) {
+    // Keep the file contiguous when the next extent is free.
+    const std::uint32_t preferred =
+        entry.extents.empty() ? 0 : entry.extents.back() + 1;
+    entry.extents.push_back(allocateLocked(preferred));
+  }
+}
+
+std::vector<Segment> TablespaceStorage::Space::segmentsLocked(
+    const Entry &entry, std::uint64_t offset, std::size_t length) const {
+  std::vector<Segment> segments;
+  while (length > 0) {
+    const std::uint32_t extent = entry.extents[offset / extent_bytes];
+    const std::uint32_t within = offset % extent_bytes;
+    const std::size_t piece =
+        std::min<std::size_t>(length, extent_bytes - within);
+    const off_t position = extentOffset(extent) + within;
+    if (!segments.empty() &&
+        segments.back().offset + static_cast<off_t>(segments.back().length) ==
+            position) {
+      segments.back().length += piece;
+    } else {
+      segments.push_back({position, piece});
+    }
+    offset += piece;
+    length -= piece;
+  }
+  return segments;
+}
+
+TablespaceStorage::TablespaceStorage(
+    std::shared_ptr<StorageProvider> container_storage,
+    const std::string &container_name, const std::uint32_t extent_bytes)
+    : space_(std::make_shared<Space>()) {
+  space_->name = container_name;
+  if (container_storage->exists(container_name)) {
+    space_->container = container_storage->open(container_name, false);
+    space_->load();
+    return;
+  }
+  if (extent_bytes == 0 || extent_bytes % 4096 != 0) {
+    throw FileIOException(container_name, EINVAL);
+  }
+  space_->container = container_storage->open(container_name, true);
+  space_->extent_bytes = extent_bytes;
+  space_->dirty = true;
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  space_->syncLocked();
+}
+
+TablespaceStorage::~TablespaceStorage() {
+  try {
+    sync();
+  } catch (const BadgerDbException &e) {
+    // Destructors must not throw; growth since the last sync is lost.
+  }
+}
+
+bool TablespaceStorage::exists(const std::string &name) {
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  return space_->files.find(name) != space_->files.end();
+}
+
+std::unique_ptr<StorageBackend> TablespaceStorage::open(
+    const std::string &name, const bool create_new) {
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  auto file = space_->files.find(name);
+  if (create_new) {
+    if (file != space_->files.end()) {
+      throw FileExistsException(name);
+    }
+    file = space_->files.emplace(name, std::make_shared<Space::Entry>()).first;
+    space_->dirty = true;
+    space_->syncLocked();
+  } else if (file == space_->files.end()) {
+    throw FileNotFoundException(name);
+  }
+  return std::unique_ptr<StorageBackend>(
+      new TablespaceBackend(space_, file->second));
+}
+
+void TablespaceStorage::remove(const std::string &name) {
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  auto file = space_->files.find(name);
+  if (file == space_->files.end()) {
+    throw FileNotFoundException(name);
+  }
+  space_->releaseLocked(*file->second);
+  space_->files.erase(file);
+  space_->syncLocked();
+}
+
+void TablespaceStorage::rename(const std::string &from, const std::string &to) {
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  auto file = space_->files.find(from);
+  if (file == space_->files.end()) {
+    throw FileNotFoundException(from);
+  }
+  std::shared_ptr<Space::Entry> entry = file->second;
+  space_->files.erase(file);
+  auto replaced = space_->files.find(to);
+  if (replaced != space_->files.end()) {
+    space_->releaseLocked(*replaced->second);
+    replaced->second = entry;
+  } else {
+    space_->files.emplace(to, entry);
+  }
+  space_->dirty = true;
+  space_->syncLocked();
+}
+
+void TablespaceStorage::sync() {
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  space_->syncLocked();
+}
+
+std::uint32_t TablespaceStorage::extentBytes() const {
+  return space_->extent_bytes;
+}
+
+std::uint32_t TablespaceStorage::numExtents() const {
+  std::lock_guard<std::mutex> lock(space_->mutex);
+  return space_->used.size();
+}
+
+}  // namespace badgerdb
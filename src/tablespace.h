@@ -0,0 +1,103 @@
+/**
+ * @author See Contributors.txt for code contributors and overview of BadgerDB.
+ *
+ * @section LICENSE
+ * Copyright (c) 2012 Database Group, Computer Sciences Department, University
+ * of Wisconsin-Madison.
+ */
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include "storage.h"
+
+namespace badgerdb {
+
+/**
+ * @brief Stores many files inside one container file.
+ *
+ * The container is divided into fixed-size extents.  Each file is a list of
+ * extents, handed out as the file grows, next to the file's last extent
+ * where possible.  A directory of file names, sizes and extent lists is
+ * kept in extents of its own and found through a superblock at the start of
+ * the container.
+ *
+ * Files stored here go through File and BufMgr like any other, so a
+ * database with thousands of small files needs one container, one
+ * descriptor, and writes that land close together:
+ *
+ * @code
+ *   File::setStorage(std::make_shared<TablespaceStorage>(
+ *       std::make_shared<PosixStorage>(), "database.tbs"));
+ *   File file = File::create("orders");
+ * @endcode
+ *
+ * The directory is rewritten to new extents and then published by
+ * rewriting the superblock, so a crash leaves the previous directory in
+ * place.  Creating, removing and renaming files updates it at once; growth
+ * of a file reaches it when the file is synced.  Memory mapping and direct
+ * I/O are not offered.
+ */
+class TablespaceStorage : public StorageProvider {
+ public:
+  /**
+   * Default size of an extent for new containers.
+   */
+  static const std::uint32_t DEFAULT_EXTENT_BYTES = 64 * 1024;
+
+  /**
+   * Opens the container with the given name, creating it if it doesn't
+   * exist.
+   *
+   * @param container_storage   Provider holding the container.
+   * @param container_name      Name of the container.
+   * @param extent_bytes        Size of an extent if the container is
+   *                            created; a multiple of 4096.  Existing
+   *                            containers keep theirs.
+   * @throws  FileIOException   If the container is not a tablespace, or
+   *                            extent_bytes is not valid.
+   */
+  TablespaceStorage(std::shared_ptr<StorageProvider> container_storage,
+                    const std::string &container_name,
+                    const std::uint32_t extent_bytes = DEFAULT_EXTENT_BYTES);
+
+  /**
+   * Writes out the directory if files have grown since it was last written.
+   */
+  ~TablespaceStorage() override;
+
+  bool exists(const std::string &name) override;
+  std::unique_ptr<StorageBackend> open(const std::string &name,
+                                       const bool create_new) override;
+  void remove(const std::string &name) override;
+  void rename(const std::string &from, const std::string &to) override;
+
+  /**
+   * Writes out the directory if it has changed and makes the container
+   * durable.
+   */
+  void sync();
+
+  /**
+   * Returns the size of an extent in bytes.
+   */
+  std::uint32_t extentBytes() const;
+
+  /**
+   * Returns the number of extents in the container, used or free.
+   */
+  std::uint32_t numExtents() const;
+
+  /**
+   * Contents of the container, shared with the backends of open files.
+   */
+  struct Space;
+
+ private:
+  std::shared_ptr<Space> space_;
+};
+
+}  // namespace badgerdb